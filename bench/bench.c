@@ -0,0 +1,1815 @@
+/*
+ * Benchmarks for the scripts in src/.
+ *
+ * This is a single file on purpose, just like the scripts themselves. Build and run it with:
+ *
+ *      cc -O3 -march=native -std=gnu11 bench/bench.c -o bench_voxeldev -lm -lpthread
+ *      ./bench_voxeldev [maxSize] [minMillisPerMeasurement] [--csv]
+ *
+ * maxSize (default 256) limits the edge length of the volumes, minMillisPerMeasurement (default 50) is the minimum time
+ * spent on each measurement (the kernel is repeated until it's reached). --csv prints machine readable output, which is
+ * handy for diffing the results of two builds to catch regressions.
+ *
+ * Reported numbers:
+ *  -   ns/voxel (or ns/op):    wall clock time per element
+ *  -   GB/s:                   bytes the kernel has to read + write per element, divided by the time. This is a
+ *                              model of the traffic (see the comments at the measurements), not a hardware counter.
+ *  -   cyc/voxel (or cyc/op):  rdtsc ticks per element. Note that the TSC runs at a constant rate, so this only equals
+ *                              core cycles if the core is running at its nominal frequency.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <x86intrin.h>
+
+// cpmath defines generic macros (min, div, length, ...), so it has to be included after the standard headers
+#include "../src/BoolArrToManhattan.h"
+#include "../src/BoolArrToSignedManhattan.h"
+#include "../src/FlowField.h"
+#include "../src/Noise.h"
+#include "../src/DistanceFieldAO.h"
+#include "../src/VoxelCollision.h"
+#include "../src/LineOfSight.h"
+#include "../src/BlockLight.h"
+#include "../src/OctantDistanceField.h"
+#include "../src/DistanceFieldFile.h"
+#include "../src/MaterialDistanceField.h"
+#include "../src/ConnectedComponents.h"
+#include "../src/ChunkVisibility.h"
+#include "../src/HiZOcclusion.h"
+#include "../src/OccupancyLod.h"
+#include "../src/SurfaceNets.h"
+#include "../src/FieldSampler.h"
+#include "../src/DistanceFieldJobs.h"
+#include "../src/cpmath.h"
+
+/**
+ * Timing
+ */
+
+static int g_minMillis = 50;
+static int g_csv = 0;
+
+// the compiler must not be able to prove that benchmarked results are unused
+static volatile uint64_t g_sink;
+
+typedef struct BenchTime
+{
+    double nanoseconds;
+    double ticks;
+    uint64_t reps;
+} BenchTime;
+
+static inline double nowNanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+// Runs setup (untimed) and kernel (timed) alternately until at least g_minMillis have been spent inside the kernel.
+// Each rep is timed separately, so setup can restore state that the kernel modifies in place.
+#define BENCH_MEASURE(result, setup, kernel)                                \
+    do {                                                                    \
+        double ns_ = 0.0, ticks_ = 0.0;                                     \
+        uint64_t reps_ = 0;                                                 \
+        { setup; kernel; } /* warm up caches and page in the buffers */     \
+        while (ns_ < g_minMillis * 1e6 || reps_ < 3)                        \
+        {                                                                   \
+            setup;                                                          \
+            double t0_ = nowNanoseconds();                                  \
+            uint64_t c0_ = __rdtsc();                                       \
+            kernel;                                                         \
+            uint64_t c1_ = __rdtsc();                                       \
+            double t1_ = nowNanoseconds();                                  \
+            ns_ += t1_ - t0_;                                               \
+            ticks_ += (double) (c1_ - c0_);                                 \
+            reps_++;                                                        \
+        }                                                                   \
+        (result) = (BenchTime) { ns_, ticks_, reps_ };                      \
+    } while (0)
+
+static void printHeader(const char* title, const char* unit)
+{
+    if (g_csv)
+        return;
+    printf("\n%s\n", title);
+    printf("%-18s %-8s %-10s %12s %10s %12s\n", "case", "size", "stage", unit[0] == 'v' ? "ns/voxel" : "ns/op", "GB/s",
+           unit[0] == 'v' ? "cyc/voxel" : "cyc/op");
+}
+
+// elements is the number of voxels / ops per rep, bytes the modeled memory traffic per rep
+static void printResult(const char* name, const char* size, const char* stage, BenchTime t, double elements, double bytes)
+{
+    double count = elements * (double) t.reps;
+    double nsPerElement = t.nanoseconds / count;
+    double gbs = bytes * (double) t.reps / t.nanoseconds;
+    double ticksPerElement = t.ticks / count;
+
+    if (g_csv)
+        printf("%s,%s,%s,%.4f,%.3f,%.4f\n", name, size, stage, nsPerElement, gbs, ticksPerElement);
+    else
+        printf("%-18s %-8s %-10s %12.4f %10.3f %12.4f\n", name, size, stage, nsPerElement, gbs, ticksPerElement);
+}
+
+/**
+ * Occupancy patterns
+ */
+
+static uint32_t g_rngState = 0x9E3779B9u;
+
+static inline uint32_t xorshift32()
+{
+    uint32_t x = g_rngState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return g_rngState = x;
+}
+
+static inline float randomFloat(float lo, float hi)
+{
+    return lo + (hi - lo) * (float) (xorshift32() & 0xFFFFFF) / (float) 0x1000000;
+}
+
+// integer hash -> [0, 1), used for the lattice values of the noise below
+static inline float hash3(int x, int y, int z)
+{
+    uint32_t h = (uint32_t) x * 0x8DA6B343u ^ (uint32_t) y * 0xD8163841u ^ (uint32_t) z * 0xCB1AB31Fu;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return (float) (h & 0xFFFFFF) / (float) 0x1000000;
+}
+
+static inline float smooth(float t)
+{
+    return t * t * (3.0f - 2.0f * t);
+}
+
+// plain trilinear value noise, good enough to produce cave like structures
+static float valueNoise3(float x, float y, float z)
+{
+    int ix = (int) floorf(x), iy = (int) floorf(y), iz = (int) floorf(z);
+    float fx = smooth(x - (float) ix), fy = smooth(y - (float) iy), fz = smooth(z - (float) iz);
+
+    float c00 = hash3(ix, iy, iz) + fx * (hash3(ix + 1, iy, iz) - hash3(ix, iy, iz));
+    float c10 = hash3(ix, iy + 1, iz) + fx * (hash3(ix + 1, iy + 1, iz) - hash3(ix, iy + 1, iz));
+    float c01 = hash3(ix, iy, iz + 1) + fx * (hash3(ix + 1, iy, iz + 1) - hash3(ix, iy, iz + 1));
+    float c11 = hash3(ix, iy + 1, iz + 1) + fx * (hash3(ix + 1, iy + 1, iz + 1) - hash3(ix, iy + 1, iz + 1));
+
+    float c0 = c00 + fy * (c10 - c00);
+    float c1 = c01 + fy * (c11 - c01);
+    return c0 + fz * (c1 - c0);
+}
+
+typedef enum Pattern
+{
+    PATTERN_EMPTY,
+    PATTERN_FULL,
+    PATTERN_TERRAIN,
+    PATTERN_CAVES,
+    PATTERN_RANDOM10,
+    PATTERN_RANDOM50,
+    PATTERN_COUNT
+} Pattern;
+
+static const char* PATTERN_NAMES[PATTERN_COUNT] = {
+        "empty", "full", "terrain", "caves", "random10", "random50"
+};
+
+// y is the up axis for the terrain pattern
+static void fillPattern(bool* boolArr, int size, Pattern pattern)
+{
+    const size_t count = (size_t) size * size * size;
+    g_rngState = 0x9E3779B9u;
+
+    switch (pattern)
+    {
+        case PATTERN_EMPTY:
+            memset(boolArr, 0, count);
+            break;
+        case PATTERN_FULL:
+            memset(boolArr, 1, count);
+            break;
+        case PATTERN_TERRAIN:
+            for (int z = 0; z < size; z++)
+                for (int x = 0; x < size; x++)
+                {
+                    // two octaves of value noise, height roughly between 25% and 75% of the volume
+                    float n = 0.66f * valueNoise3((float) x / 24.0f, 0.0f, (float) z / 24.0f)
+                              + 0.34f * valueNoise3((float) x / 7.0f, 17.0f, (float) z / 7.0f);
+                    int height = (int) ((0.25f + 0.5f * n) * (float) size);
+                    for (int y = 0; y < size; y++)
+                        boolArr[(size_t) z * size * size + (size_t) y * size + x] = y < height;
+                }
+            break;
+        case PATTERN_CAVES:
+            for (int z = 0; z < size; z++)
+                for (int y = 0; y < size; y++)
+                    for (int x = 0; x < size; x++)
+                        boolArr[(size_t) z * size * size + (size_t) y * size + x] =
+                                valueNoise3((float) x / 9.0f, (float) y / 9.0f, (float) z / 9.0f) > 0.42f;
+            break;
+        case PATTERN_RANDOM10:
+        case PATTERN_RANDOM50:
+        {
+            const uint32_t threshold = pattern == PATTERN_RANDOM10 ? UINT32_MAX / 10 : UINT32_MAX / 2;
+            for (size_t i = 0; i < count; i++)
+                boolArr[i] = xorshift32() < threshold;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static uint64_t checksum(const uint8_t* data, size_t count)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i += 61)
+        sum += data[i];
+    return sum;
+}
+
+/**
+ * Distance field benchmarks
+ */
+
+static void benchDistanceField(int maxSize)
+{
+    printHeader("boolArrToManhattanDF", "voxel");
+
+    for (int size = 16; size <= maxSize; size *= 2)
+    {
+        const size_t count = (size_t) size * size * size;
+        bool* boolArr = malloc(count);
+        bool* boolArrMorton = malloc(count);
+        uint64_t* bitArr = malloc((count + 63) / 64 * sizeof(uint64_t));
+        uint8_t* distanceField = malloc(count);
+        uint8_t* afterX = malloc(count);
+        uint8_t* afterY = malloc(count);
+        char sizeStr[16];
+        snprintf(sizeStr, sizeof(sizeStr), "%d^3", size);
+
+        for (int p = 0; p < PATTERN_COUNT; p++)
+        {
+            fillPattern(boolArr, size, (Pattern) p);
+            BenchTime t;
+
+            // full conversion: X reads the bools and writes the field, Y and Z read and write the field
+            BENCH_MEASURE(t, , boolArrToManhattanDF(boolArr, distanceField, size, size, size));
+            printResult(PATTERN_NAMES[p], sizeStr, "DF", t, (double) count, 6.0 * (double) count);
+
+            // compile time specialized versions for the common chunk sizes
+            if (size == 32 || size == 64)
+            {
+                if (size == 32)
+                    BENCH_MEASURE(t, , boolArrToManhattanDF32(boolArr, distanceField));
+                else
+                    BENCH_MEASURE(t, , boolArrToManhattanDF64(boolArr, distanceField));
+                printResult(PATTERN_NAMES[p], sizeStr, "DF fixed", t, (double) count, 6.0 * (double) count);
+            }
+
+            // signed field, inside and outside distances in the same passes
+            BENCH_MEASURE(t, , boolArrToSignedManhattanDF(boolArr, (int8_t*) distanceField, size, size, size));
+            printResult(PATTERN_NAMES[p], sizeStr, "DF signed", t, (double) count, 6.0 * (double) count);
+
+            // same conversion with both arrays in morton order
+            manhattanDFLinearToMorton((const uint8_t*) boolArr, (uint8_t*) boolArrMorton, size);
+            BENCH_MEASURE(t, , boolArrToManhattanDFMorton(boolArrMorton, distanceField, size));
+            printResult(PATTERN_NAMES[p], sizeStr, "DF morton", t, (double) count, 6.0 * (double) count);
+
+            // the passes work in place, so Y and Z are restored to their input state before every rep (untimed)
+            BENCH_MEASURE(t, , boolArrToManhattanDFXPASS(boolArr, distanceField, size, size, size));
+            printResult(PATTERN_NAMES[p], sizeStr, "XPASS", t, (double) count, 2.0 * (double) count);
+            memcpy(afterX, distanceField, count);
+
+            // the X pass reading one bit instead of one byte per voxel
+            for (size_t i = 0; i < count; i++)
+                bitArr[i / 64] = (bitArr[i / 64] & ~(1ull << (i % 64))) | ((uint64_t) boolArr[i] << (i % 64));
+            BENCH_MEASURE(t, , bitArrToManhattanDFXPASS(bitArr, distanceField, size, size, size));
+            printResult(PATTERN_NAMES[p], sizeStr, "XPASS bits", t, (double) count, 1.125 * (double) count);
+
+            // the whole conversion from the bit array, only the X pass differs from boolArrToManhattanDF
+            BENCH_MEASURE(t, , bitArrToManhattanDF(bitArr, distanceField, size, size, size));
+            printResult(PATTERN_NAMES[p], sizeStr, "DF bits", t, (double) count, 5.125 * (double) count);
+
+            BENCH_MEASURE(t, memcpy(distanceField, afterX, count), boolArrToManhattanDFYPASS(distanceField, size, size, size));
+            printResult(PATTERN_NAMES[p], sizeStr, "YPASS", t, (double) count, 2.0 * (double) count);
+            memcpy(afterY, distanceField, count);
+
+            BENCH_MEASURE(t, memcpy(distanceField, afterY, count), boolArrToManhattanDFZPASS(distanceField, size, size, size));
+            printResult(PATTERN_NAMES[p], sizeStr, "ZPASS", t, (double) count, 2.0 * (double) count);
+
+            g_sink += checksum(distanceField, count);
+        }
+
+        free(boolArr);
+        free(boolArrMorton);
+        free(bitArr);
+        free(distanceField);
+        free(afterX);
+        free(afterY);
+    }
+}
+
+/**
+ * Flow field benchmarks
+ */
+
+static void benchFlowField(int maxSize)
+{
+    printHeader("flowField", "voxel");
+
+    for (int size = 16; size <= maxSize && size <= 128; size *= 2)
+    {
+        const size_t count = (size_t) size * size * size;
+        bool* seeds = calloc(count, 1);
+        bool* blocked = malloc(count);
+        uint16_t* distance = malloc(count * sizeof(uint16_t));
+        uint32_t* nearestSeed = malloc(count * sizeof(uint32_t));
+        uint32_t* queue = malloc(count * sizeof(uint32_t));
+        uint8_t* direction = malloc(count);
+        char sizeStr[16];
+        snprintf(sizeStr, sizeof(sizeStr), "%d^3", size);
+
+        // a single target in the middle, the caves are the obstacles
+        fillPattern(blocked, size, PATTERN_CAVES);
+        seeds[count / 2 + size / 2] = true;
+        blocked[count / 2 + size / 2] = false;
+
+        BenchTime t;
+
+        // the passes read and write distance (2 bytes) and seed (4 bytes) three times, the seeds once and the directions once
+        BENCH_MEASURE(t, , flowFieldFromSeeds(seeds, distance, nearestSeed, direction, size, size, size));
+        printResult("one seed", sizeStr, "free", t, (double) count, 38.0 * (double) count);
+
+        // every voxel is read from / written to the queue once and its 6 neighbours are checked
+        BENCH_MEASURE(t, , flowFieldFromSeedsBlocked(seeds, blocked, distance, nearestSeed, direction, queue, size, size, size));
+        printResult("one seed", sizeStr, "blocked", t, (double) count, 23.0 * (double) count);
+
+        g_sink += checksum(direction, count);
+
+        free(seeds);
+        free(blocked);
+        free(distance);
+        free(nearestSeed);
+        free(queue);
+        free(direction);
+    }
+}
+
+/**
+ * Noise benchmarks
+ */
+
+static void benchNoise(int maxSize)
+{
+    printHeader("noise", "voxel");
+
+    for (int size = 32; size <= maxSize && size <= 128; size *= 2)
+    {
+        const size_t count = (size_t) size * size * size;
+        bool* boolArr = malloc(count);
+        uint64_t* bitArr = malloc((count + 63) / 64 * sizeof(uint64_t));
+        uint8_t* df = malloc(count);
+        char sizeStr[16];
+        snprintf(sizeStr, sizeof(sizeStr), "%d^3", size);
+
+        NoiseTerrain terrain = {
+            .noise = {.type = NOISE_SIMPLEX, .seed = 1, .frequency = 1.0f / 32.0f, .octaves = 4, .lacunarity = 2.0f, .gain = 0.5f},
+            .dimensions = 3,
+            .threshold = 0.0f,
+            .groundHeight = (float) size / 2.0f,
+            .heightFalloff = 1.0f / 16.0f
+        };
+
+        BenchTime t;
+
+        BENCH_MEASURE(t, , noiseTerrainToBoolArr(&terrain, boolArr, size, size, size));
+        printResult("simplex 3D", sizeStr, "bool", t, (double) count, 1.0 * (double) count);
+
+        BENCH_MEASURE(t, , noiseTerrainToBitArr(&terrain, boolArr, bitArr, size, size, size));
+        printResult("simplex 3D", sizeStr, "bits", t, (double) count, 1.125 * (double) count);
+
+        // generation + separate distance field vs. the X pass fused into generation
+        BENCH_MEASURE(t, , noiseTerrainToBoolArr(&terrain, boolArr, size, size, size); boolArrToManhattanDF(boolArr, df, size, size, size));
+        printResult("simplex 3D", sizeStr, "+DF", t, (double) count, 6.0 * (double) count);
+
+        // without a bool array, the distance field is the only output
+        BENCH_MEASURE(t, , noiseTerrainToManhattanDF(&terrain, NULL, df, size, size, size));
+        printResult("simplex 3D", sizeStr, "fused DF", t, (double) count, 4.0 * (double) count);
+
+        terrain.noise.type = NOISE_VALUE;
+        BENCH_MEASURE(t, , noiseTerrainToBoolArr(&terrain, boolArr, size, size, size));
+        printResult("value 3D", sizeStr, "bool", t, (double) count, 1.0 * (double) count);
+
+        terrain.noise.type = NOISE_SIMPLEX;
+        terrain.dimensions = 2;
+        BENCH_MEASURE(t, , noiseTerrainToBoolArr(&terrain, boolArr, size, size, size));
+        printResult("simplex 2D", sizeStr, "bool", t, (double) count, 1.0 * (double) count);
+
+        g_sink += checksum(df, count);
+
+        free(boolArr);
+        free(bitArr);
+        free(df);
+    }
+}
+
+/**
+ * Ambient occlusion benchmarks
+ */
+
+static void benchAO(int maxSize)
+{
+    printHeader("distanceFieldAO", "voxel");
+
+    for (int size = 32; size <= maxSize && size <= 128; size *= 2)
+    {
+        const size_t count = (size_t) size * size * size;
+        bool* boolArr = malloc(count);
+        uint8_t* df = malloc(count);
+        uint8_t* ao = malloc(count);
+        char sizeStr[16];
+        snprintf(sizeStr, sizeof(sizeStr), "%d^3", size);
+
+        fillPattern(boolArr, size, PATTERN_CAVES);
+        boolArrToManhattanDF(boolArr, df, size, size, size);
+
+        BenchTime t;
+
+        // every sample reads one byte per voxel (mostly from L1/L2), the result is written once
+        DistanceFieldAOParams params = {.steps = 4, .diagonals = false};
+        BENCH_MEASURE(t, , distanceFieldAO(df, ao, size, size, size, &params));
+        printResult("6 dirs x 4", sizeStr, "caves", t, (double) count, 26.0 * (double) count);
+
+        params.diagonals = true;
+        BENCH_MEASURE(t, , distanceFieldAO(df, ao, size, size, size, &params));
+        printResult("14 dirs x 4", sizeStr, "caves", t, (double) count, 58.0 * (double) count);
+
+        g_sink += checksum(ao, count);
+
+        free(boolArr);
+        free(df);
+        free(ao);
+    }
+
+    // 16 chunks of 32^3 with one thread per CPU
+    {
+        const int chunkCount = 16, size = 32;
+        const size_t count = (size_t) size * size * size;
+        bool* boolArr = malloc(count);
+        uint8_t* df = malloc(count);
+        uint8_t* ao = malloc(count * chunkCount);
+        DistanceFieldAOChunk chunks[16];
+
+        fillPattern(boolArr, size, PATTERN_CAVES);
+        boolArrToManhattanDF(boolArr, df, size, size, size);
+        for (int i = 0; i < chunkCount; i++)
+            chunks[i] = (DistanceFieldAOChunk) {df, ao + i * count};
+
+        BenchTime t;
+        DistanceFieldAOParams params = {.steps = 4, .diagonals = true};
+        BENCH_MEASURE(t, , distanceFieldAOChunks(chunks, chunkCount, size, size, size, &params, 0));
+        printResult("14 dirs x 4", "16x32^3", "threads", t, (double) count * chunkCount, 58.0 * (double) count * chunkCount);
+
+        g_sink += checksum(ao, count);
+
+        free(boolArr);
+        free(df);
+        free(ao);
+    }
+}
+
+/**
+ * Collision benchmarks
+ */
+
+#define COLLISION_BENCH_COUNT 4096
+
+static void benchCollision(int maxSize)
+{
+    const int size = maxSize < 128 ? maxSize : 128;
+    const size_t count = (size_t) size * size * size;
+    bool* boolArr = malloc(count);
+    uint8_t* df = malloc(count);
+    cp_vec3* centers = malloc(COLLISION_BENCH_COUNT * sizeof(cp_vec3));
+    cp_vec3* halfExtents = malloc(COLLISION_BENCH_COUNT * sizeof(cp_vec3));
+    cp_vec3* motions = malloc(COLLISION_BENCH_COUNT * sizeof(cp_vec3));
+    cp_vec3* results = malloc(COLLISION_BENCH_COUNT * sizeof(cp_vec3));
+    int* contacts = malloc(COLLISION_BENCH_COUNT * sizeof(int));
+    char sizeStr[16];
+    snprintf(sizeStr, sizeof(sizeStr), "%d^3", size);
+
+    printHeader("voxelCollision", "op");
+
+    fillPattern(boolArr, size, PATTERN_CAVES);
+    boolArrToManhattanDF(boolArr, df, size, size, size);
+
+    // player sized boxes in open space, moving up to 'reach' voxels per tick along every axis
+    const float reaches[3] = {0.5f, 4.0f, 16.0f};
+    const char* names[3] = {"walk 0.5", "run 4", "fly 16"};
+    for (int r = 0; r < 3; r++)
+    {
+        for (int i = 0; i < COLLISION_BENCH_COUNT; i++)
+        {
+            int index;
+            do
+                index = (int) (xorshift32() % count);
+            while (df[index] < 3);
+
+            centers[i] = (cp_vec3) {.x = (float) (index % size) + 0.5f, .y = (float) (index / size % size) + 0.5f,
+                                    .z = (float) (index / size / size) + 0.5f};
+            halfExtents[i] = (cp_vec3) {.x = 0.3f, .y = 0.3f, .z = 0.9f};
+            motions[i] = (cp_vec3) {.x = randomFloat(-reaches[r], reaches[r]), .y = randomFloat(-reaches[r], reaches[r]),
+                                    .z = randomFloat(-reaches[r], reaches[r])};
+        }
+
+        BenchTime t;
+        BENCH_MEASURE(t, , voxelCollisionMoveBatch(df, size, size, size, centers, halfExtents, motions, results, contacts, COLLISION_BENCH_COUNT));
+        printResult(names[r], sizeStr, "caves", t, COLLISION_BENCH_COUNT, 52.0 * COLLISION_BENCH_COUNT);
+        g_sink += (uint64_t) results[COLLISION_BENCH_COUNT / 2].x + (uint64_t) contacts[0];
+    }
+
+    free(boolArr);
+    free(df);
+    free(centers);
+    free(halfExtents);
+    free(motions);
+    free(results);
+    free(contacts);
+}
+
+/**
+ * Line of sight benchmarks
+ */
+
+#define LINE_OF_SIGHT_BENCH_COUNT 16384
+
+static void benchLineOfSight(int maxSize)
+{
+    const int size = maxSize < 128 ? maxSize : 128;
+    const size_t count = (size_t) size * size * size;
+    bool* boolArr = malloc(count);
+    uint8_t* df = malloc(count);
+    cp_vec3* from = malloc(LINE_OF_SIGHT_BENCH_COUNT * sizeof(cp_vec3));
+    cp_vec3* to = malloc(LINE_OF_SIGHT_BENCH_COUNT * sizeof(cp_vec3));
+    uint64_t* visible = malloc((LINE_OF_SIGHT_BENCH_COUNT + 63) / 64 * sizeof(uint64_t));
+    char sizeStr[16];
+    snprintf(sizeStr, sizeof(sizeStr), "%d^3", size);
+
+    printHeader("lineOfSight", "op");
+
+    const Pattern patterns[2] = {PATTERN_TERRAIN, PATTERN_CAVES};
+    for (int p = 0; p < 2; p++)
+    {
+        fillPattern(boolArr, size, patterns[p]);
+        boolArrToManhattanDF(boolArr, df, size, size, size);
+
+        // pairs of agents in open space, up to 32 voxels apart along every axis
+        for (int i = 0; i < LINE_OF_SIGHT_BENCH_COUNT; i++)
+        {
+            cp_vec3* points[2] = {from + i, to + i};
+            for (int k = 0; k < 2; k++)
+            {
+                int index;
+                do
+                {
+                    if (k == 0)
+                        index = (int) (xorshift32() % count);
+                    else
+                    {
+                        const int x = (int) from[i].x + (int) (xorshift32() % 65) - 32;
+                        const int y = (int) from[i].y + (int) (xorshift32() % 65) - 32;
+                        const int z = (int) from[i].z + (int) (xorshift32() % 65) - 32;
+                        index = x < 0 || y < 0 || z < 0 || x >= size || y >= size || z >= size ? -1 : z * size * size + y * size + x;
+                    }
+                } while (index < 0 || boolArr[index]);
+
+                *points[k] = (cp_vec3) {.x = (float) (index % size) + 0.5f, .y = (float) (index / size % size) + 0.5f,
+                                        .z = (float) (index / size / size) + 0.5f};
+            }
+        }
+
+        BenchTime t;
+        uint64_t visibleCount = 0;
+
+        BENCH_MEASURE(t, , for (int i = 0; i < LINE_OF_SIGHT_BENCH_COUNT; i++) visibleCount += lineOfSight(df, size, size, size, from[i], to[i]));
+        printResult("scalar", sizeStr, PATTERN_NAMES[patterns[p]], t, LINE_OF_SIGHT_BENCH_COUNT, 24.0 * LINE_OF_SIGHT_BENCH_COUNT);
+
+        BENCH_MEASURE(t, , lineOfSightBatch(df, size, size, size, from, to, LINE_OF_SIGHT_BENCH_COUNT, visible, 1));
+        printResult("batch", sizeStr, PATTERN_NAMES[patterns[p]], t, LINE_OF_SIGHT_BENCH_COUNT, 24.0 * LINE_OF_SIGHT_BENCH_COUNT);
+
+        BENCH_MEASURE(t, , lineOfSightBatch(df, size, size, size, from, to, LINE_OF_SIGHT_BENCH_COUNT, visible, 0));
+        printResult("batch threads", sizeStr, PATTERN_NAMES[patterns[p]], t, LINE_OF_SIGHT_BENCH_COUNT, 24.0 * LINE_OF_SIGHT_BENCH_COUNT);
+
+        g_sink += visibleCount + visible[0];
+    }
+
+    free(boolArr);
+    free(df);
+    free(from);
+    free(to);
+    free(visible);
+}
+
+/**
+ * Block light benchmarks
+ */
+
+#define BLOCK_LIGHT_BENCH_UPDATES 256
+
+// caves with a torch in every 512th air voxel, solid voxels are opaque
+static void fillBlockLightScene(bool* boolArr, uint8_t* emission, uint8_t* opacity, int size)
+{
+    const size_t count = (size_t) size * size * size;
+
+    fillPattern(boolArr, size, PATTERN_CAVES);
+    for (size_t i = 0; i < count; i++)
+    {
+        opacity[i] = boolArr[i] ? BLOCK_LIGHT_MAX : 0;
+        emission[i] = !boolArr[i] && xorshift32() % 512 == 0 ? 14 : 0;
+    }
+}
+
+static void benchBlockLight(int maxSize)
+{
+    printHeader("blockLightRebuild", "voxel");
+
+    for (int size = 32; size <= maxSize && size <= 128; size *= 2)
+    {
+        const size_t count = (size_t) size * size * size;
+        bool* boolArr = malloc(count);
+        uint8_t* emission = malloc(count);
+        uint8_t* opacity = malloc(count);
+        uint8_t* light = malloc(count);
+        char sizeStr[16];
+        snprintf(sizeStr, sizeof(sizeStr), "%d^3", size);
+
+        fillBlockLightScene(boolArr, emission, opacity, size);
+
+        // every pass reads the opacity and reads + writes the light, the number of rounds depends on the scene, so this
+        // models a single round (3 axes, forward and backward)
+        BenchTime t;
+        BENCH_MEASURE(t, , blockLightRebuild(emission, opacity, light, size, size, size));
+        printResult("rebuild", sizeStr, "caves", t, (double) count, 18.0 * (double) count);
+        g_sink += checksum(light, count);
+
+        free(boolArr);
+        free(emission);
+        free(opacity);
+        free(light);
+    }
+
+    printHeader("blockLightUpdate", "op");
+
+    for (int size = 32; size <= maxSize && size <= 128; size *= 2)
+    {
+        const size_t count = (size_t) size * size * size;
+        bool* boolArr = malloc(count);
+        uint8_t* emission = malloc(count);
+        uint8_t* opacity = malloc(count);
+        uint8_t* light = malloc(count);
+        uint32_t* addQueue = malloc(count * sizeof(uint32_t));
+        uint32_t* removeQueue = malloc(count * sizeof(uint32_t));
+        uint64_t* queued = calloc((count + 63) / 64, sizeof(uint64_t));
+        char sizeStr[16];
+        snprintf(sizeStr, sizeof(sizeStr), "%d^3", size);
+
+        fillBlockLightScene(boolArr, emission, opacity, size);
+        blockLightRebuild(emission, opacity, light, size, size, size);
+
+        // placing and breaking a torch at random air voxels, adding and removing restores the light, so no setup needed
+        int positions[BLOCK_LIGHT_BENCH_UPDATES][3];
+        for (int i = 0; i < BLOCK_LIGHT_BENCH_UPDATES; i++)
+        {
+            size_t index;
+            do
+            {
+                for (int j = 0; j < 3; j++)
+                    positions[i][j] = (int) (xorshift32() % size);
+                index = (size_t) positions[i][2] * size * size + (size_t) positions[i][1] * size + positions[i][0];
+            } while (boolArr[index] || emission[index]);
+        }
+
+        BlockLightVolume volume = {light, emission, opacity, size, size, size};
+        BlockLightWorkspace workspace = {addQueue, removeQueue, queued};
+
+        // the traffic depends on how many voxels the torch lights up, it isn't modeled
+        BenchTime t;
+        BENCH_MEASURE(t, , for (int i = 0; i < BLOCK_LIGHT_BENCH_UPDATES; i++) {
+            blockLightAdd(&volume, &workspace, positions[i][0], positions[i][1], positions[i][2], 14);
+            blockLightRemove(&volume, &workspace, positions[i][0], positions[i][1], positions[i][2]);
+        });
+        printResult("add + remove", sizeStr, "caves", t, BLOCK_LIGHT_BENCH_UPDATES, 0.0);
+        g_sink += checksum(light, count);
+
+        free(boolArr);
+        free(emission);
+        free(opacity);
+        free(light);
+        free(addQueue);
+        free(removeQueue);
+        free(queued);
+    }
+}
+
+/**
+ * Octant distance field benchmarks
+ */
+
+#define OCTANT_DF_BENCH_RAYS 4096
+
+static void benchOctantDF(int maxSize)
+{
+    const int size = maxSize < 128 ? maxSize : 128;
+    const size_t count = (size_t) size * size * size;
+    bool* boolArr = malloc(count);
+    uint8_t* df = malloc(count);
+    uint8_t* storage = malloc(count * 8);
+    cp_vec3* origins = malloc(OCTANT_DF_BENCH_RAYS * sizeof(cp_vec3));
+    cp_vec3* directions = malloc(OCTANT_DF_BENCH_RAYS * sizeof(cp_vec3));
+    uint8_t* fields[8];
+    const uint8_t* isotropic[8];
+    char sizeStr[16];
+    snprintf(sizeStr, sizeof(sizeStr), "%d^3", size);
+
+    for (int i = 0; i < 8; i++)
+        fields[i] = storage + i * count;
+
+    printHeader("octantDF", "voxel");
+
+    const Pattern patterns[2] = {PATTERN_TERRAIN, PATTERN_CAVES};
+    for (int p = 0; p < 2; p++)
+    {
+        fillPattern(boolArr, size, patterns[p]);
+
+        // 8 fields are written, the bool array is read twice by the X pass
+        BenchTime t;
+        BENCH_MEASURE(t, , boolArrToOctantDF(boolArr, fields, size, size, size));
+        printResult("build 8 fields", sizeStr, PATTERN_NAMES[patterns[p]], t, (double) count, 10.0 * (double) count);
+        g_sink += checksum(fields[7], count);
+    }
+
+    printHeader("octantDFRaycast", "op");
+
+    for (int p = 0; p < 2; p++)
+    {
+        fillPattern(boolArr, size, patterns[p]);
+        boolArrToManhattanDF(boolArr, df, size, size, size);
+        boolArrToOctantDF(boolArr, fields, size, size, size);
+        for (int i = 0; i < 8; i++)
+            isotropic[i] = df;
+
+        // rays from open voxels in random directions (normalized to a Manhattan length of 1), up to 64 voxels long
+        for (int i = 0; i < OCTANT_DF_BENCH_RAYS; i++)
+        {
+            int index;
+            do
+                index = (int) (xorshift32() % count);
+            while (boolArr[index]);
+
+            origins[i] = (cp_vec3) {.x = (float) (index % size) + 0.5f, .y = (float) (index / size % size) + 0.5f,
+                                    .z = (float) (index / size / size) + 0.5f};
+            cp_vec3 d = {.x = randomFloat(-1.0f, 1.0f), .y = randomFloat(-1.0f, 1.0f), .z = randomFloat(-1.0f, 1.0f)};
+            const float l1 = fabsf(d.x) + fabsf(d.y) + fabsf(d.z);
+            directions[i] = (cp_vec3) {.x = d.x / l1, .y = d.y / l1, .z = d.z / l1};
+        }
+
+        const uint8_t* const* variants[2] = {isotropic, (const uint8_t* const*) fields};
+        const char* names[2] = {"isotropic", "octant"};
+        for (int v = 0; v < 2; v++)
+        {
+            uint64_t steps = 0;
+            for (int i = 0; i < OCTANT_DF_BENCH_RAYS; i++)
+            {
+                OctantDFHit hit;
+                octantDFRaycast(variants[v], size, size, size, origins[i], directions[i], 64.0f, &hit);
+                steps += hit.steps;
+            }
+
+            // the stage column shows the lookups per ray, each of them reads a byte (usually a cache miss)
+            BenchTime t;
+            uint64_t hits = 0;
+            BENCH_MEASURE(t, , for (int i = 0; i < OCTANT_DF_BENCH_RAYS; i++)
+                hits += octantDFRaycast(variants[v], size, size, size, origins[i], directions[i], 64.0f, NULL));
+            char stage[32];
+            snprintf(stage, sizeof(stage), "%s %.1f", PATTERN_NAMES[patterns[p]], (double) steps / OCTANT_DF_BENCH_RAYS);
+            printResult(names[v], sizeStr, stage, t, OCTANT_DF_BENCH_RAYS, 24.0 * OCTANT_DF_BENCH_RAYS);
+            g_sink += hits;
+        }
+    }
+
+    free(boolArr);
+    free(df);
+    free(storage);
+    free(origins);
+    free(directions);
+}
+
+/**
+ * Distance field file benchmarks
+ */
+
+// reads one byte per page, so every page of the mapping gets faulted in
+static uint64_t touchPages(const uint8_t* data, size_t size)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; i += 4096)
+        sum += data[i];
+    return sum;
+}
+
+static void benchDistanceFieldFile(int maxSize)
+{
+    const char* path = "bench_voxeldev.vxdf";
+
+    printHeader("distanceFieldFile", "voxel");
+
+    for (int size = 64; size <= maxSize; size *= 2)
+    {
+        const size_t count = (size_t) size * size * size;
+        bool* boolArr = malloc(count);
+        uint8_t* df = malloc(count);
+        char sizeStr[16];
+        snprintf(sizeStr, sizeof(sizeStr), "%d^3", size);
+
+        fillPattern(boolArr, size, PATTERN_TERRAIN);
+
+        BenchTime t;
+        BENCH_MEASURE(t, , boolArrToManhattanDF(boolArr, df, size, size, size));
+        printResult("recompute", sizeStr, "terrain", t, (double) count, 2.0 * (double) count);
+
+        for (int compression = 0; compression < 2; compression++)
+        {
+            DistanceFieldFileDesc desc = {size, size, size, 1, DISTANCE_FIELD_FILE_LAYOUT_LINEAR, DISTANCE_FIELD_FILE_METRIC_MANHATTAN,
+                                          (DistanceFieldFileCompression) compression};
+            const char* name = compression ? "bricks" : "raw";
+            char label[32];
+
+            if (!distanceFieldFileWrite(path, df, &desc))
+            {
+                printf("could not write %s\n", path);
+                break;
+            }
+
+            // the file is in the page cache after writing it, so this measures mapping it and faulting its pages in
+            // the stage column shows the file size relative to the field
+            DistanceFieldFile file;
+            if (!distanceFieldFileOpen(path, &file, false))
+            {
+                printf("could not open %s\n", path);
+                break;
+            }
+            const double fileSize = (double) file.header->fileSize;
+            distanceFieldFileClose(&file);
+            char stage[16];
+            snprintf(stage, sizeof(stage), "%.1f%%", 100.0 * fileSize / (double) count);
+
+            // opening worked once, so a failure in the loops means the file changed under us
+            bool opened = true;
+            snprintf(label, sizeof(label), "open %s", name);
+            BENCH_MEASURE(t, , {
+                opened &= distanceFieldFileOpen(path, &file, false);
+                g_sink += touchPages((const uint8_t*) file.mapping, file.mappingSize);
+                distanceFieldFileClose(&file);
+            });
+            if (!opened)
+            {
+                printf("could not reopen %s\n", path);
+                break;
+            }
+            printResult(label, sizeStr, stage, t, (double) count, fileSize);
+
+            // a failed verification returns early, so it would be timed as a (too fast) success
+            if (!distanceFieldFileOpen(path, &file, true))
+            {
+                printf("could not open %s with verification\n", path);
+                break;
+            }
+            distanceFieldFileClose(&file);
+            snprintf(label, sizeof(label), "open+verify %s", name);
+            BENCH_MEASURE(t, , {
+                opened &= distanceFieldFileOpen(path, &file, true);
+                distanceFieldFileClose(&file);
+            });
+            if (!opened)
+            {
+                printf("could not reopen %s\n", path);
+                break;
+            }
+            printResult(label, sizeStr, stage, t, (double) count, fileSize);
+
+            if (compression && distanceFieldFileOpen(path, &file, false))
+            {
+                BENCH_MEASURE(t, , distanceFieldFileDecompress(&file, 0, df));
+                printResult("decompress", sizeStr, stage, t, (double) count, fileSize + (double) count);
+                distanceFieldFileClose(&file);
+            }
+
+        }
+
+        free(boolArr);
+        free(df);
+    }
+
+    remove(path);
+}
+
+/**
+ * Material distance field benchmarks
+ */
+
+static void benchMaterialDF(int maxSize)
+{
+    enum { AIR, STONE, WATER, LAVA };
+    uint8_t classMasks[256] = {0};
+    classMasks[STONE] = 1;
+    classMasks[WATER] = 2;
+    classMasks[LAVA] = 4;
+
+    printHeader("materialArrToManhattanDF (3 channels)", "voxel");
+
+    for (int size = 16; size <= maxSize; size *= 2)
+    {
+        const size_t count = (size_t) size * size * size;
+        bool* boolArr = malloc(count);
+        uint8_t* materials = malloc(count);
+        uint8_t* fields = malloc(3 * count);
+        char sizeStr[16];
+        snprintf(sizeStr, sizeof(sizeStr), "%d^3", size);
+
+        // terrain with pools of water and lava in the bottom quarter of the air above it
+        fillPattern(boolArr, size, PATTERN_TERRAIN);
+        for (int z = 0; z < size; z++)
+            for (int y = 0; y < size; y++)
+                for (int x = 0; x < size; x++)
+                {
+                    const size_t i = (size_t) z * size * size + (size_t) y * size + x;
+                    const bool fluid = y < size / 2 && (x / 8 + z / 8) % 3 != 0;
+                    materials[i] = boolArr[i] ? STONE : fluid ? ((x / 8 + z / 8) % 3 == 1 ? WATER : LAVA) : AIR;
+                }
+
+        BenchTime t;
+
+        // the old way: a bool array and a distance field per class. Every class reads the materials and writes its
+        // bools, then the field costs the usual 6 bytes per voxel
+        BENCH_MEASURE(t, , {
+            for (int c = 0; c < 3; c++)
+            {
+                for (size_t i = 0; i < count; i++)
+                    boolArr[i] = (classMasks[materials[i]] >> c) & 1;
+                boolArrToManhattanDF(boolArr, fields + c * count, size, size, size);
+            }
+        });
+        printResult("3x boolArr DF", sizeStr, "terrain", t, (double) count, 3.0 * 8.0 * (double) count);
+
+        // X reads the materials and writes 3 channels, Y and Z read and write 3 channels
+        BENCH_MEASURE(t, , materialArrToManhattanDF(materials, classMasks, 3, fields, size, size, size));
+        printResult("material DF", sizeStr, "terrain", t, (double) count, 16.0 * (double) count);
+
+        BENCH_MEASURE(t, , materialArrToManhattanDFXPASS(materials, classMasks, 3, fields, size, size, size));
+        printResult("material DF", sizeStr, "XPASS", t, (double) count, 4.0 * (double) count);
+
+        g_sink += checksum(fields, 3 * count);
+
+        free(boolArr);
+        free(materials);
+        free(fields);
+    }
+}
+
+/**
+ * Block ID distance field benchmarks
+ */
+
+#define BENCH_IS_SOLID_BLOCK(id) ((id) != 0 && (id) < 1024)
+BLOCKIDARRTOMANHATTANDF_PREDICATE(benchBlockIdArrToManhattanDF, BENCH_IS_SOLID_BLOCK)
+
+static void benchBlockIdDF(int maxSize)
+{
+    static uint64_t solidLut[MANHATTAN_DF_BLOCK_ID_LUT_WORDS];
+    for (int id = 0; id < 65536; id++)
+        manhattanDFBlockIdLutSet(solidLut, (uint16_t) id, BENCH_IS_SOLID_BLOCK(id));
+
+    printHeader("blockIdArrToManhattanDF", "voxel");
+
+    for (int size = 16; size <= maxSize; size *= 2)
+    {
+        const size_t count = (size_t) size * size * size;
+        bool* boolArr = malloc(count);
+        uint16_t* blockIds = malloc(count * sizeof(uint16_t));
+        uint8_t* distanceField = malloc(count);
+        char sizeStr[16];
+        snprintf(sizeStr, sizeof(sizeStr), "%d^3", size);
+
+        for (int p = PATTERN_TERRAIN; p <= PATTERN_CAVES; p++)
+        {
+            // solid voxels get one of 1023 solid IDs, air is 0 or one of the non solid ones (water, plants, ...)
+            fillPattern(boolArr, size, (Pattern) p);
+            for (size_t i = 0; i < count; i++)
+                blockIds[i] = boolArr[i] ? (uint16_t) (1 + xorshift32() % 1023) : (xorshift32() & 1 ? 0 : (uint16_t) (1024 + xorshift32() % 1000));
+
+            BenchTime t;
+
+            // the old way: IDs -> bools (read 2, write 1), then the regular conversion (6)
+            BENCH_MEASURE(t, , {
+                for (size_t i = 0; i < count; i++)
+                    boolArr[i] = BENCH_IS_SOLID_BLOCK(blockIds[i]);
+                boolArrToManhattanDF(boolArr, distanceField, size, size, size);
+            });
+            printResult(PATTERN_NAMES[p], sizeStr, "bools+DF", t, (double) count, 9.0 * (double) count);
+
+            // X reads the IDs (2) and writes the field, Y and Z as usual
+            BENCH_MEASURE(t, , blockIdArrToManhattanDF(blockIds, solidLut, distanceField, size, size, size));
+            printResult(PATTERN_NAMES[p], sizeStr, "DF lut", t, (double) count, 7.0 * (double) count);
+
+            BENCH_MEASURE(t, , benchBlockIdArrToManhattanDF(blockIds, distanceField, size, size, size));
+            printResult(PATTERN_NAMES[p], sizeStr, "DF pred", t, (double) count, 7.0 * (double) count);
+
+            BENCH_MEASURE(t, , blockIdArrToManhattanDFXPASS(blockIds, solidLut, distanceField, size, size, size));
+            printResult(PATTERN_NAMES[p], sizeStr, "XPASS lut", t, (double) count, 3.0 * (double) count);
+
+            BENCH_MEASURE(t, , benchBlockIdArrToManhattanDFXPASS(blockIds, distanceField, size, size, size));
+            printResult(PATTERN_NAMES[p], sizeStr, "XPASS pred", t, (double) count, 3.0 * (double) count);
+
+            g_sink += checksum(distanceField, count);
+        }
+
+        free(boolArr);
+        free(blockIds);
+        free(distanceField);
+    }
+}
+
+/**
+ * Connected components benchmarks
+ */
+
+// the single threaded flood fill the labeller replaces, for comparison (same labels, no statistics)
+static uint32_t floodFillLabel(const bool* boolArr, uint32_t* o_labels, uint32_t* queue, int size)
+{
+    const uint32_t count = (uint32_t) size * size * size, planeSize = (uint32_t) size * size;
+    uint32_t label = 0;
+    memset(o_labels, 0, count * sizeof(uint32_t));
+
+    for (uint32_t seed = 0; seed < count; seed++)
+    {
+        if (boolArr[seed] || o_labels[seed])
+            continue;
+
+        uint32_t head = 0, tail = 0;
+        o_labels[seed] = ++label;
+        queue[tail++] = seed;
+        while (head < tail)
+        {
+            const uint32_t i = queue[head++];
+            const uint32_t x = i % size, y = i / size % size, z = i / planeSize;
+            const uint32_t neighbours[6] = {i - 1, i + 1, i - size, i + size, i - planeSize, i + planeSize};
+            const bool inside[6] = {x > 0, x + 1 < (uint32_t) size, y > 0, y + 1 < (uint32_t) size, z > 0, z + 1 < (uint32_t) size};
+            for (int n = 0; n < 6; n++)
+                if (inside[n] && !boolArr[neighbours[n]] && !o_labels[neighbours[n]])
+                {
+                    o_labels[neighbours[n]] = label;
+                    queue[tail++] = neighbours[n];
+                }
+        }
+    }
+
+    return label;
+}
+
+static void benchConnectedComponents(int maxSize)
+{
+    const Pattern patterns[3] = {PATTERN_TERRAIN, PATTERN_CAVES, PATTERN_RANDOM50};
+
+    printHeader("connectedComponentsLabel", "voxel");
+
+    for (int size = 32; size <= maxSize; size *= 2)
+    {
+        const size_t count = (size_t) size * size * size;
+        bool* boolArr = malloc(count);
+        uint32_t* labels = malloc(count * sizeof(uint32_t));
+        uint32_t* queue = malloc(count * sizeof(uint32_t));
+        ConnectedComponent* components = malloc(count * sizeof(ConnectedComponent));
+        char sizeStr[16];
+        snprintf(sizeStr, sizeof(sizeStr), "%d^3", size);
+
+        for (int p = 0; p < 3; p++)
+        {
+            fillPattern(boolArr, size, patterns[p]);
+            BenchTime t;
+
+            // reads the bools, writes the labels, the queue and the labels of the neighbours are read again
+            BENCH_MEASURE(t, , g_sink += floodFillLabel(boolArr, labels, queue, size));
+            printResult(PATTERN_NAMES[patterns[p]], sizeStr, "flood fill", t, (double) count, 17.0 * (double) count);
+
+            BENCH_MEASURE(t, , g_sink += connectedComponentsLabel(boolArr, labels, components, (uint32_t) count, size, size, size, 1));
+            printResult(PATTERN_NAMES[patterns[p]], sizeStr, "1 thread", t, (double) count, 25.0 * (double) count);
+
+            BENCH_MEASURE(t, , g_sink += connectedComponentsLabel(boolArr, labels, components, (uint32_t) count, size, size, size, 0));
+            printResult(PATTERN_NAMES[patterns[p]], sizeStr, "threads", t, (double) count, 25.0 * (double) count);
+        }
+
+        free(boolArr);
+        free(labels);
+        free(queue);
+        free(components);
+    }
+}
+
+static void benchChunkVisibility(int maxSize)
+{
+    const Pattern patterns[3] = {PATTERN_TERRAIN, PATTERN_CAVES, PATTERN_RANDOM50};
+    const int CHUNK = 32;
+    bool* chunkArr = malloc((size_t) CHUNK * CHUNK * CHUNK);
+    uint64_t airRows[32 * 32];
+    ChunkVisibility chunk;
+
+    printHeader("chunkVisibilityInit", "voxel");
+
+    for (int p = 0; p < 3; p++)
+    {
+        fillPattern(chunkArr, CHUNK, patterns[p]);
+        BenchTime t;
+
+        // reads the bools, the air rows stay in cache
+        BENCH_MEASURE(t, , g_sink += chunkVisibilityInit(&chunk, airRows, chunkArr, CHUNK, CHUNK, CHUNK));
+        printResult(PATTERN_NAMES[patterns[p]], "32^3", "init", t, (double) (CHUNK * CHUNK * CHUNK), (double) (CHUNK * CHUNK * CHUNK));
+    }
+
+    printHeader("chunkVisibilitySetVoxel / chunkVisibilityTraverse", "op");
+
+    for (int p = 0; p < 3; p++)
+    {
+        fillPattern(chunkArr, CHUNK, patterns[p]);
+        chunkVisibilityInit(&chunk, airRows, chunkArr, CHUNK, CHUNK, CHUNK);
+        BenchTime t;
+
+        // toggles a voxel in the middle of the chunk back and forth, so every call is an edit
+        int toggle = 0;
+        BENCH_MEASURE(t, , g_sink += chunkVisibilitySetVoxel(&chunk, 16, 16, 16, (toggle ^= 1) != 0));
+        printResult(PATTERN_NAMES[patterns[p]], "32^3", "edit", t, 1.0, 8.0 * CHUNK * CHUNK);
+    }
+
+    // walks a grid of 32^3 chunks cut out of a volume, from the chunk in the middle (ns per chunk of the grid)
+    const int chunks = maxSize / CHUNK;
+    const int chunkCount = chunks * chunks * chunks;
+    bool* boolArr = malloc((size_t) maxSize * maxSize * maxSize);
+    uint16_t* grid = malloc(chunkCount * sizeof(uint16_t));
+    uint64_t* visible = malloc((chunkCount + 63) / 64 * sizeof(uint64_t));
+    ChunkVisibilityStep* queue = malloc(chunkCount * sizeof(ChunkVisibilityStep));
+    char sizeStr[16];
+    snprintf(sizeStr, sizeof(sizeStr), "%d^3 ch", chunks);
+
+    for (int p = 0; p < 3 && chunkCount > 0; p++)
+    {
+        fillPattern(boolArr, maxSize, patterns[p]);
+        for (int i = 0; i < chunkCount; i++)
+        {
+            const int cx = i % chunks, cy = i / chunks % chunks, cz = i / (chunks * chunks);
+            for (int z = 0; z < CHUNK; z++)
+                for (int y = 0; y < CHUNK; y++)
+                    memcpy(chunkArr + (z * CHUNK + y) * CHUNK,
+                           boolArr + ((size_t) (cz * CHUNK + z) * maxSize + cy * CHUNK + y) * maxSize + cx * CHUNK, CHUNK);
+            grid[i] = chunkVisibilityInit(&chunk, airRows, chunkArr, CHUNK, CHUNK, CHUNK);
+        }
+
+        BenchTime t;
+        int visibleCount = 0;
+        BENCH_MEASURE(t, , visibleCount = chunkVisibilityTraverse(grid, chunks, chunks, chunks, chunks / 2, chunks / 2, chunks / 2, visible, queue));
+        g_sink += visibleCount;
+
+        char stage[32];
+        snprintf(stage, sizeof(stage), "%d%% visible", 100 * visibleCount / chunkCount);
+        printResult(PATTERN_NAMES[patterns[p]], sizeStr, stage, t, (double) chunkCount, 2.0 * chunkCount + 6.0 * visibleCount);
+    }
+
+    free(chunkArr);
+    free(boolArr);
+    free(grid);
+    free(visible);
+    free(queue);
+}
+
+static void benchHiZOcclusion()
+{
+    // a city: a grid of buildings (4 walls each) in front of a camera at the origin looking along -z, and the 16^3 chunks
+    // of the area behind it
+    enum { BUILDINGS = 20, CHUNKS_X = 25, CHUNKS_Y = 4, CHUNKS_Z = 25, CHUNK_COUNT = CHUNKS_X * CHUNKS_Y * CHUNKS_Z };
+    static HiZOccluder occluders[BUILDINGS * BUILDINGS * 4];
+    static float minX[CHUNK_COUNT], minY[CHUNK_COUNT], minZ[CHUNK_COUNT], maxX[CHUNK_COUNT], maxY[CHUNK_COUNT], maxZ[CHUNK_COUNT];
+    static uint64_t visible[(CHUNK_COUNT + 63) / 64];
+    int occluderCount = 0;
+
+    for (int bz = 0; bz < BUILDINGS; bz++)
+        for (int bx = 0; bx < BUILDINGS; bx++)
+        {
+            const float x0 = -200.0f + 20.0f * bx + 4.0f, x1 = x0 + 12.0f, z0 = -20.0f * (bz + 1) - 4.0f, z1 = z0 - 12.0f;
+            const float y0 = -10.0f, y1 = randomFloat(10.0f, 60.0f);
+            const float xs[5] = {x0, x1, x1, x0, x0}, zs[5] = {z0, z0, z1, z1, z0};
+            for (int w = 0; w < 4; w++)
+                occluders[occluderCount++] = (HiZOccluder) {.corners = {
+                    {.x = xs[w], .y = y0, .z = zs[w]}, {.x = xs[w + 1], .y = y0, .z = zs[w + 1]},
+                    {.x = xs[w + 1], .y = y1, .z = zs[w + 1]}, {.x = xs[w], .y = y1, .z = zs[w]},
+                }};
+        }
+
+    for (int i = 0; i < CHUNK_COUNT; i++)
+    {
+        minX[i] = -200.0f + 16.0f * (i % CHUNKS_X);
+        minY[i] = -16.0f + 16.0f * (i / CHUNKS_X % CHUNKS_Y);
+        minZ[i] = -400.0f + 16.0f * (i / (CHUNKS_X * CHUNKS_Y));
+        maxX[i] = minX[i] + 16.0f, maxY[i] = minY[i] + 16.0f, maxZ[i] = minZ[i] + 16.0f;
+    }
+
+    float* memory = malloc(hiZBufferFloats(256, 128) * sizeof(float));
+    HiZBuffer hiz;
+    hiZInit(&hiz, memory, 256, 128);
+    const cp_mat4 projection = cp_mat4_perspective(cp_radiansf(90.0f), 2.0f, 0.1f, 1000.0f);
+    const cp_mat4 view = cp_mat4_look_at((cp_vec3) {.x = 0.0f, .y = 0.0f, .z = 0.0f}, (cp_vec3) {.x = 0.0f, .y = 0.0f, .z = -1.0f},
+                                         (cp_vec3) {.x = 0.0f, .y = 1.0f, .z = 0.0f});
+    const cp_mat4 viewProj = cp_mat4_mul(&projection, &view);
+    const cp_aabb_soa boxes = {minX, minY, minZ, maxX, maxY, maxZ, CHUNK_COUNT};
+
+    printHeader("hiZOcclusion (256x128, 1600 walls, 2500 chunks)", "op");
+    BenchTime t;
+
+    // per frame: clear, rasterise and build the pyramid (the depth buffer is read and written, the pyramid written)
+    BENCH_MEASURE(t, , hiZRasterize(&hiz, &viewProj, occluders, occluderCount, 1));
+    printResult("rasterize", "frame", "1 thread", t, 1.0, 256.0 * 128.0 * 3.0 * sizeof(float));
+
+    BENCH_MEASURE(t, , hiZRasterize(&hiz, &viewProj, occluders, occluderCount, 0));
+    printResult("rasterize", "frame", "threads", t, 1.0, 256.0 * 128.0 * 3.0 * sizeof(float));
+
+    // per chunk
+    BENCH_MEASURE(t, , hiZCullAabbs(&hiz, &boxes, visible, 1));
+    int visibleCount = 0;
+    for (int i = 0; i < (CHUNK_COUNT + 63) / 64; i++)
+        visibleCount += __builtin_popcountll(visible[i]);
+    g_sink += visibleCount;
+
+    char stage[32];
+    snprintf(stage, sizeof(stage), "%d%% visible", 100 * visibleCount / CHUNK_COUNT);
+    printResult("cull aabbs", "chunk", stage, t, CHUNK_COUNT, CHUNK_COUNT * 24.0);
+
+    free(memory);
+}
+
+static void benchOccupancyLod(int maxSize)
+{
+    const Pattern patterns[3] = {PATTERN_TERRAIN, PATTERN_CAVES, PATTERN_RANDOM50};
+    const char* modeNames[2] = {"any", "majority"};
+
+    printHeader("occupancyLodDownsample (per input voxel)", "voxel");
+
+    for (int size = 64; size <= maxSize; size *= 2)
+    {
+        const size_t count = (size_t) size * size * size;
+        bool* boolArr = malloc(count);
+        bool* lod = malloc(count / 8);
+        uint64_t* bitArr = malloc((count + 63) / 64 * sizeof(uint64_t));
+        uint64_t* lodBits = malloc((count / 8 + 63) / 64 * sizeof(uint64_t));
+        uint8_t* distanceField = malloc(count);
+        char sizeStr[16];
+        snprintf(sizeStr, sizeof(sizeStr), "%d^3", size);
+
+        for (int p = 0; p < 3; p++)
+        {
+            fillPattern(boolArr, size, patterns[p]);
+            memset(bitArr, 0, (count + 63) / 64 * sizeof(uint64_t));
+            for (size_t i = 0; i < count; i++)
+                bitArr[i >> 6] |= (uint64_t) boolArr[i] << (i & 63);
+
+            BenchTime t;
+            char stage[32];
+            for (int mode = 0; mode < 2; mode++)
+            {
+                // reads every voxel, writes an eighth
+                BENCH_MEASURE(t, , occupancyLodDownsampleBool(boolArr, lod, size, size, size, (OccupancyLodMode) mode));
+                snprintf(stage, sizeof(stage), "bool %s", modeNames[mode]);
+                printResult(PATTERN_NAMES[patterns[p]], sizeStr, stage, t, (double) count, (double) count * 9.0 / 8.0);
+                g_sink += lod[count / 16];
+
+                BENCH_MEASURE(t, , occupancyLodDownsampleBits(bitArr, lodBits, size, size, size, (OccupancyLodMode) mode));
+                snprintf(stage, sizeof(stage), "bits %s", modeNames[mode]);
+                printResult(PATTERN_NAMES[patterns[p]], sizeStr, stage, t, (double) count, (double) count * 9.0 / 64.0);
+                g_sink += lodBits[0];
+            }
+
+            // the point of the levels: a distance field of the 2x level costs an eighth of the full one
+            BENCH_MEASURE(t, , boolArrToManhattanDF(boolArr, distanceField, size, size, size));
+            printResult(PATTERN_NAMES[patterns[p]], sizeStr, "DF full", t, (double) count, 7.0 * (double) count);
+            BENCH_MEASURE(t, , boolArrToManhattanDF(lod, distanceField, size / 2, size / 2, size / 2));
+            printResult(PATTERN_NAMES[patterns[p]], sizeStr, "DF 2x", t, (double) count, 7.0 * (double) count / 8.0);
+            g_sink += distanceField[0];
+        }
+
+        free(boolArr);
+        free(lod);
+        free(bitArr);
+        free(lodBits);
+        free(distanceField);
+    }
+}
+
+static void benchSurfaceNets(int maxSize)
+{
+    const Pattern patterns[2] = {PATTERN_TERRAIN, PATTERN_CAVES};
+
+    printHeader("surfaceNetsExtract (per sample)", "voxel");
+
+    // chunks plus the 2 layers shared with the neighbours
+    for (int chunkSize = 32; chunkSize <= maxSize && chunkSize <= 64; chunkSize *= 2)
+    {
+        const int size = chunkSize + 2;
+        const size_t count = (size_t) size * size * size;
+        float* volume = malloc(count * sizeof(float));
+        bool* boolArr = malloc(count);
+        int8_t* signedField = malloc(count);
+        // every sample can't be a surface cell, but random caves come close to a third
+        SurfaceNetsMesh mesh = {.vertices = malloc(count * sizeof(PackedVec3)), .indices = malloc(6 * count * sizeof(uint32_t)),
+                                .vertexCapacity = (uint32_t) count, .indexCapacity = (uint32_t) (6 * count)};
+        char sizeStr[16];
+        snprintf(sizeStr, sizeof(sizeStr), "%d^3", size);
+
+        // rolling hills, a smooth float field with a couple of percent surface cells
+        for (int z = 0; z < size; z++)
+            for (int y = 0; y < size; y++)
+                for (int x = 0; x < size; x++)
+                    volume[((size_t) z * size + y) * size + x] =
+                            (float) z - (float) size * (0.5f + 0.2f * sinf((float) x * 0.15f) * cosf((float) y * 0.1f));
+
+        BenchTime t;
+        // reads every sample, writes a vertex and 6 indices per surface cell
+        BENCH_MEASURE(t, , surfaceNetsExtract(volume, size, size, size, 0.0f, &mesh));
+        printResult("hills", sizeStr, "float", t, (double) count, 4.0 * (double) count + 36.0 * mesh.vertexCount);
+        g_sink += mesh.indexCount;
+
+        for (int p = 0; p < 2; p++)
+        {
+            fillPattern(boolArr, size, patterns[p]);
+            boolArrToSignedManhattanDF(boolArr, signedField, size, size, size);
+
+            BENCH_MEASURE(t, , surfaceNetsExtractSigned(signedField, size, size, size, &mesh));
+            printResult(PATTERN_NAMES[patterns[p]], sizeStr, "signed", t, (double) count, (double) count + 36.0 * mesh.vertexCount);
+            g_sink += mesh.indexCount;
+        }
+
+        free(volume);
+        free(boolArr);
+        free(signedField);
+        free(mesh.vertices);
+        free(mesh.indices);
+    }
+
+    // 16 chunks of 32^3 with one thread per CPU
+    {
+        const int chunkCount = 16, size = 34;
+        const size_t count = (size_t) size * size * size;
+        bool* boolArr = malloc(count);
+        int8_t* signedField = malloc(count);
+        PackedVec3* vertices = malloc(chunkCount * count * sizeof(PackedVec3));
+        uint32_t* indices = malloc(6 * chunkCount * count * sizeof(uint32_t));
+        SurfaceNetsChunk chunks[16];
+
+        fillPattern(boolArr, size, PATTERN_TERRAIN);
+        boolArrToSignedManhattanDF(boolArr, signedField, size, size, size);
+        for (int i = 0; i < chunkCount; i++)
+            chunks[i] = (SurfaceNetsChunk) {.signedField = signedField,
+                                            .mesh = {.vertices = vertices + i * count, .indices = indices + 6 * i * count,
+                                                     .vertexCapacity = (uint32_t) count, .indexCapacity = (uint32_t) (6 * count)}};
+
+        BenchTime t;
+        BENCH_MEASURE(t, , surfaceNetsChunks(chunks, chunkCount, size, size, size, 0.0f, 0));
+        printResult("terrain", "16x34^3", "threads", t, (double) count * chunkCount,
+                    (double) count * chunkCount + 36.0 * chunks[0].mesh.vertexCount * chunkCount);
+        g_sink += chunks[0].mesh.indexCount;
+
+        free(boolArr);
+        free(signedField);
+        free(vertices);
+        free(indices);
+    }
+}
+
+// trilinear lookup of voxel centers, one point at a time, the way it's usually written
+static inline float scalarTrilinear(const uint8_t* field, int size, float x, float y, float z)
+{
+    const float p[3] = {x - 0.5f, y - 0.5f, z - 0.5f};
+    int i[3];
+    float t[3];
+    for (int a = 0; a < 3; a++)
+    {
+        const float g = p[a] < 0.0f ? 0.0f : p[a] > (float) size - 1.001f ? (float) size - 1.001f : p[a];
+        i[a] = (int) g;
+        t[a] = g - (float) i[a];
+    }
+
+    float value = 0.0f;
+    for (int c = 0; c < 8; c++)
+    {
+        const int dx = c & 1, dy = (c >> 1) & 1, dz = c >> 2;
+        const float w = (dx ? t[0] : 1.0f - t[0]) * (dy ? t[1] : 1.0f - t[1]) * (dz ? t[2] : 1.0f - t[2]);
+        value += w * (float) field[((size_t) (i[2] + dz) * size + i[1] + dy) * size + i[0] + dx];
+    }
+    return value;
+}
+
+static void scalarFieldSample(const uint8_t* field, int size, const cp_vec3* points, int count, float* o_values, cp_vec3* o_gradients)
+{
+    for (int i = 0; i < count; i++)
+    {
+        const cp_vec3 p = points[i];
+        o_values[i] = scalarTrilinear(field, size, p.x, p.y, p.z);
+        o_gradients[i] = (cp_vec3) {
+            .x = 0.5f * (scalarTrilinear(field, size, p.x + 1.0f, p.y, p.z) - scalarTrilinear(field, size, p.x - 1.0f, p.y, p.z)),
+            .y = 0.5f * (scalarTrilinear(field, size, p.x, p.y + 1.0f, p.z) - scalarTrilinear(field, size, p.x, p.y - 1.0f, p.z)),
+            .z = 0.5f * (scalarTrilinear(field, size, p.x, p.y, p.z + 1.0f) - scalarTrilinear(field, size, p.x, p.y, p.z - 1.0f)),
+        };
+    }
+}
+
+static void benchFieldSampler(int maxSize)
+{
+    const int pointCount = 1 << 16;
+    cp_vec3* points = malloc(pointCount * sizeof(cp_vec3));
+    cp_vec3* gradients = malloc(pointCount * sizeof(cp_vec3));
+    float* values = malloc(pointCount * sizeof(float));
+
+    printHeader("fieldSample (value + gradient per point)", "op");
+
+    for (int size = 32; size <= maxSize && size <= 128; size *= 4)
+    {
+        const size_t count = (size_t) size * size * size;
+        bool* boolArr = malloc(count);
+        uint8_t* field = malloc(count);
+        float* floatField = malloc(count * sizeof(float));
+        char sizeStr[16];
+        snprintf(sizeStr, sizeof(sizeStr), "%d^3", size);
+
+        fillPattern(boolArr, size, PATTERN_CAVES);
+        boolArrToManhattanDF(boolArr, field, size, size, size);
+        for (size_t i = 0; i < count; i++)
+            floatField[i] = (float) field[i];
+        for (int i = 0; i < pointCount; i++)
+            points[i] = (cp_vec3) {.x = randomFloat(0.0f, (float) size), .y = randomFloat(0.0f, (float) size),
+                                   .z = randomFloat(0.0f, (float) size)};
+
+        BenchTime t;
+        // the baseline: 7 separate lookups per point (the value and 2 per axis for the central difference)
+        BENCH_MEASURE(t, , scalarFieldSample(field, size, points, pointCount, values, gradients));
+        printResult("caves", sizeStr, "scalar u8", t, pointCount, pointCount * (56.0 + 36.0));
+        g_sink += (uint64_t) values[pointCount / 2];
+
+        // 32 samples per point, but the rows are one fetch each
+        BENCH_MEASURE(t, , fieldSampleU8(field, size, size, size, points, pointCount, values, gradients));
+        printResult("caves", sizeStr, "u8", t, pointCount, pointCount * (48.0 + 36.0));
+        g_sink += (uint64_t) values[pointCount / 2];
+
+        BENCH_MEASURE(t, , fieldSampleF32(floatField, size, size, size, points, pointCount, values, gradients));
+        printResult("caves", sizeStr, "f32", t, pointCount, pointCount * (128.0 + 36.0));
+        g_sink += (uint64_t) values[pointCount / 2];
+
+        free(boolArr);
+        free(field);
+        free(floatField);
+    }
+
+    free(points);
+    free(gradients);
+    free(values);
+}
+
+// synthetic load for the job system: bursts of small chunks at random distances, some of them changing again right away
+typedef struct BenchJobsLoad
+{
+    DistanceFieldJobs* jobs;
+    DistanceFieldJob* jobArr;
+    DistanceFieldJobChunk* chunks;
+    const bool* boolArr;
+    uint8_t* fields;
+    const float* distances;
+    int jobCount, size;
+    int staleEvery;         // every n-th job replaces the previous one (0: never)
+    bool* finished;         // per job, set if its callback reported it done
+    int handled, done;
+    double nearRanks;       // sum of the completion positions of the jobs in the nearest bucket
+    int nearCount;
+} BenchJobsLoad;
+
+static void benchJobsCallback(DistanceFieldJob* job, DistanceFieldJobStatus status)
+{
+    BenchJobsLoad* load = job->user;
+    if (status == DISTANCE_FIELD_JOB_DONE)
+    {
+        if (load->distances[job - load->jobArr] < load->jobs->bucketDistance)
+        {
+            load->nearRanks += (double) load->done;
+            load->nearCount++;
+        }
+        load->done++;
+        load->finished[job - load->jobArr] = true;
+    }
+    load->handled++;
+}
+
+static void benchJobsRun(BenchJobsLoad* load)
+{
+    const int burst = 512;
+    const size_t fieldSize = (size_t) load->size * load->size * load->size;
+    load->handled = load->done = load->nearCount = 0;
+    load->nearRanks = 0.0;
+    memset(load->finished, 0, load->jobCount * sizeof(bool));
+
+    for (int i = 0; i < load->jobCount; i++)
+    {
+        const bool stale = load->staleEvery && i % load->staleEvery == load->staleEvery - 1;
+        DistanceFieldJobChunk* chunk = &load->chunks[stale ? i - 1 : i];
+        load->jobArr[i] = (DistanceFieldJob) {.boolArr = load->boolArr, .o_distanceField = load->fields + i * fieldSize,
+                                              .sizeX = load->size, .sizeY = load->size, .sizeZ = load->size,
+                                              .callback = benchJobsCallback, .user = load};
+        while (!distanceFieldJobsSubmit(load->jobs, &load->jobArr[i], chunk, load->distances[i]))
+            distanceFieldJobsPoll(load->jobs);
+
+        // a frame between the bursts
+        if (i % burst == burst - 1)
+            distanceFieldJobsPoll(load->jobs);
+    }
+
+    while (load->handled < load->jobCount)
+    {
+        distanceFieldJobsPoll(load->jobs);
+        sched_yield();
+    }
+}
+
+static void benchDistanceFieldJobs()
+{
+    enum { JOBS = 4096, SIZE = 16 };
+    static DistanceFieldJobs jobs;
+    static DistanceFieldJob jobArr[JOBS];
+    static DistanceFieldJobChunk chunks[JOBS];
+    static float distances[JOBS];
+    static bool finished[JOBS];
+    const size_t fieldSize = SIZE * SIZE * SIZE;
+    bool* boolArr = malloc(fieldSize);
+    uint8_t* fields = malloc(JOBS * fieldSize);
+    uint8_t* reference = malloc(fieldSize);
+
+    fillPattern(boolArr, SIZE, PATTERN_CAVES);
+    boolArrToManhattanDF(boolArr, reference, SIZE, SIZE, SIZE);
+    for (int i = 0; i < JOBS; i++)
+        distances[i] = randomFloat(0.0f, 800.0f);
+
+    printHeader("distanceFieldJobs (4096 jobs of 16^3 in bursts of 512)", "op");
+    BenchTime t;
+
+    // the same work without the scheduler, on the calling thread
+    BENCH_MEASURE(t, , for (int i = 0; i < JOBS; i++) boolArrToManhattanDF(boolArr, fields + i * fieldSize, SIZE, SIZE, SIZE));
+    printResult("16^3 chunks", "4096", "direct", t, JOBS, 2.0 * JOBS * fieldSize);
+    g_sink += fields[fieldSize / 2];
+
+    if (!distanceFieldJobsStart(&jobs, 0, 100.0f))
+    {
+        free(boolArr);
+        free(fields);
+        free(reference);
+        return;
+    }
+
+    BenchJobsLoad load = {.jobs = &jobs, .jobArr = jobArr, .chunks = chunks, .boolArr = boolArr, .fields = fields,
+                          .distances = distances, .jobCount = JOBS, .size = SIZE, .finished = finished};
+    char stage[32];
+    for (int staleEvery = 0; staleEvery <= 4; staleEvery += 4)
+    {
+        load.staleEvery = staleEvery;
+
+        // one untimed run on cleared fields first: every job reported done has to hold the same field as a direct build
+        memset(fields, 0xFF, JOBS * fieldSize);
+        benchJobsRun(&load);
+        int wrong = 0;
+        for (int i = 0; i < JOBS; i++)
+            wrong += finished[i] && memcmp(fields + i * fieldSize, reference, fieldSize) != 0;
+        if (wrong)
+            fprintf(stderr, "distanceFieldJobs: %d of %d finished fields differ from boolArrToManhattanDF\n", wrong, load.done);
+
+        BENCH_MEASURE(t, , benchJobsRun(&load));
+
+        // where the nearest eighth finished among all jobs, 0.06 if strictly first, 0.5 without priorities
+        snprintf(stage, sizeof(stage), "near@%.2f", load.nearCount ? load.nearRanks / load.nearCount / load.done : 0.0);
+        printResult(staleEvery ? "25% stale" : "16^3 chunks", "4096", stage, t, JOBS, 2.0 * load.done * fieldSize);
+        g_sink += load.done;
+    }
+
+    distanceFieldJobsStop(&jobs);
+    distanceFieldJobsPoll(&jobs);
+    free(boolArr);
+    free(fields);
+    free(reference);
+}
+
+/**
+ * cpmath benchmarks
+ */
+
+#define CPMATH_BENCH_COUNT 4096
+
+// Applies op to every element of the input arrays. Results are written to an output array, so the loop can't be
+// optimized away and the numbers reflect throughput rather than latency.
+#define BENCH_CPMATH_BINARY(name, type, op, bytesPerOp)                                     \
+    do {                                                                                    \
+        BenchTime t_;                                                                       \
+        BENCH_MEASURE(t_, , for (int i_ = 0; i_ < CPMATH_BENCH_COUNT; i_++)                 \
+            out##type[i_] = op(a##type[i_], b##type[i_]));                                  \
+        printResult(name, #type, "", t_, CPMATH_BENCH_COUNT, (bytesPerOp) * CPMATH_BENCH_COUNT); \
+        g_sink += (uint64_t) out##type[CPMATH_BENCH_COUNT / 2].x;                           \
+    } while (0)
+
+#define BENCH_CPMATH_UNARY(name, type, op, bytesPerOp)                                      \
+    do {                                                                                    \
+        BenchTime t_;                                                                       \
+        BENCH_MEASURE(t_, , for (int i_ = 0; i_ < CPMATH_BENCH_COUNT; i_++)                 \
+            out##type[i_] = op(a##type[i_]));                                               \
+        printResult(name, #type, "", t_, CPMATH_BENCH_COUNT, (bytesPerOp) * CPMATH_BENCH_COUNT); \
+        g_sink += (uint64_t) out##type[CPMATH_BENCH_COUNT / 2].x;                           \
+    } while (0)
+
+#define BENCH_CPMATH_SCALAR(name, type, op, bytesPerOp)                                     \
+    do {                                                                                    \
+        BenchTime t_;                                                                       \
+        BENCH_MEASURE(t_, , for (int i_ = 0; i_ < CPMATH_BENCH_COUNT; i_++)                 \
+            outf[i_] = op(a##type[i_], b##type[i_]));                                       \
+        printResult(name, #type, "", t_, CPMATH_BENCH_COUNT, (bytesPerOp) * CPMATH_BENCH_COUNT); \
+        g_sink += (uint64_t) outf[CPMATH_BENCH_COUNT / 2];                                  \
+    } while (0)
+
+static void benchCpmath()
+{
+    // vec3 is stored as 16 bytes, so every vec3 / vec4 load or store moves 16 bytes
+    static vec4 avec4[CPMATH_BENCH_COUNT], bvec4[CPMATH_BENCH_COUNT], cvec4[CPMATH_BENCH_COUNT], outvec4[CPMATH_BENCH_COUNT];
+    static vec3 avec3[CPMATH_BENCH_COUNT], bvec3[CPMATH_BENCH_COUNT], outvec3[CPMATH_BENCH_COUNT];
+    static ivec4 aivec4[CPMATH_BENCH_COUNT], bivec4[CPMATH_BENCH_COUNT], outivec4[CPMATH_BENCH_COUNT];
+    static float outf[CPMATH_BENCH_COUNT];
+
+    g_rngState = 0x12345678u;
+    for (int i = 0; i < CPMATH_BENCH_COUNT; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            avec4[i].arr[c] = (float) (xorshift32() % 1000) / 100.0f + 0.5f;
+            bvec4[i].arr[c] = (float) (xorshift32() % 1000) / 100.0f + 0.5f;
+            cvec4[i].arr[c] = (float) (xorshift32() % 1000) / 100.0f + 0.5f;
+            aivec4[i].arr[c] = (int32_t) (xorshift32() % 1000);
+            bivec4[i].arr[c] = (int32_t) (xorshift32() % 1000) + 1;
+        }
+        avec3[i].i = avec4[i].i;
+        bvec3[i].i = bvec4[i].i;
+    }
+
+    printHeader("cpmath", "op");
+
+    BENCH_CPMATH_BINARY("add", vec4, cp_vec4_add, 48.0);
+    BENCH_CPMATH_BINARY("add", vec3, cp_vec3_add, 48.0);
+    BENCH_CPMATH_BINARY("add", ivec4, cp_ivec4_add, 48.0);
+    BENCH_CPMATH_BINARY("mul", vec4, cp_vec4_mul, 48.0);
+    BENCH_CPMATH_BINARY("mul", vec3, cp_vec3_mul, 48.0);
+    BENCH_CPMATH_BINARY("div", vec4, cp_vec4_div, 48.0);
+    BENCH_CPMATH_BINARY("div", ivec4, cp_ivec4_div, 48.0);
+    BENCH_CPMATH_BINARY("cross", vec3, cp_vec3_cross, 48.0);
+    BENCH_CPMATH_SCALAR("dot", vec4, cp_vec4_dot, 36.0);
+    BENCH_CPMATH_SCALAR("dot", vec3, cp_vec3_dot, 36.0);
+    BENCH_CPMATH_UNARY("normalize", vec4, cp_vec4_normalize, 32.0);
+    BENCH_CPMATH_UNARY("normalize", vec3, cp_vec3_normalize, 32.0);
+
+    {
+        BenchTime t;
+        BENCH_MEASURE(t, , for (int i = 0; i < CPMATH_BENCH_COUNT; i++) outf[i] = cp_vec3_length(avec3[i]));
+        printResult("length", "vec3", "", t, CPMATH_BENCH_COUNT, 20.0 * CPMATH_BENCH_COUNT);
+        g_sink += (uint64_t) outf[CPMATH_BENCH_COUNT / 2];
+
+        BENCH_MEASURE(t, , for (int i = 0; i < CPMATH_BENCH_COUNT; i++) outvec4[i] = cp_vec4_fma(avec4[i], bvec4[i], cvec4[i]));
+        printResult("fma", "vec4", "", t, CPMATH_BENCH_COUNT, 64.0 * CPMATH_BENCH_COUNT);
+        g_sink += (uint64_t) outvec4[CPMATH_BENCH_COUNT / 2].x;
+    }
+}
+
+/**
+ * Culling
+ */
+
+#define CULLING_BENCH_COUNT 16384
+
+static float g_cullMinX[CULLING_BENCH_COUNT], g_cullMinY[CULLING_BENCH_COUNT], g_cullMinZ[CULLING_BENCH_COUNT];
+static float g_cullMaxX[CULLING_BENCH_COUNT], g_cullMaxY[CULLING_BENCH_COUNT], g_cullMaxZ[CULLING_BENCH_COUNT];
+static float g_cullRadius[CULLING_BENCH_COUNT];
+static uint32_t g_cullIndices[CULLING_BENCH_COUNT];
+
+// The culling functions are usually throughput bound, so besides ns/op the stage column shows boxes (or spheres) per ns.
+// bytesPerElement is what has to be read per box / sphere, each visible one additionally writes its index
+static void printCullingResult(const char* name, uint32_t visible, BenchTime t, double bytesPerElement)
+{
+    char stage[32];
+    snprintf(stage, sizeof(stage), "%.2f/ns", CULLING_BENCH_COUNT * (double) t.reps / t.nanoseconds);
+    printResult(name, "16384", stage, t, CULLING_BENCH_COUNT, bytesPerElement * CULLING_BENCH_COUNT + 4.0 * visible);
+}
+
+static void benchCulling()
+{
+    printHeader("culling", "op");
+
+    // boxes with an edge length of up to 4 scattered around the camera, roughly a quarter of them ends up visible
+    for (int i = 0; i < CULLING_BENCH_COUNT; i++)
+    {
+        g_cullMinX[i] = randomFloat(-100.0f, 100.0f);
+        g_cullMinY[i] = randomFloat(-100.0f, 100.0f);
+        g_cullMinZ[i] = randomFloat(-100.0f, 100.0f);
+        g_cullMaxX[i] = g_cullMinX[i] + randomFloat(0.0f, 4.0f);
+        g_cullMaxY[i] = g_cullMinY[i] + randomFloat(0.0f, 4.0f);
+        g_cullMaxZ[i] = g_cullMinZ[i] + randomFloat(0.0f, 4.0f);
+        g_cullRadius[i] = randomFloat(0.0f, 2.0f);
+    }
+
+    // 90 degree frustum at the origin looking along +z
+    const float h = 0.70710678f;
+    cp_frustum frustum = {.planes = {
+        {.x = h, .y = 0.0f, .z = h, .w = 0.0f},
+        {.x = -h, .y = 0.0f, .z = h, .w = 0.0f},
+        {.x = 0.0f, .y = h, .z = h, .w = 0.0f},
+        {.x = 0.0f, .y = -h, .z = h, .w = 0.0f},
+        {.x = 0.0f, .y = 0.0f, .z = 1.0f, .w = -0.1f},
+        {.x = 0.0f, .y = 0.0f, .z = -1.0f, .w = 100.0f},
+    }};
+
+    cp_aabb_soa boxes = {g_cullMinX, g_cullMinY, g_cullMinZ, g_cullMaxX, g_cullMaxY, g_cullMaxZ, CULLING_BENCH_COUNT};
+    cp_sphere_soa spheres = {g_cullMinX, g_cullMinY, g_cullMinZ, g_cullRadius, CULLING_BENCH_COUNT};
+    cp_aabb query = {.min = {.x = -20.0f, .y = -20.0f, .z = -20.0f}, .max = {.x = 20.0f, .y = 20.0f, .z = 20.0f}};
+
+    BenchTime t;
+    uint32_t visible = 0;
+
+    BENCH_MEASURE(t, , visible = cp_frustum_cull_aabbs(&frustum, &boxes, g_cullIndices));
+    printCullingResult("frustum aabb", visible, t, 24.0);
+    g_sink += visible;
+
+    BENCH_MEASURE(t, , visible = cp_frustum_cull_spheres(&frustum, &spheres, g_cullIndices));
+    printCullingResult("frustum sphere", visible, t, 16.0);
+    g_sink += visible;
+
+    BENCH_MEASURE(t, , visible = cp_aabb_overlap_batch(query, &boxes, g_cullIndices));
+    printCullingResult("aabb overlap", visible, t, 24.0);
+    g_sink += visible;
+}
+
+int main(int argc, char** argv)
+{
+    int maxSize = 256;
+    int positional = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--csv") == 0)
+            g_csv = 1;
+        else if (positional++ == 0)
+            maxSize = atoi(argv[i]);
+        else
+            g_minMillis = atoi(argv[i]);
+    }
+
+    if (maxSize < 16 || g_minMillis < 0)
+    {
+        fprintf(stderr, "usage: %s [maxSize >= 16] [minMillisPerMeasurement] [--csv]\n", argv[0]);
+        return 1;
+    }
+
+    if (g_csv)
+        printf("case,size,stage,ns_per_element,gb_per_s,ticks_per_element\n");
+
+    benchDistanceField(maxSize);
+    benchFlowField(maxSize);
+    benchNoise(maxSize);
+    benchAO(maxSize);
+    benchCollision(maxSize);
+    benchLineOfSight(maxSize);
+    benchBlockLight(maxSize);
+    benchOctantDF(maxSize);
+    benchDistanceFieldFile(maxSize);
+    benchMaterialDF(maxSize);
+    benchBlockIdDF(maxSize);
+    benchConnectedComponents(maxSize);
+    benchChunkVisibility(maxSize);
+    benchHiZOcclusion();
+    benchOccupancyLod(maxSize);
+    benchSurfaceNets(maxSize);
+    benchFieldSampler(maxSize);
+    benchDistanceFieldJobs();
+    benchCpmath();
+    benchCulling();
+
+    return g_sink == 42 ? 2 : 0;
+}
@@ -0,0 +1,432 @@
+#ifndef VOXELDEVSCRIPTS_BLOCKLIGHT_H
+#define VOXELDEVSCRIPTS_BLOCKLIGHT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "VoxelStats.h"
+
+/*
+ * Block light (torches, lava, glowing blocks, ...) propagation, built like the distance field passes of BoolArrToManhattan.h.
+ *
+ * Every voxel has an emission (0 - 15) and an opacity (0 - 15). The light level of a voxel is
+ *      light = max(emission, max over the 6 neighbours (neighbourLight - 1 - opacity))
+ * clamped at 0, so light loses one level per step plus the opacity of every voxel it enters. Voxels with an opacity of 15
+ * are opaque: they can emit light themselves, but no light gets into them.
+ *
+ * This is a distance transform with a per voxel cost, so we can use the same passes as for the distance field: relax every
+ * row along x (forward and backward), then every column along y, then along z. Without opacity one round of passes would be
+ * enough (just like for the distance field), but light also has to go around opaque voxels, which can take a couple of rounds.
+ * So the full rebuild repeats rounds until nothing changes. Light fades after 15 steps, so this stays a handful of rounds.
+ * Like the distance field passes, the Y and Z passes relax whole rows / planes at once and vectorize well. The X pass can't
+ * do that, every voxel depends on the previous one in the row. But since light only travels 15 voxels, a log step scan
+ * (4 steps of 1, 2, 4 and 8 voxels per direction) gives the same result and does vectorize.
+ *
+ * For changes of single voxels (placing a torch or a block), rebuilding the chunk is overkill. blockLightUpdate removes the
+ * light that depended on the voxel with a breadth first search and then fills the hole from the surrounding light (and the
+ * new emission), touching only the voxels whose light changes.
+ *
+ * Light stays inside of the volume, voxels outside of it are neither lit nor block anything.
+ */
+
+#define BLOCK_LIGHT_MAX 15
+
+// light entering a voxel with the given opacity from a neighbour with light level l, all unsigned, so this vectorizes
+static inline uint8_t blockLightAttenuate(uint8_t l, uint8_t opacity)
+{
+    const uint8_t cost = opacity + 1;
+    return l > cost ? l - cost : 0;
+}
+
+// Relaxes every element of row against the corresponding element of prevRow, returns non-zero if anything changed.
+static inline uint8_t blockLightRelaxRow(uint8_t* restrict row, const uint8_t* restrict prevRow, const uint8_t* restrict opacityRow, int sizeX)
+{
+    uint8_t changed = 0;
+    VOXEL_STATS_ONLY(uint32_t updates = 0;)
+    for (int x = 0; x < sizeX; x++)
+    {
+        const uint8_t incoming = blockLightAttenuate(prevRow[x], opacityRow[x]);
+        const uint8_t l = incoming > row[x] ? incoming : row[x];
+        changed |= l ^ row[x];
+        VOXEL_STATS_ONLY(updates += l != row[x];)
+        row[x] = l;
+    }
+    VOXEL_STATS_UPDATES(updates);
+    return changed;
+}
+
+// One step of the X pass scan: every element takes the light from step elements before it. cost holds the summed cost of
+// the step elements ending at the element (capped at 16, that's more than any light can pay), the new sums are written to
+// o_cost. After steps 1, 2, 4 and 8, light has travelled up to 15 elements, which is as far as it goes.
+static inline void blockLightScanForward(uint8_t* restrict o_light, uint8_t* restrict o_cost, const uint8_t* restrict light,
+                                         const uint8_t* restrict cost, int count, int step)
+{
+    const uint8_t* lightBefore = light - step;
+    const uint8_t* costBefore = cost - step;
+
+    for (int i = 0; i < step; i++)
+        o_light[i] = light[i], o_cost[i] = cost[i];
+
+    for (int i = step; i < count; i++)
+    {
+        const uint8_t incoming = lightBefore[i] > cost[i] ? lightBefore[i] - cost[i] : 0;
+        const uint8_t summedCost = costBefore[i] + cost[i];
+        o_light[i] = incoming > light[i] ? incoming : light[i];
+        o_cost[i] = summedCost < 16 ? summedCost : 16;
+    }
+}
+
+// same as blockLightScanForward, but takes the light from step elements after the element
+static inline void blockLightScanBackward(uint8_t* restrict o_light, uint8_t* restrict o_cost, const uint8_t* restrict light,
+                                          const uint8_t* restrict cost, int count, int step)
+{
+    const uint8_t* lightAfter = light + step;
+    const uint8_t* costAfter = cost + step;
+    const int last = count - step;
+
+    for (int i = 0; i < last; i++)
+    {
+        const uint8_t incoming = lightAfter[i] > cost[i] ? lightAfter[i] - cost[i] : 0;
+        const uint8_t summedCost = costAfter[i] + cost[i];
+        o_light[i] = incoming > light[i] ? incoming : light[i];
+        o_cost[i] = summedCost < 16 ? summedCost : 16;
+    }
+
+    for (int i = last; i < count; i++)
+        o_light[i] = light[i], o_cost[i] = cost[i];
+}
+
+#define BLOCK_LIGHT_X_BATCH 4096
+
+static uint8_t blockLightXPASS(uint8_t* light, const uint8_t* opacity, int sizeX, int sizeY, int sizeZ)
+{
+    const int rowCount = sizeY * sizeZ;
+    const int rowsPerBatch = BLOCK_LIGHT_X_BATCH / sizeX;
+    uint8_t changed = 0;
+    VOXEL_STATS_BEGIN(VOXEL_STATS_BLOCK_LIGHT_XPASS);
+
+    // Along x every element depends on the previous one, which would make this pass scalar (and by far the slowest).
+    // Instead we scan batches of rows with log steps: light can't get further than 15 voxels, so 4 steps per direction
+    // are enough and every step vectorizes. The first element of a row (the last one going backward) costs 16, so no
+    // light leaks from one row into the next.
+    if (rowsPerBatch > 0)
+    {
+        uint8_t lightA[BLOCK_LIGHT_X_BATCH], lightB[BLOCK_LIGHT_X_BATCH];
+        uint8_t costA[BLOCK_LIGHT_X_BATCH], costB[BLOCK_LIGHT_X_BATCH];
+
+        for (int firstRow = 0; firstRow < rowCount; firstRow += rowsPerBatch)
+        {
+            const int rows = rowCount - firstRow < rowsPerBatch ? rowCount - firstRow : rowsPerBatch;
+            const int count = rows * sizeX;
+            uint8_t* batch = light + (uint64_t) firstRow * sizeX;
+            const uint8_t* opacityBatch = opacity + (uint64_t) firstRow * sizeX;
+
+            for (int i = 0; i < count; i++)
+                costA[i] = opacityBatch[i] < 15 ? opacityBatch[i] + 1 : 16;
+            for (int row = 0; row < rows; row++)
+                costA[row * sizeX] = 16;
+
+            blockLightScanForward(lightA, costB, batch, costA, count, 1);
+            blockLightScanForward(lightB, costA, lightA, costB, count, 2);
+            blockLightScanForward(lightA, costB, lightB, costA, count, 4);
+            blockLightScanForward(lightB, costA, lightA, costB, count, 8);
+
+            for (int i = 0; i < count; i++)
+                costA[i] = opacityBatch[i] < 15 ? opacityBatch[i] + 1 : 16;
+            for (int row = 0; row < rows; row++)
+                costA[row * sizeX + sizeX - 1] = 16;
+
+            blockLightScanBackward(lightA, costB, lightB, costA, count, 1);
+            blockLightScanBackward(lightB, costA, lightA, costB, count, 2);
+            blockLightScanBackward(lightA, costB, lightB, costA, count, 4);
+            blockLightScanBackward(lightB, costA, lightA, costB, count, 8);
+
+            VOXEL_STATS_ONLY(uint32_t updates = 0;)
+            for (int i = 0; i < count; i++)
+            {
+                changed |= lightB[i] ^ batch[i];
+                VOXEL_STATS_ONLY(updates += lightB[i] != batch[i];)
+            }
+            VOXEL_STATS_UPDATES(updates);
+            memcpy(batch, lightB, count);
+        }
+
+        VOXEL_STATS_END(VOXEL_STATS_BLOCK_LIGHT_XPASS, (uint64_t) sizeX * sizeY * sizeZ, 3ull * sizeX * sizeY * sizeZ);
+        return changed;
+    }
+
+    // rows that don't fit into a batch are relaxed element by element
+    for (int r = 0; r < rowCount; r++)
+    {
+        uint8_t* row = light + (uint64_t) r * sizeX;
+        const uint8_t* opacityRow = opacity + (uint64_t) r * sizeX;
+
+        for (int x = 1; x < sizeX; x++)
+        {
+            const uint8_t incoming = blockLightAttenuate(row[x - 1], opacityRow[x]);
+            if (incoming > row[x])
+            {
+                row[x] = incoming, changed = 1;
+                VOXEL_STATS_UPDATES(1);
+            }
+        }
+
+        for (int x = sizeX - 2; x >= 0; x--)
+        {
+            const uint8_t incoming = blockLightAttenuate(row[x + 1], opacityRow[x]);
+            if (incoming > row[x])
+            {
+                row[x] = incoming, changed = 1;
+                VOXEL_STATS_UPDATES(1);
+            }
+        }
+    }
+
+    // reads light and opacity, writes light
+    VOXEL_STATS_END(VOXEL_STATS_BLOCK_LIGHT_XPASS, (uint64_t) sizeX * sizeY * sizeZ, 3ull * sizeX * sizeY * sizeZ);
+    return changed;
+}
+
+static uint8_t blockLightYPASS(uint8_t* light, const uint8_t* opacity, int sizeX, int sizeY, int sizeZ)
+{
+    uint8_t changed = 0;
+    VOXEL_STATS_BEGIN(VOXEL_STATS_BLOCK_LIGHT_YPASS);
+
+    for (int z = 0; z < sizeZ; z++)
+    {
+        uint8_t* plane = light + (uint64_t) z * sizeX * sizeY;
+        const uint8_t* opacityPlane = opacity + (uint64_t) z * sizeX * sizeY;
+
+        for (int y = 1; y < sizeY; y++)
+            changed |= blockLightRelaxRow(plane + y * sizeX, plane + (y - 1) * sizeX, opacityPlane + y * sizeX, sizeX);
+
+        for (int y = sizeY - 2; y >= 0; y--)
+            changed |= blockLightRelaxRow(plane + y * sizeX, plane + (y + 1) * sizeX, opacityPlane + y * sizeX, sizeX);
+    }
+
+    // both directions read light and opacity and write light
+    VOXEL_STATS_END(VOXEL_STATS_BLOCK_LIGHT_YPASS, (uint64_t) sizeX * sizeY * sizeZ, 6ull * sizeX * sizeY * sizeZ);
+    return changed;
+}
+
+static uint8_t blockLightZPASS(uint8_t* light, const uint8_t* opacity, int sizeX, int sizeY, int sizeZ)
+{
+    const int planeSize = sizeX * sizeY;
+    uint8_t changed = 0;
+    VOXEL_STATS_BEGIN(VOXEL_STATS_BLOCK_LIGHT_ZPASS);
+
+    // planes are contiguous, so we can relax a whole plane against its neighbour as if it were a single row
+    for (int z = 1; z < sizeZ; z++)
+        changed |= blockLightRelaxRow(light + (uint64_t) z * planeSize, light + (uint64_t) (z - 1) * planeSize,
+                                      opacity + (uint64_t) z * planeSize, planeSize);
+
+    for (int z = sizeZ - 2; z >= 0; z--)
+        changed |= blockLightRelaxRow(light + (uint64_t) z * planeSize, light + (uint64_t) (z + 1) * planeSize,
+                                      opacity + (uint64_t) z * planeSize, planeSize);
+
+    VOXEL_STATS_END(VOXEL_STATS_BLOCK_LIGHT_ZPASS, (uint64_t) sizeX * sizeY * sizeZ, 6ull * sizeX * sizeY * sizeZ);
+    return changed;
+}
+
+// Computes the light of every voxel from scratch, e.g. when a chunk is loaded or generated.
+static void blockLightRebuild(const uint8_t* emission, const uint8_t* opacity, uint8_t* o_light, int sizeX, int sizeY, int sizeZ)
+{
+    VOXEL_STATS_BEGIN(VOXEL_STATS_BLOCK_LIGHT_REBUILD);
+    memcpy(o_light, emission, (size_t) sizeX * sizeY * sizeZ);
+    VOXEL_STATS_ONLY(int rounds = 0;)
+
+    // every round spreads light along all paths that go x -> y -> z, paths around corners need more rounds.
+    // a round that changes nothing means we're done.
+    bool changed = true;
+    while (changed)
+    {
+        changed = blockLightXPASS(o_light, opacity, sizeX, sizeY, sizeZ) != 0;
+        changed |= blockLightYPASS(o_light, opacity, sizeX, sizeY, sizeZ) != 0;
+        changed |= blockLightZPASS(o_light, opacity, sizeX, sizeY, sizeZ) != 0;
+        VOXEL_STATS_ONLY(rounds++;)
+    }
+
+    // the passes record their own updates, the bytes are those of all passes of all rounds
+    VOXEL_STATS_END(VOXEL_STATS_BLOCK_LIGHT_REBUILD, (uint64_t) sizeX * sizeY * sizeZ,
+                    (2ull + 15ull * rounds) * sizeX * sizeY * sizeZ);
+}
+
+/**
+ * Incremental updates
+ */
+
+// Buffers for blockLightUpdate, for a volume of n voxels:
+//  -   addQueue: n entries (it's a ring buffer, a voxel is never in it twice)
+//  -   removeQueue: n entries (every voxel is removed at most once)
+//  -   queued: (n + 63) / 64 words, must be zeroed once before the first update, it's zero again after every update
+// Voxel indices are stored together with a light level in the remove queue, so the volume can have at most 2^28 voxels.
+typedef struct BlockLightWorkspace
+{
+    uint32_t* addQueue;
+    uint32_t* removeQueue;
+    uint64_t* queued;
+} BlockLightWorkspace;
+
+typedef struct BlockLightVolume
+{
+    uint8_t* light;
+    uint8_t* emission;
+    uint8_t* opacity;
+    int sizeX, sizeY, sizeZ;
+} BlockLightVolume;
+
+// runs body with neighbour set to every neighbour of voxel index that's inside of the volume
+#define BLOCK_LIGHT_FOR_NEIGHBOURS(volume, index, neighbour, body)                                                      \
+    do {                                                                                                                \
+        const uint32_t planeSize_ = (uint32_t) (volume)->sizeX * (volume)->sizeY;                                      \
+        const uint32_t x_ = (index) % (volume)->sizeX, y_ = (index) / (volume)->sizeX % (volume)->sizeY;               \
+        const uint32_t z_ = (index) / planeSize_;                                                                       \
+        uint32_t neighbour;                                                                                             \
+        if (x_ > 0) { neighbour = (index) - 1; body }                                                                   \
+        if (x_ + 1 < (uint32_t) (volume)->sizeX) { neighbour = (index) + 1; body }                                      \
+        if (y_ > 0) { neighbour = (index) - (volume)->sizeX; body }                                                     \
+        if (y_ + 1 < (uint32_t) (volume)->sizeY) { neighbour = (index) + (volume)->sizeX; body }                        \
+        if (z_ > 0) { neighbour = (index) - planeSize_; body }                                                          \
+        if (z_ + 1 < (uint32_t) (volume)->sizeZ) { neighbour = (index) + planeSize_; body }                             \
+    } while (0)
+
+static inline void blockLightEnqueue(const BlockLightVolume* volume, BlockLightWorkspace* workspace, uint32_t* tail, uint32_t index)
+{
+    if ((workspace->queued[index >> 6] >> (index & 63)) & 1)
+        return;
+
+    const uint32_t capacity = (uint32_t) volume->sizeX * volume->sizeY * volume->sizeZ;
+    workspace->queued[index >> 6] |= 1ull << (index & 63);
+    workspace->addQueue[*tail % capacity] = index;
+    (*tail)++;
+}
+
+// Sets the emission and opacity of voxel (x, y, z) and updates the light of all voxels affected by the change.
+static void blockLightUpdate(BlockLightVolume* volume, BlockLightWorkspace* workspace, int x, int y, int z, uint8_t emission, uint8_t opacity)
+{
+    const uint32_t capacity = (uint32_t) volume->sizeX * volume->sizeY * volume->sizeZ;
+    const uint32_t index = (uint32_t) z * volume->sizeX * volume->sizeY + (uint32_t) y * volume->sizeX + (uint32_t) x;
+    uint8_t* light = volume->light;
+    uint32_t addHead = 0, addTail = 0;
+    VOXEL_STATS_BEGIN(VOXEL_STATS_BLOCK_LIGHT_UPDATE);
+
+    // 1. remove all light that might have come from the voxel: every neighbour with less light than the voxel we're
+    //    coming from could have been lit by it, so it's cleared as well. Neighbours with at least as much light have
+    //    another source, they refill the cleared voxels in step 3. Emitters that were cleared are added back there, too.
+    //    If the voxel only gets brighter or more transparent, no light can be lost and we can skip this.
+    const bool darker = emission < volume->emission[index] || opacity > volume->opacity[index];
+    uint32_t removeCount = 0;
+    if (darker && light[index] > 0)
+    {
+        workspace->removeQueue[removeCount++] = index << 4 | light[index];
+        light[index] = 0;
+    }
+
+    for (uint32_t i = 0; i < removeCount; i++)
+    {
+        const uint32_t current = workspace->removeQueue[i] >> 4;
+        const uint8_t level = workspace->removeQueue[i] & 15;
+
+        BLOCK_LIGHT_FOR_NEIGHBOURS(volume, current, neighbour, {
+            const uint8_t l = light[neighbour];
+            if (l != 0 && l < level)
+            {
+                workspace->removeQueue[removeCount++] = neighbour << 4 | l;
+                light[neighbour] = 0;
+                if (volume->emission[neighbour] > 0)
+                    blockLightEnqueue(volume, workspace, &addTail, neighbour);
+            }
+            else if (l != 0)
+                blockLightEnqueue(volume, workspace, &addTail, neighbour);
+        });
+    }
+
+    // 2. apply the change, the voxel itself and its neighbours (which might now shine into it) start spreading again
+    volume->emission[index] = emission;
+    volume->opacity[index] = opacity;
+    blockLightEnqueue(volume, workspace, &addTail, index);
+    BLOCK_LIGHT_FOR_NEIGHBOURS(volume, index, neighbour, {
+        if (light[neighbour] > 0)
+            blockLightEnqueue(volume, workspace, &addTail, neighbour);
+    });
+
+    // 3. spread light from everything in the queue. A voxel whose light increases while it's still queued isn't queued
+    //    again, it will spread its new light when it comes up.
+    while (addHead != addTail)
+    {
+        const uint32_t current = workspace->addQueue[addHead % capacity];
+        addHead++;
+        workspace->queued[current >> 6] &= ~(1ull << (current & 63));
+
+        if (volume->emission[current] > light[current])
+            light[current] = volume->emission[current];
+        const uint8_t l = light[current];
+
+        BLOCK_LIGHT_FOR_NEIGHBOURS(volume, current, neighbour, {
+            const uint8_t incoming = blockLightAttenuate(l, volume->opacity[neighbour]);
+            if (incoming > light[neighbour])
+            {
+                light[neighbour] = incoming;
+                VOXEL_STATS_UPDATES(1);
+                blockLightEnqueue(volume, workspace, &addTail, neighbour);
+            }
+        });
+    }
+
+    // elements are the voxels taken out of both queues, the traffic is scattered and isn't modeled
+    VOXEL_STATS_END(VOXEL_STATS_BLOCK_LIGHT_UPDATE, (uint64_t) removeCount + addHead, 0);
+}
+
+// Places a light source with the given level (keeps the opacity of the voxel).
+static void blockLightAdd(BlockLightVolume* volume, BlockLightWorkspace* workspace, int x, int y, int z, uint8_t level)
+{
+    const uint32_t index = (uint32_t) z * volume->sizeX * volume->sizeY + (uint32_t) y * volume->sizeX + (uint32_t) x;
+    blockLightUpdate(volume, workspace, x, y, z, level, volume->opacity[index]);
+}
+
+// Removes the light source at the voxel (keeps the opacity of the voxel).
+static void blockLightRemove(BlockLightVolume* volume, BlockLightWorkspace* workspace, int x, int y, int z)
+{
+    const uint32_t index = (uint32_t) z * volume->sizeX * volume->sizeY + (uint32_t) y * volume->sizeX + (uint32_t) x;
+    blockLightUpdate(volume, workspace, x, y, z, 0, volume->opacity[index]);
+}
+
+// Usage Example
+void testBlockLight()
+{
+    const int SIZE = 32;
+    const int COUNT = SIZE * SIZE * SIZE;
+
+    uint8_t emission[COUNT];
+    uint8_t opacity[COUNT];
+    uint8_t light[COUNT];
+    memset(&emission, 0, sizeof(emission));
+    memset(&opacity, 0, sizeof(opacity));
+
+    // a torch next to a stone wall (opaque) at x = 16 with a glass window (only a bit of opacity)
+    for (int i = 0; i < COUNT; i++)
+        opacity[i] = i % SIZE == 16 ? BLOCK_LIGHT_MAX : 0;
+    opacity[10 * SIZE * SIZE + 10 * SIZE + 16] = 2;
+    emission[10 * SIZE * SIZE + 10 * SIZE + 12] = 14;
+
+    blockLightRebuild(emission, opacity, light, SIZE, SIZE, SIZE);
+
+    // light[10 * SIZE * SIZE + 10 * SIZE + 13] is now 13 and the light that got through the window is dimmer
+
+    // the player places a second torch and later breaks the first one
+    uint32_t addQueue[COUNT], removeQueue[COUNT];
+    uint64_t queued[(COUNT + 63) / 64];
+    memset(&queued, 0, sizeof(queued));
+
+    BlockLightVolume volume = {light, emission, opacity, SIZE, SIZE, SIZE};
+    BlockLightWorkspace workspace = {addQueue, removeQueue, queued};
+
+    blockLightAdd(&volume, &workspace, 4, 4, 4, 15);
+    blockLightRemove(&volume, &workspace, 12, 10, 10);
+
+    // closing the window
+    blockLightUpdate(&volume, &workspace, 16, 10, 10, 0, BLOCK_LIGHT_MAX);
+}
+
+#endif //VOXELDEVSCRIPTS_BLOCKLIGHT_H
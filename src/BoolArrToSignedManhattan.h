@@ -0,0 +1,184 @@
+#ifndef VOXELDEVSCRIPTS_SIGNEDDISTANCEFIELD_H
+#define VOXELDEVSCRIPTS_SIGNEDDISTANCEFIELD_H
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "VoxelStats.h"
+
+/*
+ * Same as BoolArrToManhattan.h, but produces a signed Manhattan distance field:
+ *  -   "false" voxels (outside) contain the (positive) Manhattan distance to the closest "true" voxel.
+ *  -   "true" voxels (inside) contain the negated Manhattan distance to the closest "false" voxel.
+ * So the surface lies between the voxels with value 1 and -1, there are no zeros. This is useful for collision push-out
+ * (the value tells you how deep you are and the neighbours tell you where to go, see signedManhattanDFEscapeDirection)
+ * and for smooth surface extraction.
+ *
+ * Both distances are computed in one traversal of the same XPASS -> YPASS -> ZPASS structure and stored in one int8 field.
+ * This works because every voxel needs only one of the two distances, and the other one is 0 for it:
+ * the outside distance of an inside voxel is 0 and vice versa. So when we look at a neighbour's value n, its outside
+ * distance is max(n, 0) and its inside distance is max(-n, 0), and we can relax both distances in the same pass.
+ *
+ * The distances are clamped to 126 (so adding one never overflows an int8). Voxels outside of the array are not
+ * considered, neither as inside nor as outside.
+ *
+ * The complexity of this algorithm is O(n) for n elements in boolArray, just like the unsigned version.
+ */
+
+// cpmath.h defines a generic min() macro that handles ints as well, so we only need our own if it's not around
+// (or if another script of this repo already defined it)
+#if !defined(min) && !defined(VOXELDEVSCRIPTS_MIN)
+#define VOXELDEVSCRIPTS_MIN
+static inline int min(int d1, int d2)
+{
+    return d1 > d2 ? d2 : d1;
+}
+#endif
+
+// Relaxes the value v of a voxel against the already updated value n of its neighbour.
+// Outside voxels (v > 0) can be at most one further away from the surface than an outside neighbour (or 1 if the neighbour is inside),
+// and the same goes the other way round for inside voxels.
+static inline int8_t signedManhattanDFRelax(int8_t v, int8_t n)
+{
+    int8_t outside = (n > 0 ? n : 0) + 1;
+    int8_t inside = (n < 0 ? n : 0) - 1;
+
+    return v > 0 ? (outside < v ? outside : v) : (inside > v ? inside : v);
+}
+
+// relaxes every element of row against the corresponding element of prevRow, this loop vectorizes well
+static inline void signedManhattanDFRelaxRow(int8_t* restrict row, const int8_t* restrict prevRow, int sizeX)
+{
+    VOXEL_STATS_ONLY(uint32_t updates = 0;)
+    for (int x = 0; x < sizeX; x++)
+    {
+        const int8_t v = signedManhattanDFRelax(row[x], prevRow[x]);
+        VOXEL_STATS_ONLY(updates += v != row[x];)
+        row[x] = v;
+    }
+    VOXEL_STATS_UPDATES(updates);
+}
+
+static void boolArrToSignedManhattanDFXPASS(const bool* boolArr, int8_t* o_distanceField, int sizeX, int sizeY, int sizeZ)
+{
+    const int maxDistance = min(126, sizeX + sizeY + sizeZ);
+    VOXEL_STATS_BEGIN(VOXEL_STATS_SIGNED_DF_XPASS);
+
+    for (int z = 0; z < sizeZ; z++)
+        for (int y = 0; y < sizeY; y++)
+        {
+            const bool* boolRow = boolArr + z * sizeX * sizeY + y * sizeX;
+            int8_t* row = o_distanceField + z * sizeX * sizeY + y * sizeX;
+
+            // the first element has nothing to compare to, so it starts with "infinity" on its side of the surface
+            int d = boolRow[0] ? -maxDistance : maxDistance;
+            row[0] = d;
+
+            // we then count up (or down) while staying on the same side, and restart at 1 (or -1) when crossing the surface
+            for (int x = 1; x < sizeX; x++)
+            {
+                if (boolRow[x])
+                    d = d < 0 ? (d - 1 < -maxDistance ? -maxDistance : d - 1) : -1;
+                else
+                    d = d > 0 ? min(maxDistance, d + 1) : 1;
+                row[x] = d;
+            }
+
+            // and once more in opposite direction
+            for (int x = sizeX - 2; x >= 0; x--)
+                row[x] = signedManhattanDFRelax(row[x], row[x + 1]);
+        }
+
+    VOXEL_STATS_END(VOXEL_STATS_SIGNED_DF_XPASS, (uint64_t) sizeX * sizeY * sizeZ, 2ull * sizeX * sizeY * sizeZ);
+}
+
+static void boolArrToSignedManhattanDFYPASS(int8_t* o_distanceField, int sizeX, int sizeY, int sizeZ)
+{
+    VOXEL_STATS_BEGIN(VOXEL_STATS_SIGNED_DF_YPASS);
+
+    for (int z = 0; z < sizeZ; z++)
+    {
+        int8_t* plane = o_distanceField + z * sizeX * sizeY;
+
+        // like in the unsigned version, we move whole rows along y to process all columns of the plane at once
+        for (int y = 1; y < sizeY; y++)
+            signedManhattanDFRelaxRow(plane + y * sizeX, plane + (y - 1) * sizeX, sizeX);
+
+        for (int y = sizeY - 2; y >= 0; y--)
+            signedManhattanDFRelaxRow(plane + y * sizeX, plane + (y + 1) * sizeX, sizeX);
+    }
+
+    VOXEL_STATS_END(VOXEL_STATS_SIGNED_DF_YPASS, (uint64_t) sizeX * sizeY * sizeZ, 2ull * sizeX * sizeY * sizeZ);
+}
+
+static void boolArrToSignedManhattanDFZPASS(int8_t* o_distanceField, int sizeX, int sizeY, int sizeZ)
+{
+    const int planeSize = sizeX * sizeY;
+    VOXEL_STATS_BEGIN(VOXEL_STATS_SIGNED_DF_ZPASS);
+
+    // planes are contiguous, so we can relax a whole plane against its neighbour as if it were a single row
+    for (int z = 1; z < sizeZ; z++)
+        signedManhattanDFRelaxRow(o_distanceField + z * planeSize, o_distanceField + (z - 1) * planeSize, planeSize);
+
+    for (int z = sizeZ - 2; z >= 0; z--)
+        signedManhattanDFRelaxRow(o_distanceField + z * planeSize, o_distanceField + (z + 1) * planeSize, planeSize);
+
+    VOXEL_STATS_END(VOXEL_STATS_SIGNED_DF_ZPASS, (uint64_t) sizeX * sizeY * sizeZ, 2ull * sizeX * sizeY * sizeZ);
+}
+
+// Just like the unsigned version, the order of the passes is fixed and only the first pass requires the bool array
+static void boolArrToSignedManhattanDF(const bool* boolArr, int8_t* o_distanceField, int sizeX, int sizeY, int sizeZ)
+{
+    boolArrToSignedManhattanDFXPASS(boolArr, o_distanceField, sizeX, sizeY, sizeZ);
+    boolArrToSignedManhattanDFYPASS(o_distanceField, sizeX, sizeY, sizeZ);
+    boolArrToSignedManhattanDFZPASS(o_distanceField, sizeX, sizeY, sizeZ);
+}
+
+// Returns the direction (0: -x, 1: +x, 2: -y, 3: +y, 4: -z, 5: +z) to the neighbour with the largest value, or -1 if
+// no neighbour is larger than the voxel itself. For an inside voxel with value -d, following this direction d times
+// leads to the closest outside voxel, so a penetrating object can be pushed out with a single lookup per step.
+static int signedManhattanDFEscapeDirection(const int8_t* distanceField, int sizeX, int sizeY, int sizeZ, int x, int y, int z)
+{
+    const int index = z * sizeX * sizeY + y * sizeX + x;
+    int best = distanceField[index];
+    int direction = -1;
+
+    if (x > 0 && distanceField[index - 1] > best)
+        best = distanceField[index - 1], direction = 0;
+    if (x < sizeX - 1 && distanceField[index + 1] > best)
+        best = distanceField[index + 1], direction = 1;
+    if (y > 0 && distanceField[index - sizeX] > best)
+        best = distanceField[index - sizeX], direction = 2;
+    if (y < sizeY - 1 && distanceField[index + sizeX] > best)
+        best = distanceField[index + sizeX], direction = 3;
+    if (z > 0 && distanceField[index - sizeX * sizeY] > best)
+        best = distanceField[index - sizeX * sizeY], direction = 4;
+    if (z < sizeZ - 1 && distanceField[index + sizeX * sizeY] > best)
+        direction = 5;
+
+    return direction;
+}
+
+// Usage Example
+void testBoolArrToSignedManhattan()
+{
+    const int SIZE = 64;
+
+    bool boolArr[SIZE * SIZE * SIZE];
+    memset(&boolArr, 0, SIZE * SIZE * SIZE * sizeof(bool));
+
+    // a solid floor, 8 voxels thick
+    memset(&boolArr, 1, 8 * SIZE * SIZE * sizeof(bool));
+
+    int8_t distanceField[SIZE * SIZE * SIZE];
+
+    boolArrToSignedManhattanDF(boolArr, distanceField, SIZE, SIZE, SIZE);
+
+    // distanceField[2 * SIZE * SIZE] is now -6 (6 voxels below the surface of the floor), distanceField[10 * SIZE * SIZE] is 3.
+    // escaping from inside the floor means going up (+z):
+    int direction = signedManhattanDFEscapeDirection(distanceField, SIZE, SIZE, SIZE, 5, 5, 2);
+    (void) direction; // == 5
+}
+
+#endif //VOXELDEVSCRIPTS_SIGNEDDISTANCEFIELD_H
@@ -0,0 +1,367 @@
+#ifndef VOXELDEVSCRIPTS_CONNECTEDCOMPONENTS_H
+#define VOXELDEVSCRIPTS_CONNECTEDCOMPONENTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "VoxelStats.h"
+
+/*
+ * Labels the connected regions of empty space (false in the bool array, 6-connected) of a flattened 3D bool array, e.g. to
+ * find caves, enclosed rooms or the volumes a fluid simulation can flood. Every empty voxel gets the label of its region
+ * (1 to count), solid voxels get 0. Labels are numbered in order of the first voxel (flattened index) of each region.
+ * Per region, the voxel count, the bounding box and whether it touches the border of the volume (regions that don't are
+ * enclosed) are collected as well.
+ *
+ * This is a union find over the voxels, with the label array as the parent array: while labelling, the label of a voxel
+ * is the flattened index + 1 of its parent, roots point to themselves. Parents always have smaller indices than their
+ * children. The volume is split into slabs of planes along z, one per thread, and it goes in phases:
+ *  1.  every thread labels its slab: a voxel is joined with its -x, -y and -z neighbours inside of the slab. A voxel
+ *      whose -x neighbour is empty simply takes its parent, and the -y (-z) neighbour only needs to be joined if the
+ *      diagonal voxel between them isn't empty (otherwise they are already in the same set), so in open space most
+ *      voxels cost a single copy.
+ *  2.  the calling thread joins the first plane of every slab with the last plane of the slab before it.
+ *  3.  every thread points its voxels directly to their roots and counts the roots in its slab.
+ *  4.  from the root counts, every slab knows the first label of its roots, roots are replaced with their final labels
+ *      (marked with the top bit, so the next phase can tell them apart).
+ *  5.  the other voxels take the final label of their root, the marks are removed and the statistics are collected
+ *      (runs of voxels with the same label are added at once).
+ * Every phase is linear, the only serial part is phase 2 with one plane per slab. Phases 3 and 5 read roots of other
+ * slabs while their threads rewrite them, which is fine: in phase 3 every value a find can see is an ancestor of the
+ * voxel, in phase 5 the root's label is the same with or without the mark. Those accesses are relaxed atomics, so this
+ * is not a data race.
+ *
+ * Labels need the top bit, so volumes are limited to 2^31 - 1 voxels.
+ */
+
+#define CONNECTED_COMPONENTS_ROOT_MARK 0x80000000u
+
+// Below this many voxels per thread, starting a thread costs more than it saves.
+#define CONNECTED_COMPONENTS_VOXELS_PER_THREAD (1 << 16)
+
+typedef struct ConnectedComponent
+{
+    uint32_t voxelCount;
+    int minX, minY, minZ;
+    int maxX, maxY, maxZ;       // inclusive
+    bool touchesBorder;         // false if the region is enclosed by solid voxels
+} ConnectedComponent;
+
+// root of voxel i, with path halving. Only for voxels of the caller's own slab (phase 1) or while no other thread runs.
+static inline uint32_t connectedComponentsFind(uint32_t* labels, uint32_t i)
+{
+    while (labels[i] != i + 1)
+    {
+        labels[i] = labels[labels[i] - 1];
+        i = labels[i] - 1;
+    }
+    return i;
+}
+
+static inline void connectedComponentsUnion(uint32_t* labels, uint32_t a, uint32_t b)
+{
+    a = connectedComponentsFind(labels, a);
+    b = connectedComponentsFind(labels, b);
+    if (a < b)
+        labels[b] = a + 1;
+    else if (b < a)
+        labels[a] = b + 1;
+}
+
+static inline void connectedComponentsAtomicMin(int* p, int v)
+{
+    int current = __atomic_load_n(p, __ATOMIC_RELAXED);
+    while (v < current && !__atomic_compare_exchange_n(p, &current, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static inline void connectedComponentsAtomicMax(int* p, int v)
+{
+    int current = __atomic_load_n(p, __ATOMIC_RELAXED);
+    while (v > current && !__atomic_compare_exchange_n(p, &current, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+typedef struct ConnectedComponentsJob
+{
+    const bool* boolArr;
+    uint32_t* labels;
+    ConnectedComponent* components;
+    uint32_t componentCapacity;
+    int sizeX, sizeY, sizeZ;
+    int phase;
+} ConnectedComponentsJob;
+
+typedef struct ConnectedComponentsSlab
+{
+    ConnectedComponentsJob* job;
+    int zBegin, zEnd;
+    uint32_t rootCount;
+    uint32_t firstLabel;
+} ConnectedComponentsSlab;
+
+// phase 1
+static void connectedComponentsLabelSlab(const ConnectedComponentsJob* job, const ConnectedComponentsSlab* slab)
+{
+    const bool* boolArr = job->boolArr;
+    uint32_t* labels = job->labels;
+    const int sizeX = job->sizeX, sizeY = job->sizeY;
+    const uint32_t planeSize = (uint32_t) sizeX * sizeY;
+
+    for (int z = slab->zBegin; z < slab->zEnd; z++)
+        for (int y = 0; y < sizeY; y++)
+        {
+            const uint32_t rowStart = (uint32_t) z * planeSize + (uint32_t) y * sizeX;
+            const bool hasBack = z > slab->zBegin;
+            bool left = false;
+            // the label of the previous voxel, kept in a register so the copies don't wait for the previous store
+            uint32_t label = 0;
+
+            for (int x = 0; x < sizeX; x++)
+            {
+                const uint32_t i = rowStart + x;
+                if (boolArr[i])
+                {
+                    labels[i] = 0;
+                    left = false;
+                    continue;
+                }
+
+                label = left ? label : i + 1;
+                labels[i] = label;
+
+                const bool joinUp = y > 0 && !boolArr[i - sizeX] && !(left && !boolArr[i - sizeX - 1]);
+                const bool joinBack = hasBack && !boolArr[i - planeSize] && !(left && !boolArr[i - planeSize - 1]);
+                if (joinUp)
+                    connectedComponentsUnion(labels, i, i - sizeX);
+                if (joinBack)
+                    connectedComponentsUnion(labels, i, i - planeSize);
+                if (joinUp || joinBack)
+                    label = labels[i];
+
+                left = true;
+            }
+        }
+}
+
+// phase 3
+static void connectedComponentsFlattenSlab(const ConnectedComponentsJob* job, ConnectedComponentsSlab* slab)
+{
+    uint32_t* labels = job->labels;
+    const uint32_t planeSize = (uint32_t) job->sizeX * job->sizeY;
+    uint32_t rootCount = 0;
+
+    for (uint32_t i = slab->zBegin * planeSize; i < slab->zEnd * planeSize; i++)
+    {
+        if (labels[i] == 0)
+            continue;
+
+        uint32_t root = i, parent;
+        while ((parent = __atomic_load_n(labels + root, __ATOMIC_RELAXED)) != root + 1)
+            root = parent - 1;
+
+        if (root == i)
+            rootCount++;
+        else
+            __atomic_store_n(labels + i, root + 1, __ATOMIC_RELAXED);
+    }
+
+    slab->rootCount = rootCount;
+}
+
+// adds x in [xBegin, xEnd] of row (y, z) to component
+static inline void connectedComponentsAddRun(ConnectedComponent* component, const ConnectedComponentsJob* job, int xBegin, int xEnd, int y, int z)
+{
+    __atomic_fetch_add(&component->voxelCount, (uint32_t) (xEnd - xBegin + 1), __ATOMIC_RELAXED);
+    connectedComponentsAtomicMin(&component->minX, xBegin);
+    connectedComponentsAtomicMax(&component->maxX, xEnd);
+    connectedComponentsAtomicMin(&component->minY, y);
+    connectedComponentsAtomicMax(&component->maxY, y);
+    connectedComponentsAtomicMin(&component->minZ, z);
+    connectedComponentsAtomicMax(&component->maxZ, z);
+
+    if (xBegin == 0 || xEnd == job->sizeX - 1 || y == 0 || y == job->sizeY - 1 || z == 0 || z == job->sizeZ - 1)
+        __atomic_store_n(&component->touchesBorder, true, __ATOMIC_RELAXED);
+}
+
+// phase 5
+static void connectedComponentsFinishSlab(const ConnectedComponentsJob* job, const ConnectedComponentsSlab* slab)
+{
+    uint32_t* labels = job->labels;
+    const int sizeX = job->sizeX, sizeY = job->sizeY;
+    const uint32_t planeSize = (uint32_t) sizeX * sizeY;
+
+    for (int z = slab->zBegin; z < slab->zEnd; z++)
+        for (int y = 0; y < sizeY; y++)
+        {
+            const uint32_t rowStart = (uint32_t) z * planeSize + (uint32_t) y * sizeX;
+            uint32_t* row = labels + rowStart;
+
+            // roots come before the voxels pointing to them, so a root of this slab is unmarked before it's read here
+            for (int x = 0; x < sizeX; x++)
+            {
+                const uint32_t l = row[x];
+                if (l & CONNECTED_COMPONENTS_ROOT_MARK)
+                    __atomic_store_n(row + x, l & ~CONNECTED_COMPONENTS_ROOT_MARK, __ATOMIC_RELAXED);
+                else if (l != 0)
+                    row[x] = __atomic_load_n(labels + l - 1, __ATOMIC_RELAXED) & ~CONNECTED_COMPONENTS_ROOT_MARK;
+            }
+
+            if (!job->components)
+                continue;
+
+            for (int x = 0; x < sizeX;)
+            {
+                const uint32_t label = row[x];
+                int end = x;
+                while (end + 1 < sizeX && row[end + 1] == label)
+                    end++;
+
+                if (label != 0 && label <= job->componentCapacity)
+                    connectedComponentsAddRun(job->components + label - 1, job, x, end, y, z);
+                x = end + 1;
+            }
+        }
+}
+
+static void* connectedComponentsWorker(void* arg)
+{
+    ConnectedComponentsSlab* slab = arg;
+    const ConnectedComponentsJob* job = slab->job;
+    uint32_t* labels = job->labels;
+    const uint32_t planeSize = (uint32_t) job->sizeX * job->sizeY;
+    const uint32_t begin = slab->zBegin * planeSize, end = slab->zEnd * planeSize;
+
+    switch (job->phase)
+    {
+        case 1:
+            connectedComponentsLabelSlab(job, slab);
+            break;
+        case 3:
+            connectedComponentsFlattenSlab(job, slab);
+            break;
+        case 4:
+        {
+            // roots of earlier slabs have smaller indices, so they got the smaller labels. Nothing reads other slabs here.
+            uint32_t label = slab->firstLabel;
+            for (uint32_t i = begin; i < end; i++)
+                if (labels[i] == i + 1)
+                    labels[i] = CONNECTED_COMPONENTS_ROOT_MARK | label++;
+            break;
+        }
+        case 5:
+            connectedComponentsFinishSlab(job, slab);
+            break;
+        default:
+            break;
+    }
+
+    return NULL;
+}
+
+// runs the current phase of the job on every slab, the calling thread takes the first one
+static void connectedComponentsRunPhase(ConnectedComponentsJob* job, ConnectedComponentsSlab* slabs, int slabCount, int phase)
+{
+    pthread_t threads[slabCount];
+    int started = 0;
+    job->phase = phase;
+
+    for (int i = 1; i < slabCount; i++)
+        if (pthread_create(&threads[started], NULL, connectedComponentsWorker, &slabs[i]) == 0)
+            started++;
+        else
+            connectedComponentsWorker(&slabs[i]);
+
+    connectedComponentsWorker(&slabs[0]);
+
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+}
+
+// Labels the empty regions of boolArr (true is solid) into o_labels (sizeX * sizeY * sizeZ labels) and returns the number
+// of regions. If o_components is not NULL, the statistics of the regions with labels 1 to componentCapacity are written
+// to o_components[label - 1]. threadCount <= 0 uses one thread per online CPU (large volumes only).
+static uint32_t connectedComponentsLabel(const bool* boolArr, uint32_t* o_labels, ConnectedComponent* o_components, uint32_t componentCapacity,
+                                         int sizeX, int sizeY, int sizeZ, int threadCount)
+{
+    const uint64_t count = (uint64_t) sizeX * sizeY * sizeZ;
+    const uint32_t planeSize = (uint32_t) sizeX * sizeY;
+    VOXEL_STATS_BEGIN(VOXEL_STATS_CONNECTED_COMPONENTS);
+
+    if (threadCount <= 0)
+        threadCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadCount > (int) (count / CONNECTED_COMPONENTS_VOXELS_PER_THREAD))
+        threadCount = (int) (count / CONNECTED_COMPONENTS_VOXELS_PER_THREAD);
+    if (threadCount > sizeZ)
+        threadCount = sizeZ;
+    if (threadCount < 1)
+        threadCount = 1;
+
+    ConnectedComponentsJob job = {.boolArr = boolArr, .labels = o_labels, .components = o_components,
+                                  .componentCapacity = o_components ? componentCapacity : 0, .sizeX = sizeX, .sizeY = sizeY, .sizeZ = sizeZ};
+    ConnectedComponentsSlab slabs[threadCount];
+    for (int i = 0; i < threadCount; i++)
+        slabs[i] = (ConnectedComponentsSlab) {.job = &job, .zBegin = sizeZ * i / threadCount, .zEnd = sizeZ * (i + 1) / threadCount};
+
+    connectedComponentsRunPhase(&job, slabs, threadCount, 1);
+
+    // phase 2: the slab borders. Same rule as in phase 1, if the voxels to the left are joined already, so are these.
+    for (int s = 1; s < threadCount; s++)
+    {
+        const uint32_t planeStart = slabs[s].zBegin * planeSize;
+        for (uint32_t i = planeStart; i < planeStart + planeSize; i++)
+        {
+            const bool left = i % sizeX != 0 && !boolArr[i - 1] && !boolArr[i - 1 - planeSize];
+            if (!boolArr[i] && !boolArr[i - planeSize] && !left)
+                connectedComponentsUnion(o_labels, i, i - planeSize);
+        }
+    }
+
+    connectedComponentsRunPhase(&job, slabs, threadCount, 3);
+
+    uint32_t componentCount = 0;
+    for (int i = 0; i < threadCount; i++)
+    {
+        slabs[i].firstLabel = componentCount + 1;
+        componentCount += slabs[i].rootCount;
+    }
+
+    connectedComponentsRunPhase(&job, slabs, threadCount, 4);
+
+    if (o_components)
+    {
+        const uint32_t n = componentCount < componentCapacity ? componentCount : componentCapacity;
+        for (uint32_t i = 0; i < n; i++)
+            o_components[i] = (ConnectedComponent) {0, sizeX, sizeY, sizeZ, -1, -1, -1, false};
+    }
+
+    connectedComponentsRunPhase(&job, slabs, threadCount, 5);
+
+    // reads the bools, the labels are written once, read and written in phases 3 and 5 and read in phase 4
+    VOXEL_STATS_END(VOXEL_STATS_CONNECTED_COMPONENTS, count, 25 * count);
+    return componentCount;
+}
+
+// Usage Example
+void testConnectedComponents()
+{
+    const int SIZE = 32;
+
+    // a hollow box (walls 1 voxel thick) in an empty volume: the air inside of it is enclosed
+    static bool boolArr[32 * 32 * 32];
+    for (int z = 8; z < 24; z++)
+        for (int y = 8; y < 24; y++)
+            for (int x = 8; x < 24; x++)
+                boolArr[z * SIZE * SIZE + y * SIZE + x] = x == 8 || x == 23 || y == 8 || y == 23 || z == 8 || z == 23;
+
+    static uint32_t labels[32 * 32 * 32];
+    ConnectedComponent components[16];
+    const uint32_t count = connectedComponentsLabel(boolArr, labels, components, 16, SIZE, SIZE, SIZE, 0);
+
+    // count == 2: label 1 is the air around the box (voxel 0 comes first), label 2 the 14^3 voxels inside of it,
+    // components[1].touchesBorder is false
+    (void) count;
+}
+
+#endif //VOXELDEVSCRIPTS_CONNECTEDCOMPONENTS_H
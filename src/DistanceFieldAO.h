@@ -0,0 +1,313 @@
+#ifndef VOXELDEVSCRIPTS_DISTANCEFIELDAO_H
+#define VOXELDEVSCRIPTS_DISTANCEFIELDAO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+#include "BoolArrToManhattan.h"
+
+/*
+ * Ambient occlusion from the Manhattan distance field of BoolArrToManhattan.h (distance field AO).
+ *
+ * Instead of casting rays, we look at the distance field at a few points along a couple of directions around each voxel.
+ * If the sample at (Manhattan) distance d from the voxel has a value of at least d, there's nothing between the voxel and
+ * the sample point (at least nothing closer to the sample than the voxel), so that direction is open up to d. If the value
+ * is smaller, some geometry is closer than d and the direction is occluded by (d - value) / d.
+ * The openness of all samples is averaged, so every voxel gets a value from 0 (completely enclosed) to 255 (nothing around
+ * it within the sampled distance). Solid voxels get 0.
+ *
+ * The samples are taken at distances 1, 2, 4, ... (params.steps of them) along the 6 axis directions and optionally along
+ * the 8 diagonals as well. Samples outside of the volume count as open.
+ *
+ * Because every voxel of a row uses the same offsets, the samples of a whole row are a contiguous range of the field.
+ * So we accumulate sample by sample over whole rows with SIMD (16 voxels per instruction with AVX2, 8 with SSE2), using
+ * 16 bit fixed point sums.
+ * This replaces the thousands of ray steps per voxel with 6 * steps (or 14 * steps) lookups.
+ *
+ * For meshing, distanceFieldAOVertex averages the AO of the 4 voxels around a vertex on the outer side of a face.
+ * distanceFieldAOChunks processes many chunks in parallel.
+ *
+ * The complexity is O(n * directions * steps) for n voxels, independent of the geometry.
+ */
+
+typedef struct DistanceFieldAOParams
+{
+    int steps;          // samples per direction, at distances 1, 2, 4, ..., 2^(steps - 1) (1 to 6)
+    bool diagonals;     // sample the 8 diagonal directions in addition to the 6 axis directions
+} DistanceFieldAOParams;
+
+typedef struct DistanceFieldAOSample
+{
+    int dx;
+    int dy;
+    int dz;
+    uint32_t cap;       // Manhattan distance of the offset, the openness of the sample is min(value, cap) / cap
+    uint16_t weight;    // 512 / cap, so every sample contributes about 512 when it's completely open (84 * 512 fits in 16 bit)
+} DistanceFieldAOSample;
+
+#define DISTANCE_FIELD_AO_MAX_SAMPLES (14 * 6)
+
+static int distanceFieldAOSamples(const DistanceFieldAOParams* params, DistanceFieldAOSample* o_samples)
+{
+    static const int DIRECTIONS[14][3] = {
+        {-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1},
+        {-1, -1, -1}, {1, -1, -1}, {-1, 1, -1}, {1, 1, -1}, {-1, -1, 1}, {1, -1, 1}, {-1, 1, 1}, {1, 1, 1}
+    };
+    const int directionCount = params->diagonals ? 14 : 6;
+    const int steps = params->steps < 1 ? 1 : params->steps > 6 ? 6 : params->steps;
+    int count = 0;
+
+    for (int d = 0; d < directionCount; d++)
+        for (int s = 0; s < steps; s++)
+        {
+            // the diagonals are taken at the same number of steps per axis, so their samples are 3 times as far away
+            const int distance = 1 << s;
+            DistanceFieldAOSample sample = {
+                DIRECTIONS[d][0] * distance, DIRECTIONS[d][1] * distance, DIRECTIONS[d][2] * distance,
+                (uint32_t) (d < 6 ? distance : 3 * distance), 0
+            };
+            sample.weight = (uint16_t) (512 / sample.cap);
+            o_samples[count++] = sample;
+        }
+
+    return count;
+}
+
+// Adds the weighted openness of one sample to every voxel of a row. src points at the sample of voxel begin of the row
+// (the one of voxel 0 may be outside of the volume), the samples of [begin, end) are read, the voxels outside of that
+// range sample outside of the volume and are open.
+static inline void distanceFieldAOAccumulateRow(uint16_t* restrict acc, const uint8_t* restrict src, int begin, int end, int sizeX,
+                                                uint32_t cap, uint16_t weight)
+{
+    const uint16_t open = (uint16_t) (cap * weight);
+    int x = 0;
+
+    for (; x < begin; x++)
+        acc[x] += open;
+
+#ifdef __SSE2__
+#ifdef __AVX2__
+    const __m256i cap32 = _mm256_set1_epi16((short) cap);
+    const __m256i weight32 = _mm256_set1_epi16((short) weight);
+    for (; x + 16 <= end; x += 16)
+    {
+        // cap is below 256, so min on the 16 bit lanes gives the same result as on the bytes
+        __m256i samples = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (src + (x - begin))));
+        __m256i contribution = _mm256_mullo_epi16(_mm256_min_epu16(samples, cap32), weight32);
+        _mm256_storeu_si256((__m256i*) (acc + x), _mm256_add_epi16(_mm256_loadu_si256((const __m256i*) (acc + x)), contribution));
+    }
+#endif
+    const __m128i cap16 = _mm_set1_epi8((char) cap);
+    const __m128i weight16 = _mm_set1_epi16((short) weight);
+    for (; x + 8 <= end; x += 8)
+    {
+        __m128i samples = _mm_unpacklo_epi8(_mm_min_epu8(_mm_loadl_epi64((const __m128i*) (src + (x - begin))), cap16), _mm_setzero_si128());
+        __m128i contribution = _mm_mullo_epi16(samples, weight16);
+        _mm_storeu_si128((__m128i*) (acc + x), _mm_add_epi16(_mm_loadu_si128((const __m128i*) (acc + x)), contribution));
+    }
+#endif
+    for (; x < end; x++)
+    {
+        const uint8_t sample = src[x - begin];
+        acc[x] += (uint16_t) ((sample < cap ? sample : cap) * weight);
+    }
+
+    for (; x < sizeX; x++)
+        acc[x] += open;
+}
+
+// Writes the AO (0 to 255) of the z-slices [beginZ, endZ) of the volume to o_ao.
+static void distanceFieldAOSlices(const uint8_t* distanceField, uint8_t* o_ao, int sizeX, int sizeY, int sizeZ,
+                                  const DistanceFieldAOParams* params, int beginZ, int endZ)
+{
+    DistanceFieldAOSample samples[DISTANCE_FIELD_AO_MAX_SAMPLES];
+    const int sampleCount = distanceFieldAOSamples(params, samples);
+
+    // maps the sum of all samples to 0 - 255 with a multiplication in 16.16 fixed point
+    uint32_t maxSum = 0;
+    for (int i = 0; i < sampleCount; i++)
+        maxSum += samples[i].cap * samples[i].weight;
+    const uint32_t scale = (uint32_t) ((255ull << 16) / maxSum);
+
+    uint16_t acc[sizeX];
+
+    for (int z = beginZ; z < endZ; z++)
+        for (int y = 0; y < sizeY; y++)
+        {
+            const uint64_t rowIndex = (uint64_t) z * sizeX * sizeY + (uint64_t) y * sizeX;
+            uint32_t open = 0;
+            memset(acc, 0, sizeof(acc));
+
+            for (int i = 0; i < sampleCount; i++)
+            {
+                const DistanceFieldAOSample s = samples[i];
+                const int sy = y + s.dy, sz = z + s.dz;
+
+                // the whole row samples outside of the volume
+                if (sy < 0 || sy >= sizeY || sz < 0 || sz >= sizeZ || s.dx >= sizeX || -s.dx >= sizeX)
+                {
+                    open += s.cap * s.weight;
+                    continue;
+                }
+
+                const int begin = s.dx < 0 ? -s.dx : 0;
+                const int end = s.dx > 0 ? sizeX - s.dx : sizeX;
+                // begin + s.dx >= 0, so the pointer stays inside of the volume
+                const uint8_t* src = distanceField + (uint64_t) sz * sizeX * sizeY + (uint64_t) sy * sizeX + (begin + s.dx);
+                distanceFieldAOAccumulateRow(acc, src, begin, end, sizeX, s.cap, s.weight);
+            }
+
+            const uint8_t* row = distanceField + rowIndex;
+            uint8_t* aoRow = o_ao + rowIndex;
+            for (int x = 0; x < sizeX; x++)
+                aoRow[x] = row[x] == 0 ? 0 : (uint8_t) (((acc[x] + open) * scale) >> 16);
+        }
+}
+
+// Computes the AO of every voxel of the distance field.
+static void distanceFieldAO(const uint8_t* distanceField, uint8_t* o_ao, int sizeX, int sizeY, int sizeZ, const DistanceFieldAOParams* params)
+{
+    VOXEL_STATS_BEGIN(VOXEL_STATS_AO);
+    distanceFieldAOSlices(distanceField, o_ao, sizeX, sizeY, sizeZ, params, 0, sizeZ);
+    VOXEL_STATS_END(VOXEL_STATS_AO, (uint64_t) sizeX * sizeY * sizeZ, 2ull * sizeX * sizeY * sizeZ);
+}
+
+// Returns the AO of the vertex at grid corner (x, y, z) (0 to size inclusive) of a face pointing in direction face
+// (0: -x, 1: +x, 2: -y, 3: +y, 4: -z, 5: +z): the average of the 4 voxels touching the vertex in front of the face.
+// Solid voxels and voxels outside of the volume are skipped, if all 4 are, the result is 0.
+static inline uint8_t distanceFieldAOVertex(const uint8_t* ao, const uint8_t* distanceField, int sizeX, int sizeY, int sizeZ,
+                                            int x, int y, int z, int face)
+{
+    const int axis = face >> 1;
+    const int u = axis == 0 ? 1 : 0, v = axis == 2 ? 1 : 2;
+    int corner[3] = {x, y, z};
+    const int size[3] = {sizeX, sizeY, sizeZ};
+
+    // the voxels in front of the face lie at corner - 1 (negative face) or corner (positive face) along the axis
+    corner[axis] -= (face & 1) ? 0 : 1;
+    if (corner[axis] < 0 || corner[axis] >= size[axis])
+        return 0;
+
+    uint32_t sum = 0, count = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int p[3] = {corner[0], corner[1], corner[2]};
+        p[u] -= i & 1;
+        p[v] -= i >> 1;
+        if (p[u] < 0 || p[u] >= size[u] || p[v] < 0 || p[v] >= size[v])
+            continue;
+
+        const uint64_t index = (uint64_t) p[2] * sizeX * sizeY + (uint64_t) p[1] * sizeX + p[0];
+        if (distanceField[index] != 0)
+        {
+            sum += ao[index];
+            count++;
+        }
+    }
+
+    return count ? (uint8_t) (sum / count) : 0;
+}
+
+/**
+ * Chunk driver
+ */
+
+typedef struct DistanceFieldAOChunk
+{
+    const uint8_t* distanceField;
+    uint8_t* o_ao;
+} DistanceFieldAOChunk;
+
+typedef struct DistanceFieldAOJob
+{
+    DistanceFieldAOChunk* chunks;
+    int chunkCount;
+    int sizeX, sizeY, sizeZ;
+    const DistanceFieldAOParams* params;
+    VoxelStats* stats;      // of the calling thread, the workers record into it as well
+    atomic_int nextChunk;
+} DistanceFieldAOJob;
+
+static void* distanceFieldAOWorker(void* arg)
+{
+    DistanceFieldAOJob* job = arg;
+    VoxelStats* previousStats = voxelStatsBind(job->stats);
+
+    // chunks are handed out one at a time, so threads that got cheap chunks (or started late) simply take more of them
+    for (int i = atomic_fetch_add(&job->nextChunk, 1); i < job->chunkCount; i = atomic_fetch_add(&job->nextChunk, 1))
+        distanceFieldAO(job->chunks[i].distanceField, job->chunks[i].o_ao, job->sizeX, job->sizeY, job->sizeZ, job->params);
+
+    voxelStatsBind(previousStats);
+    return NULL;
+}
+
+// Computes the AO of chunkCount chunks of the same size on threadCount threads (including the calling one).
+// threadCount <= 0 uses one thread per online CPU.
+static void distanceFieldAOChunks(DistanceFieldAOChunk* chunks, int chunkCount, int sizeX, int sizeY, int sizeZ,
+                                  const DistanceFieldAOParams* params, int threadCount)
+{
+    if (threadCount <= 0)
+        threadCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadCount > chunkCount)
+        threadCount = chunkCount;
+    if (threadCount < 1)
+        threadCount = 1;
+
+    VOXEL_STATS_BEGIN(VOXEL_STATS_AO_CHUNKS);
+    DistanceFieldAOJob job = {.chunks = chunks, .chunkCount = chunkCount, .sizeX = sizeX, .sizeY = sizeY, .sizeZ = sizeZ,
+                              .params = params, .stats = voxelStatsGetCurrent()};
+    atomic_init(&job.nextChunk, 0);
+
+    pthread_t threads[threadCount];
+    int started = 0;
+    for (; started < threadCount - 1; started++)
+        if (pthread_create(&threads[started], NULL, distanceFieldAOWorker, &job) != 0)
+            break; // the remaining threads do the work anyway
+
+    distanceFieldAOWorker(&job);
+
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    VOXEL_STATS_END(VOXEL_STATS_AO_CHUNKS, (uint64_t) chunkCount * sizeX * sizeY * sizeZ, 2ull * chunkCount * sizeX * sizeY * sizeZ);
+}
+
+// Usage Example
+void testDistanceFieldAO()
+{
+    const int SIZE = 32;
+
+    bool boolArr[SIZE * SIZE * SIZE];
+    memset(&boolArr, 0, SIZE * SIZE * SIZE * sizeof(bool));
+
+    // a floor with a pillar on it, the voxels at the foot of the pillar should come out darker than the ones in the open
+    memset(&boolArr, 1, 4 * SIZE * SIZE * sizeof(bool));
+    for (int z = 4; z < 20; z++)
+        boolArr[z * SIZE * SIZE + 16 * SIZE + 16] = true;
+
+    uint8_t distanceField[SIZE * SIZE * SIZE];
+    uint8_t ao[SIZE * SIZE * SIZE];
+
+    boolArrToManhattanDF(boolArr, distanceField, SIZE, SIZE, SIZE);
+
+    DistanceFieldAOParams params = {.steps = 4, .diagonals = true};
+    distanceFieldAO(distanceField, ao, SIZE, SIZE, SIZE, &params);
+
+    // AO of a vertex at the foot of the pillar, on the top face (+z) of the floor
+    uint8_t vertexAO = distanceFieldAOVertex(ao, distanceField, SIZE, SIZE, SIZE, 16, 16, 4, 5);
+    (void) vertexAO;
+
+    // many chunks at once (all of them the same here)
+    uint8_t ao2[SIZE * SIZE * SIZE];
+    DistanceFieldAOChunk chunks[2] = {{distanceField, ao}, {distanceField, ao2}};
+    distanceFieldAOChunks(chunks, 2, SIZE, SIZE, SIZE, &params, 0);
+}
+
+#endif //VOXELDEVSCRIPTS_DISTANCEFIELDAO_H
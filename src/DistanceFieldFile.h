@@ -0,0 +1,562 @@
+#ifndef VOXELDEVSCRIPTS_DISTANCEFIELDFILE_H
+#define VOXELDEVSCRIPTS_DISTANCEFIELDFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "BoolArrToManhattan.h"
+
+/*
+ * A binary container for baked distance fields (BoolArrToManhattan.h, BoolArrToSignedManhattan.h, OctantDistanceField.h),
+ * made to be loaded with mmap: there is nothing to parse, a loaded file is the header plus pointers into the mapping.
+ * Loading a pre-baked region costs a few page faults instead of recomputing its fields.
+ *
+ * Layout (little endian: the header, the brick table and the data are the structs and arrays as they are in memory,
+ * nothing is byte swapped, so only little endian hosts are supported, which is checked at compile time):
+ *  -   the header (DistanceFieldFileHeader, 128 bytes): magic, version, dimensions, layout, metric, compression, offsets
+ *      and a checksum of the whole file
+ *  -   the brick table (compressed files only): one DistanceFieldFileBrick per brick
+ *  -   the data, starting at a page boundary (DISTANCE_FIELD_FILE_ALIGNMENT). Uncompressed, these are the fields themselves,
+ *      one after the other (channel c starts at c * sizeX * sizeY * sizeZ), so file.fields can be used like any other field.
+ *
+ * Compression splits every channel into bricks of 8^3 voxels (x fastest, bricks in x fastest order as well) and stores each
+ * brick as one of:
+ *  -   uniform: all voxels have the same value (the inside of the terrain, empty sky far from everything), no data at all
+ *  -   delta4: all values are within base and base + 15, 4 bits per voxel (256 bytes). Distances change by at most 1 per
+ *      voxel, so this catches most bricks of a distance field
+ *  -   raw: 512 bytes
+ * Compressed files are still loaded without decompressing anything, distanceFieldFileGet reads single voxels straight from
+ * the bricks, distanceFieldFileDecompress unpacks a whole channel into a regular field.
+ *
+ * The checksum is a fast 64 bit hash (not cryptographic) of the whole file, with the checksum field taken as 0. Verifying it
+ * reads every byte of the file, so it's optional when loading: check it once after downloading / writing a file, skip it
+ * for files you trust to keep loading bounded by page faults. The structure of the header (sizes, offsets, brick table) is
+ * always validated, so a corrupt file can't make the accessors read outside of the mapping.
+ */
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "DistanceFieldFile.h writes and reads its little endian format without byte swapping"
+#endif
+
+#define DISTANCE_FIELD_FILE_MAGIC 0x46445856u // "VXDF"
+#define DISTANCE_FIELD_FILE_VERSION 1
+#define DISTANCE_FIELD_FILE_ALIGNMENT 4096
+#define DISTANCE_FIELD_FILE_BRICK 8
+
+typedef enum DistanceFieldFileLayout
+{
+    DISTANCE_FIELD_FILE_LAYOUT_LINEAR = 0,  // x fastest, z slowest
+    DISTANCE_FIELD_FILE_LAYOUT_MORTON = 1,  // morton order (see BoolArrToManhattan.h), cubes with a power of two size only
+} DistanceFieldFileLayout;
+
+typedef enum DistanceFieldFileMetric
+{
+    DISTANCE_FIELD_FILE_METRIC_MANHATTAN = 0,        // uint8_t, BoolArrToManhattan.h
+    DISTANCE_FIELD_FILE_METRIC_SIGNED_MANHATTAN = 1, // int8_t, BoolArrToSignedManhattan.h
+    DISTANCE_FIELD_FILE_METRIC_OCTANT_MANHATTAN = 2, // 8 uint8_t channels, OctantDistanceField.h
+} DistanceFieldFileMetric;
+
+typedef enum DistanceFieldFileCompression
+{
+    DISTANCE_FIELD_FILE_COMPRESSION_NONE = 0,
+    DISTANCE_FIELD_FILE_COMPRESSION_BRICKS = 1,     // linear layout only
+} DistanceFieldFileCompression;
+
+typedef enum DistanceFieldFileBrickType
+{
+    DISTANCE_FIELD_FILE_BRICK_UNIFORM = 0,
+    DISTANCE_FIELD_FILE_BRICK_DELTA4 = 1,
+    DISTANCE_FIELD_FILE_BRICK_RAW = 2,
+} DistanceFieldFileBrickType;
+
+typedef struct DistanceFieldFileHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t sizeX, sizeY, sizeZ;
+    uint32_t channels;
+    uint8_t layout, metric, compression, brickSize;
+    uint32_t reserved0;
+    uint64_t brickTableOffset;      // 0 for uncompressed files
+    uint64_t brickCount;            // per channel
+    uint64_t dataOffset;
+    uint64_t dataSize;
+    uint64_t fileSize;
+    uint64_t checksum;
+    uint8_t reserved[48];
+} DistanceFieldFileHeader;
+
+_Static_assert(sizeof(DistanceFieldFileHeader) == 128, "the header is part of the file format");
+
+typedef struct DistanceFieldFileBrick
+{
+    uint32_t offset;    // relative to the data, unused for uniform bricks
+    uint8_t type;       // DistanceFieldFileBrickType
+    uint8_t base;       // the value of uniform bricks, the smallest value of delta4 bricks
+    uint16_t reserved;
+} DistanceFieldFileBrick;
+
+// what to write
+typedef struct DistanceFieldFileDesc
+{
+    int sizeX, sizeY, sizeZ;
+    int channels;
+    DistanceFieldFileLayout layout;
+    DistanceFieldFileMetric metric;
+    DistanceFieldFileCompression compression;
+} DistanceFieldFileDesc;
+
+// a loaded file, all pointers point into the mapping (or into the buffer passed to distanceFieldFileOpenMemory)
+typedef struct DistanceFieldFile
+{
+    const DistanceFieldFileHeader* header;
+    const uint8_t* fields;                      // uncompressed files: the fields, NULL for compressed ones
+    const DistanceFieldFileBrick* bricks;       // compressed files: brickCount bricks per channel, channel after channel
+    const uint8_t* brickData;
+    void* mapping;
+    size_t mappingSize;
+} DistanceFieldFile;
+
+/**
+ * Checksum
+ */
+
+static inline uint64_t distanceFieldFileMix(uint64_t h, uint64_t v)
+{
+    h ^= v * 0x87C37B91114253D5ull;
+    h = (h << 31 | h >> 33) * 0x4CF5AD432745937Full;
+    return h;
+}
+
+// 4 independent lanes of 8 bytes, so this runs at about memory speed
+static uint64_t distanceFieldFileHash(const uint8_t* data, size_t size, uint64_t seed)
+{
+    uint64_t lanes[4] = {seed, seed ^ 0x9E3779B97F4A7C15ull, seed ^ 0xC2B2AE3D27D4EB4Full, seed ^ 0x165667B19E3779F9ull};
+    size_t i = 0;
+
+    for (; i + 32 <= size; i += 32)
+        for (int lane = 0; lane < 4; lane++)
+        {
+            uint64_t v;
+            memcpy(&v, data + i + lane * 8, 8);
+            lanes[lane] = distanceFieldFileMix(lanes[lane], v);
+        }
+
+    uint64_t h = distanceFieldFileMix(distanceFieldFileMix(lanes[0], lanes[1]), distanceFieldFileMix(lanes[2], lanes[3]));
+    for (; i < size; i++)
+        h = distanceFieldFileMix(h, data[i]);
+
+    h ^= size;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    return h;
+}
+
+// hash of the header (with the checksum field set to 0), followed by everything after it
+static uint64_t distanceFieldFileChecksum(const uint8_t* file, size_t size)
+{
+    DistanceFieldFileHeader header;
+    memcpy(&header, file, sizeof(header));
+    header.checksum = 0;
+
+    const uint64_t h = distanceFieldFileHash((const uint8_t*) &header, sizeof(header), 0);
+    return distanceFieldFileHash(file + sizeof(header), size - sizeof(header), h);
+}
+
+/**
+ * Writing
+ */
+
+static inline uint64_t distanceFieldFileAlign(uint64_t offset)
+{
+    return (offset + DISTANCE_FIELD_FILE_ALIGNMENT - 1) & ~(uint64_t) (DISTANCE_FIELD_FILE_ALIGNMENT - 1);
+}
+
+// in uint64_t, the sizes of a file that is being opened can be anything up to INT32_MAX
+static inline uint64_t distanceFieldFileBrickCount(int sizeX, int sizeY, int sizeZ)
+{
+    const uint64_t b = DISTANCE_FIELD_FILE_BRICK;
+    return (((uint64_t) sizeX + b - 1) / b) * (((uint64_t) sizeY + b - 1) / b) * (((uint64_t) sizeZ + b - 1) / b);
+}
+
+// Upper bound of the encoded size (the exact size for uncompressed files), 0 if desc is invalid.
+static size_t distanceFieldFileMaxSize(const DistanceFieldFileDesc* desc)
+{
+    if (desc->sizeX <= 0 || desc->sizeY <= 0 || desc->sizeZ <= 0 || desc->channels <= 0)
+        return 0;
+    // the voxel count of all channels (and so the brick count) has to fit into 64 bits
+    if ((uint64_t) desc->sizeX * desc->sizeY > UINT64_MAX / (uint64_t) desc->sizeZ / (uint64_t) desc->channels)
+        return 0;
+    if (desc->layout == DISTANCE_FIELD_FILE_LAYOUT_MORTON &&
+        (desc->sizeX != desc->sizeY || desc->sizeX != desc->sizeZ || (desc->sizeX & (desc->sizeX - 1)) || desc->sizeX > 1024 ||
+         desc->compression != DISTANCE_FIELD_FILE_COMPRESSION_NONE))
+        return 0;
+
+    const uint64_t count = (uint64_t) desc->sizeX * desc->sizeY * desc->sizeZ * desc->channels;
+    if (desc->compression == DISTANCE_FIELD_FILE_COMPRESSION_NONE)
+        return distanceFieldFileAlign(sizeof(DistanceFieldFileHeader)) + count;
+
+    const uint64_t bricks = distanceFieldFileBrickCount(desc->sizeX, desc->sizeY, desc->sizeZ) * desc->channels;
+    const uint64_t brickVoxels = DISTANCE_FIELD_FILE_BRICK * DISTANCE_FIELD_FILE_BRICK * DISTANCE_FIELD_FILE_BRICK;
+    if (bricks * brickVoxels > UINT32_MAX)
+        return 0;
+    return distanceFieldFileAlign(sizeof(DistanceFieldFileHeader) + bricks * sizeof(DistanceFieldFileBrick)) + bricks * brickVoxels;
+}
+
+// signed fields are stored with the sign bit flipped inside of bricks, so that values close to 0 are close to each other
+static inline uint8_t distanceFieldFileBias(int metric)
+{
+    return metric == DISTANCE_FIELD_FILE_METRIC_SIGNED_MANHATTAN ? 0x80 : 0;
+}
+
+// Encodes a brick starting at voxel (bx, by, bz) of field, returns the number of bytes written to o_data.
+static size_t distanceFieldFileEncodeBrick(const uint8_t* field, int sizeX, int sizeY, int sizeZ, int bx, int by, int bz,
+                                           uint8_t bias, DistanceFieldFileBrick* o_brick, uint8_t* o_data)
+{
+    const int B = DISTANCE_FIELD_FILE_BRICK;
+    uint8_t values[DISTANCE_FIELD_FILE_BRICK * DISTANCE_FIELD_FILE_BRICK * DISTANCE_FIELD_FILE_BRICK];
+    uint8_t lo = 255, hi = 0;
+
+    // voxels of bricks at the border that are outside of the volume repeat the last voxel inside of it
+    for (int z = 0; z < B; z++)
+        for (int y = 0; y < B; y++)
+            for (int x = 0; x < B; x++)
+            {
+                const int vx = min(bx + x, sizeX - 1), vy = min(by + y, sizeY - 1), vz = min(bz + z, sizeZ - 1);
+                const uint8_t v = field[(uint64_t) vz * sizeX * sizeY + (uint64_t) vy * sizeX + vx] ^ bias;
+                values[z * B * B + y * B + x] = v;
+                lo = v < lo ? v : lo;
+                hi = v > hi ? v : hi;
+            }
+
+    o_brick->base = lo;
+    o_brick->reserved = 0;
+
+    if (lo == hi)
+    {
+        o_brick->type = DISTANCE_FIELD_FILE_BRICK_UNIFORM;
+        return 0;
+    }
+
+    if (hi - lo < 16)
+    {
+        o_brick->type = DISTANCE_FIELD_FILE_BRICK_DELTA4;
+        for (int i = 0; i < B * B * B; i += 2)
+            o_data[i / 2] = (uint8_t) ((values[i] - lo) | (values[i + 1] - lo) << 4);
+        return B * B * B / 2;
+    }
+
+    o_brick->type = DISTANCE_FIELD_FILE_BRICK_RAW;
+    memcpy(o_data, values, B * B * B);
+    return B * B * B;
+}
+
+// Encodes the fields (desc->channels fields of sizeX * sizeY * sizeZ bytes, one after the other, in desc->layout) into
+// o_buffer, which must hold distanceFieldFileMaxSize(desc) bytes. Returns the size of the file, 0 if desc is invalid.
+static size_t distanceFieldFileEncode(const uint8_t* fields, const DistanceFieldFileDesc* desc, uint8_t* o_buffer)
+{
+    const size_t maxSize = distanceFieldFileMaxSize(desc);
+    if (maxSize == 0)
+        return 0;
+
+    const uint64_t count = (uint64_t) desc->sizeX * desc->sizeY * desc->sizeZ;
+    DistanceFieldFileHeader header = {
+        .magic = DISTANCE_FIELD_FILE_MAGIC,
+        .version = DISTANCE_FIELD_FILE_VERSION,
+        .headerSize = sizeof(DistanceFieldFileHeader),
+        .sizeX = (uint32_t) desc->sizeX, .sizeY = (uint32_t) desc->sizeY, .sizeZ = (uint32_t) desc->sizeZ,
+        .channels = (uint32_t) desc->channels,
+        .layout = (uint8_t) desc->layout, .metric = (uint8_t) desc->metric, .compression = (uint8_t) desc->compression,
+    };
+
+    if (desc->compression == DISTANCE_FIELD_FILE_COMPRESSION_NONE)
+    {
+        header.dataOffset = distanceFieldFileAlign(sizeof(header));
+        header.dataSize = count * desc->channels;
+        memset(o_buffer, 0, header.dataOffset);
+        memcpy(o_buffer + header.dataOffset, fields, header.dataSize);
+    }
+    else
+    {
+        const int B = DISTANCE_FIELD_FILE_BRICK;
+        const uint8_t bias = distanceFieldFileBias(desc->metric);
+
+        header.brickSize = B;
+        header.brickCount = distanceFieldFileBrickCount(desc->sizeX, desc->sizeY, desc->sizeZ);
+        header.brickTableOffset = sizeof(header);
+        header.dataOffset = distanceFieldFileAlign(sizeof(header) + header.brickCount * desc->channels * sizeof(DistanceFieldFileBrick));
+        memset(o_buffer, 0, header.dataOffset);
+
+        DistanceFieldFileBrick* bricks = (DistanceFieldFileBrick*) (o_buffer + header.brickTableOffset);
+        uint8_t* data = o_buffer + header.dataOffset;
+        uint64_t brick = 0, dataSize = 0;
+
+        for (int c = 0; c < desc->channels; c++)
+            for (int bz = 0; bz < desc->sizeZ; bz += B)
+                for (int by = 0; by < desc->sizeY; by += B)
+                    for (int bx = 0; bx < desc->sizeX; bx += B, brick++)
+                    {
+                        bricks[brick].offset = (uint32_t) dataSize;
+                        dataSize += distanceFieldFileEncodeBrick(fields + c * count, desc->sizeX, desc->sizeY, desc->sizeZ,
+                                                                 bx, by, bz, bias, bricks + brick, data + dataSize);
+                    }
+
+        header.dataSize = dataSize;
+    }
+
+    header.fileSize = header.dataOffset + header.dataSize;
+    memcpy(o_buffer, &header, sizeof(header));
+
+    header.checksum = distanceFieldFileChecksum(o_buffer, header.fileSize);
+    memcpy(o_buffer, &header, sizeof(header));
+    return header.fileSize;
+}
+
+// Encodes the fields and writes them to path. Returns false if desc is invalid or writing failed.
+static bool distanceFieldFileWrite(const char* path, const uint8_t* fields, const DistanceFieldFileDesc* desc)
+{
+    const size_t maxSize = distanceFieldFileMaxSize(desc);
+    if (maxSize == 0)
+        return false;
+
+    uint8_t* buffer = malloc(maxSize);
+    if (!buffer)
+        return false;
+
+    const size_t size = distanceFieldFileEncode(fields, desc, buffer);
+    FILE* file = fopen(path, "wb");
+    bool ok = file != NULL && fwrite(buffer, 1, size, file) == size;
+    if (file)
+        ok &= fclose(file) == 0;
+
+    free(buffer);
+    return ok;
+}
+
+/**
+ * Loading
+ */
+
+// Sets up o_file for a file that's already in memory (e.g. embedded in a region file, must stay alive while o_file is used).
+// Returns false if the file is malformed or (with verify) if its checksum doesn't match.
+static bool distanceFieldFileOpenMemory(const void* buffer, size_t size, DistanceFieldFile* o_file, bool verify)
+{
+    const uint8_t* bytes = buffer;
+    const DistanceFieldFileHeader* header = buffer;
+    memset(o_file, 0, sizeof(*o_file));
+
+    if (size < sizeof(DistanceFieldFileHeader) || header->magic != DISTANCE_FIELD_FILE_MAGIC ||
+        header->version != DISTANCE_FIELD_FILE_VERSION || header->headerSize < sizeof(DistanceFieldFileHeader))
+        return false;
+
+    const DistanceFieldFileDesc desc = {(int) header->sizeX, (int) header->sizeY, (int) header->sizeZ, (int) header->channels,
+                                        header->layout, header->metric, header->compression};
+    // distanceFieldFileMaxSize also rejects voxel counts that don't fit into 64 bits
+    if (header->sizeX > INT32_MAX || header->sizeY > INT32_MAX || header->sizeZ > INT32_MAX || header->channels > INT32_MAX ||
+        header->layout > DISTANCE_FIELD_FILE_LAYOUT_MORTON || header->metric > DISTANCE_FIELD_FILE_METRIC_OCTANT_MANHATTAN ||
+        header->compression > DISTANCE_FIELD_FILE_COMPRESSION_BRICKS || distanceFieldFileMaxSize(&desc) == 0)
+        return false;
+
+    if (header->fileSize > size || header->dataOffset > header->fileSize || header->dataSize > header->fileSize - header->dataOffset ||
+        header->dataOffset < header->headerSize || header->dataOffset % DISTANCE_FIELD_FILE_ALIGNMENT != 0)
+        return false;
+
+    if (verify && distanceFieldFileChecksum(bytes, header->fileSize) != header->checksum)
+        return false;
+
+    const uint64_t count = (uint64_t) header->sizeX * header->sizeY * header->sizeZ;
+    if (header->compression == DISTANCE_FIELD_FILE_COMPRESSION_NONE)
+    {
+        if (header->dataSize % header->channels != 0 || header->dataSize / header->channels != count)
+            return false;
+        o_file->fields = bytes + header->dataOffset;
+    }
+    else
+    {
+        const uint64_t bricks = distanceFieldFileBrickCount(header->sizeX, header->sizeY, header->sizeZ) * header->channels;
+        if (header->brickSize != DISTANCE_FIELD_FILE_BRICK || header->brickCount * header->channels != bricks ||
+            header->brickTableOffset < header->headerSize || header->brickTableOffset % sizeof(uint64_t) != 0 ||
+            header->brickTableOffset > header->dataOffset ||
+            bricks > (header->dataOffset - header->brickTableOffset) / sizeof(DistanceFieldFileBrick))
+            return false;
+
+        // every brick has to be inside of the data, so the accessors never need to check anything
+        o_file->bricks = (const DistanceFieldFileBrick*) (bytes + header->brickTableOffset);
+        for (uint64_t i = 0; i < bricks; i++)
+        {
+            const DistanceFieldFileBrick* brick = o_file->bricks + i;
+            const uint64_t brickSize = brick->type == DISTANCE_FIELD_FILE_BRICK_UNIFORM ? 0 :
+                                       brick->type == DISTANCE_FIELD_FILE_BRICK_DELTA4 ? 256 : 512;
+            if (brick->type > DISTANCE_FIELD_FILE_BRICK_RAW || (uint64_t) brick->offset + brickSize > header->dataSize)
+                return false;
+        }
+        o_file->brickData = bytes + header->dataOffset;
+    }
+
+    o_file->header = header;
+    return true;
+}
+
+// Maps the file at path into memory. Nothing is read until the fields are accessed (except for the checksum with verify
+// and the brick table of compressed files). Returns false if the file can't be opened or is malformed.
+static bool distanceFieldFileOpen(const char* path, DistanceFieldFile* o_file, bool verify)
+{
+    memset(o_file, 0, sizeof(*o_file));
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(DistanceFieldFileHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    // the mapping stays valid after closing the file descriptor
+    void* mapping = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    if (!distanceFieldFileOpenMemory(mapping, (size_t) st.st_size, o_file, verify))
+    {
+        munmap(mapping, (size_t) st.st_size);
+        return false;
+    }
+
+    o_file->mapping = mapping;
+    o_file->mappingSize = (size_t) st.st_size;
+    return true;
+}
+
+static void distanceFieldFileClose(DistanceFieldFile* file)
+{
+    if (file->mapping)
+        munmap(file->mapping, file->mappingSize);
+    memset(file, 0, sizeof(*file));
+}
+
+/**
+ * Access
+ */
+
+// The value of voxel (x, y, z) of channel c (as stored, cast to int8_t for signed fields).
+static inline uint8_t distanceFieldFileGet(const DistanceFieldFile* file, int c, int x, int y, int z)
+{
+    const DistanceFieldFileHeader* header = file->header;
+    const uint64_t count = (uint64_t) header->sizeX * header->sizeY * header->sizeZ;
+
+    if (file->fields)
+    {
+        const uint8_t* field = file->fields + c * count;
+        if (header->layout == DISTANCE_FIELD_FILE_LAYOUT_MORTON)
+            return manhattanDFMortonGet(field, x, y, z);
+        return field[(uint64_t) z * header->sizeX * header->sizeY + (uint64_t) y * header->sizeX + x];
+    }
+
+    const int B = DISTANCE_FIELD_FILE_BRICK;
+    const uint32_t bricksX = (header->sizeX + B - 1) / B, bricksY = (header->sizeY + B - 1) / B;
+    const DistanceFieldFileBrick* brick = file->bricks + c * header->brickCount +
+                                          ((uint64_t) (z / B) * bricksY + y / B) * bricksX + x / B;
+    const int i = (z % B) * B * B + (y % B) * B + x % B;
+    const uint8_t bias = distanceFieldFileBias(header->metric);
+
+    switch (brick->type)
+    {
+        case DISTANCE_FIELD_FILE_BRICK_UNIFORM:
+            return brick->base ^ bias;
+        case DISTANCE_FIELD_FILE_BRICK_DELTA4:
+            return (uint8_t) (brick->base + (file->brickData[brick->offset + i / 2] >> (i & 1) * 4 & 15)) ^ bias;
+        default:
+            return file->brickData[brick->offset + i] ^ bias;
+    }
+}
+
+// Unpacks channel c into a regular field (x fastest, whatever the layout of the file).
+static void distanceFieldFileDecompress(const DistanceFieldFile* file, int c, uint8_t* o_field)
+{
+    const DistanceFieldFileHeader* header = file->header;
+    const int sizeX = (int) header->sizeX, sizeY = (int) header->sizeY, sizeZ = (int) header->sizeZ;
+    const uint64_t count = (uint64_t) sizeX * sizeY * sizeZ;
+
+    if (file->fields)
+    {
+        if (header->layout == DISTANCE_FIELD_FILE_LAYOUT_MORTON)
+            manhattanDFMortonToLinear(file->fields + c * count, o_field, sizeX);
+        else
+            memcpy(o_field, file->fields + c * count, count);
+        return;
+    }
+
+    const int B = DISTANCE_FIELD_FILE_BRICK;
+    const uint8_t bias = distanceFieldFileBias(header->metric);
+    const DistanceFieldFileBrick* brick = file->bricks + c * header->brickCount;
+    uint8_t values[DISTANCE_FIELD_FILE_BRICK * DISTANCE_FIELD_FILE_BRICK * DISTANCE_FIELD_FILE_BRICK];
+
+    for (int bz = 0; bz < sizeZ; bz += B)
+        for (int by = 0; by < sizeY; by += B)
+            for (int bx = 0; bx < sizeX; bx += B, brick++)
+            {
+                const uint8_t* data = file->brickData + brick->offset;
+                if (brick->type == DISTANCE_FIELD_FILE_BRICK_UNIFORM)
+                    memset(values, brick->base ^ bias, sizeof(values));
+                else if (brick->type == DISTANCE_FIELD_FILE_BRICK_DELTA4)
+                    for (int i = 0; i < B * B * B; i += 2)
+                    {
+                        values[i] = (uint8_t) (brick->base + (data[i / 2] & 15)) ^ bias;
+                        values[i + 1] = (uint8_t) (brick->base + (data[i / 2] >> 4)) ^ bias;
+                    }
+                else
+                    for (int i = 0; i < B * B * B; i++)
+                        values[i] = data[i] ^ bias;
+
+                // copy the rows of the brick that are inside of the volume
+                const int w = min(B, sizeX - bx), h = min(B, sizeY - by), d = min(B, sizeZ - bz);
+                for (int z = 0; z < d; z++)
+                    for (int y = 0; y < h; y++)
+                        memcpy(o_field + (uint64_t) (bz + z) * sizeX * sizeY + (uint64_t) (by + y) * sizeX + bx,
+                               values + z * B * B + y * B, w);
+            }
+}
+
+// Usage Example
+void testDistanceFieldFile()
+{
+    const int SIZE = 32;
+    const int COUNT = SIZE * SIZE * SIZE;
+
+    // terrain: solid below z = 12
+    bool boolArr[COUNT];
+    uint8_t distanceField[COUNT];
+    for (int i = 0; i < COUNT; i++)
+        boolArr[i] = i / SIZE / SIZE < 12;
+    boolArrToManhattanDF(boolArr, distanceField, SIZE, SIZE, SIZE);
+
+    // bake it once (bricks: everything below the surface is a uniform brick of zeros)...
+    DistanceFieldFileDesc desc = {SIZE, SIZE, SIZE, 1, DISTANCE_FIELD_FILE_LAYOUT_LINEAR, DISTANCE_FIELD_FILE_METRIC_MANHATTAN,
+                                  DISTANCE_FIELD_FILE_COMPRESSION_BRICKS};
+    distanceFieldFileWrite("region.vxdf", distanceField, &desc);
+
+    // ...and load it whenever the region is needed
+    DistanceFieldFile file;
+    if (distanceFieldFileOpen("region.vxdf", &file, false))
+    {
+        // distanceFieldFileGet(&file, 0, 5, 5, 20) == 9, without unpacking anything.
+        // Uncompressed files can use file.fields directly, e.g. lineOfSight(file.fields, SIZE, SIZE, SIZE, from, to).
+        distanceFieldFileClose(&file);
+    }
+}
+
+#endif //VOXELDEVSCRIPTS_DISTANCEFIELDFILE_H
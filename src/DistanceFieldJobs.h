@@ -0,0 +1,444 @@
+#ifndef VOXELDEVSCRIPTS_DISTANCEFIELDJOBS_H
+#define VOXELDEVSCRIPTS_DISTANCEFIELDJOBS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "BoolArrToManhattan.h"
+
+/*
+ * Asynchronous distance field builds (boolArrToManhattanDF) for chunks, nearest first.
+ *
+ * The game thread submits jobs (a bool array, an output buffer and a callback) together with the distance of the chunk
+ * to the camera, and calls distanceFieldJobsPoll once per frame to run the callbacks of the finished ones. Neither of the
+ * two ever waits for a worker: the queues are lock free, and the finished jobs are published on a lock free stack that
+ * poll takes as a whole.
+ *
+ * Priorities: the distance picks one of DF_JOBS_BUCKETS buckets (bucketDistance wide, the last one takes everything
+ * beyond). Workers always look for work in the nearest bucket first, so a burst of far chunks never holds up a chunk
+ * next to the camera for more than the jobs that are already running. Within a bucket, the oldest job goes first: every
+ * queue is taken from its oldest end, so jobs start in submission order (up to the ones other workers start at the same
+ * time).
+ *
+ * Work stealing: every bucket has a queue owned by the submitting thread, and every worker has a deque per bucket
+ * (Chase-Lev deques, but FIFO: the owner pushes at the bottom, everyone, the owner included, takes at the top with a
+ * CAS). A worker that takes from a submission queue takes up to DF_JOBS_STEAL_BATCH jobs at once into its own deque, so
+ * with thousands of small jobs most of them are taken from a deque the other workers only touch when they run out of
+ * work: idle workers steal from the deques of the others. Workers that find nothing spin for a bit, then sleep on a
+ * semaphore that submit only posts when someone sleeps.
+ *
+ * Cancellation: a chunk (DistanceFieldJobChunk) counts how often jobs were submitted for it. Submitting a new job for a
+ * chunk (or distanceFieldJobsCancel) makes its older jobs stale: workers skip them if they haven't started yet, and poll
+ * reports them as cancelled instead of done in any case, so a callback never sees an outdated result. Every submitted
+ * job gets exactly one callback, on the thread calling poll.
+ *
+ * The caller owns all the memory: the DistanceFieldJobs (a few hundred KB, don't put it on the stack), the jobs, and
+ * their arrays, which have to stay valid (and the bool array unchanged) until the callback of the job. Two jobs that
+ * are in flight at the same time need separate output buffers, even if they are for the same chunk, and a job can only
+ * be submitted again after its callback. Submit, cancel and poll have to be called from one thread.
+ */
+
+#define DF_JOBS_BUCKETS 8
+#define DF_JOBS_MAX_WORKERS 32
+// jobs waiting per bucket (power of 2), submit fails beyond that
+#define DF_JOBS_QUEUE_SIZE 4096
+// jobs a worker holds per bucket (power of 2, at least DF_JOBS_STEAL_BATCH)
+#define DF_JOBS_LOCAL_SIZE 16
+#define DF_JOBS_STEAL_BATCH 8
+// rounds over the queues an idle worker makes before it goes to sleep
+#define DF_JOBS_SPINS 64
+
+typedef enum DistanceFieldJobStatus
+{
+    DISTANCE_FIELD_JOB_DONE,
+    DISTANCE_FIELD_JOB_CANCELLED,   // stale (a newer job for the chunk was submitted, or it was cancelled) or stopped
+} DistanceFieldJobStatus;
+
+typedef struct DistanceFieldJob DistanceFieldJob;
+
+typedef void (*DistanceFieldJobCallback)(DistanceFieldJob* job, DistanceFieldJobStatus status);
+
+// one per chunk, zero initialized
+typedef struct DistanceFieldJobChunk
+{
+    atomic_uint generation;
+} DistanceFieldJobChunk;
+
+struct DistanceFieldJob
+{
+    // set by the caller
+    const bool* boolArr;
+    uint8_t* o_distanceField;
+    int sizeX, sizeY, sizeZ;
+    DistanceFieldJobCallback callback;
+    void* user;
+
+    // set by the scheduler
+    DistanceFieldJobChunk* chunk;
+    unsigned generation;
+    bool computed;
+    DistanceFieldJob* next;
+};
+
+/**
+ * Deques
+ */
+
+typedef struct DistanceFieldJobDeque
+{
+    _Alignas(64) atomic_int_fast64_t top;       // thieves
+    _Alignas(64) atomic_int_fast64_t bottom;    // owner
+    _Atomic(DistanceFieldJob*)* jobs;
+    int64_t mask;
+} DistanceFieldJobDeque;
+
+static inline int64_t distanceFieldJobDequeSize(DistanceFieldJobDeque* deque)
+{
+    return atomic_load_explicit(&deque->bottom, memory_order_relaxed) - atomic_load_explicit(&deque->top, memory_order_relaxed);
+}
+
+// owner only, false if the deque is full
+static inline bool distanceFieldJobDequePush(DistanceFieldJobDeque* deque, DistanceFieldJob* job)
+{
+    const int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    const int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    if (bottom - top > deque->mask)
+        return false;
+
+    atomic_store_explicit(&deque->jobs[bottom & deque->mask], job, memory_order_relaxed);
+    // the job (and what it points to) has to be visible before the thieves see the new bottom
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+    return true;
+}
+
+// anyone (the owner too, so jobs are taken in the order they were pushed), the oldest job, retries if other thieves
+// got in between
+static inline DistanceFieldJob* distanceFieldJobDequeSteal(DistanceFieldJobDeque* deque)
+{
+    for (;;)
+    {
+        int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        const int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+        if (top >= bottom)
+            return NULL;
+
+        DistanceFieldJob* job = atomic_load_explicit(&deque->jobs[top & deque->mask], memory_order_relaxed);
+        if (atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+            return job;
+    }
+}
+
+/**
+ * Scheduler
+ */
+
+typedef struct DistanceFieldJobs DistanceFieldJobs;
+
+typedef struct DistanceFieldJobsWorker
+{
+    DistanceFieldJobs* jobs;
+    int index;
+} DistanceFieldJobsWorker;
+
+struct DistanceFieldJobs
+{
+    DistanceFieldJobDeque queues[DF_JOBS_BUCKETS];                          // owned by the submitting thread
+    DistanceFieldJobDeque local[DF_JOBS_MAX_WORKERS][DF_JOBS_BUCKETS];      // owned by the workers
+    _Atomic(DistanceFieldJob*) queueJobs[DF_JOBS_BUCKETS][DF_JOBS_QUEUE_SIZE];
+    _Atomic(DistanceFieldJob*) localJobs[DF_JOBS_MAX_WORKERS][DF_JOBS_BUCKETS][DF_JOBS_LOCAL_SIZE];
+
+    _Alignas(64) _Atomic(DistanceFieldJob*) finished;  // stack of finished jobs, newest first
+    _Alignas(64) atomic_int sleeping;
+    atomic_bool stop;
+    sem_t wake;
+
+    float bucketDistance;
+    int workerCount;        // the deques the workers steal from
+    int threadCount;        // the workers that were started
+    pthread_t threads[DF_JOBS_MAX_WORKERS];
+    DistanceFieldJobsWorker workers[DF_JOBS_MAX_WORKERS];
+    VoxelStats* stats;      // of the thread that started the workers, they record into it
+};
+
+// the next job of worker w, nearest bucket first: its own deque, the submission queue, then the deques of the others
+static DistanceFieldJob* distanceFieldJobsFind(DistanceFieldJobs* jobs, int w)
+{
+    for (int b = 0; b < DF_JOBS_BUCKETS; b++)
+    {
+        // oldest first, the others may be stealing from the same end
+        DistanceFieldJob* job = NULL;
+        if (distanceFieldJobDequeSize(&jobs->local[w][b]) > 0 && (job = distanceFieldJobDequeSteal(&jobs->local[w][b])))
+            return job;
+
+        if (distanceFieldJobDequeSize(&jobs->queues[b]) > 0 && (job = distanceFieldJobDequeSteal(&jobs->queues[b])))
+        {
+            // take a few more while we're at it, the others steal them from us if they run out
+            for (int i = 1; i < DF_JOBS_STEAL_BATCH; i++)
+            {
+                DistanceFieldJob* extra = distanceFieldJobDequeSteal(&jobs->queues[b]);
+                if (!extra)
+                    break;
+                distanceFieldJobDequePush(&jobs->local[w][b], extra); // can't fail, the deque was empty
+            }
+            return job;
+        }
+
+        for (int i = 1; i < jobs->workerCount; i++)
+        {
+            DistanceFieldJobDeque* victim = &jobs->local[(w + i) % jobs->workerCount][b];
+            if (distanceFieldJobDequeSize(victim) > 0 && (job = distanceFieldJobDequeSteal(victim)))
+                return job;
+        }
+    }
+    return NULL;
+}
+
+static void distanceFieldJobsRun(DistanceFieldJobs* jobs, DistanceFieldJob* job)
+{
+    // skip the job if a newer one for the chunk came in, poll checks again before the callback
+    job->computed = false;
+    if (job->generation == atomic_load_explicit(&job->chunk->generation, memory_order_relaxed))
+    {
+        boolArrToManhattanDF(job->boolArr, job->o_distanceField, job->sizeX, job->sizeY, job->sizeZ);
+        job->computed = true;
+    }
+
+    // publish, the release makes the job and its distance field visible to poll
+    DistanceFieldJob* head = atomic_load_explicit(&jobs->finished, memory_order_relaxed);
+    do
+        job->next = head;
+    while (!atomic_compare_exchange_weak_explicit(&jobs->finished, &head, job, memory_order_release, memory_order_relaxed));
+}
+
+static void* distanceFieldJobsWorker(void* arg)
+{
+    DistanceFieldJobsWorker* worker = arg;
+    DistanceFieldJobs* jobs = worker->jobs;
+    VoxelStats* previousStats = voxelStatsBind(jobs->stats);
+
+    int idle = 0;
+    while (!atomic_load_explicit(&jobs->stop, memory_order_relaxed))
+    {
+        DistanceFieldJob* job = distanceFieldJobsFind(jobs, worker->index);
+        if (job)
+        {
+            distanceFieldJobsRun(jobs, job);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < DF_JOBS_SPINS)
+        {
+            sched_yield();
+            continue;
+        }
+
+        // announce that we sleep before the last look, submit looks at sleeping after pushing, so one of the two
+        // sees the other. That needs a full fence on both sides: the one here orders the increment before the (relaxed)
+        // loads of the deque sizes in the look, the one in submit the push before its load of sleeping
+        atomic_fetch_add(&jobs->sleeping, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        job = distanceFieldJobsFind(jobs, worker->index);
+        if (!job && !atomic_load(&jobs->stop))
+            while (sem_wait(&jobs->wake) != 0); // EINTR
+        atomic_fetch_sub(&jobs->sleeping, 1);
+
+        if (job)
+            distanceFieldJobsRun(jobs, job);
+        idle = 0;
+    }
+
+    voxelStatsBind(previousStats);
+    return NULL;
+}
+
+// Starts threadCount workers (threadCount <= 0 uses one per online CPU). Jobs with a camera distance below
+// bucketDistance go into the first bucket, below 2 * bucketDistance into the second, ...
+// Returns false if no worker could be started.
+static bool distanceFieldJobsStart(DistanceFieldJobs* jobs, int threadCount, float bucketDistance)
+{
+    if (threadCount <= 0)
+        threadCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadCount > DF_JOBS_MAX_WORKERS)
+        threadCount = DF_JOBS_MAX_WORKERS;
+    if (threadCount < 1)
+        threadCount = 1;
+
+    memset(jobs, 0, sizeof(DistanceFieldJobs));
+    for (int b = 0; b < DF_JOBS_BUCKETS; b++)
+    {
+        jobs->queues[b].jobs = jobs->queueJobs[b];
+        jobs->queues[b].mask = DF_JOBS_QUEUE_SIZE - 1;
+        for (int w = 0; w < DF_JOBS_MAX_WORKERS; w++)
+        {
+            jobs->local[w][b].jobs = jobs->localJobs[w][b];
+            jobs->local[w][b].mask = DF_JOBS_LOCAL_SIZE - 1;
+        }
+    }
+    jobs->bucketDistance = bucketDistance;
+    jobs->stats = voxelStatsGetCurrent();
+    if (sem_init(&jobs->wake, 0, 0) != 0)
+        return false;
+
+    // the workers steal from each other's deques, so all of them have to be counted before the first one starts
+    // (the deques of workers that fail to start stay empty, stealing from them finds nothing)
+    jobs->workerCount = threadCount;
+    for (; jobs->threadCount < threadCount; jobs->threadCount++)
+    {
+        const int w = jobs->threadCount;
+        jobs->workers[w] = (DistanceFieldJobsWorker) {jobs, w};
+        if (pthread_create(&jobs->threads[w], NULL, distanceFieldJobsWorker, &jobs->workers[w]) != 0)
+            break;
+    }
+
+    // no workers, no semaphore (stop skips it then)
+    if (jobs->threadCount == 0)
+        sem_destroy(&jobs->wake);
+    return jobs->threadCount > 0;
+}
+
+// Submits job for chunk, replacing the chunk's older jobs. The caller sets the arrays, sizes and callback of job.
+// Returns false if the bucket of the distance is full (nothing changes then, try again after the next poll).
+static bool distanceFieldJobsSubmit(DistanceFieldJobs* jobs, DistanceFieldJob* job, DistanceFieldJobChunk* chunk, float cameraDistance)
+{
+    // NaN and negative distances go into the first bucket
+    const float bucket = cameraDistance / jobs->bucketDistance;
+    const int b = bucket > 0.0f ? (bucket < (float) (DF_JOBS_BUCKETS - 1) ? (int) bucket : DF_JOBS_BUCKETS - 1) : 0;
+    DistanceFieldJobDeque* queue = &jobs->queues[b];
+
+    // only this thread pushes, so a queue that has room now still has it below
+    if (distanceFieldJobDequeSize(queue) > queue->mask)
+        return false;
+
+    // the older jobs become stale before the new one can be seen by a worker
+    job->chunk = chunk;
+    job->generation = atomic_load_explicit(&chunk->generation, memory_order_relaxed) + 1;
+    job->computed = false;
+    atomic_store_explicit(&chunk->generation, job->generation, memory_order_relaxed);
+    distanceFieldJobDequePush(queue, job);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&jobs->sleeping, memory_order_relaxed) > 0)
+        sem_post(&jobs->wake);
+    return true;
+}
+
+// Makes the jobs of chunk stale, e.g. when it's unloaded.
+static inline void distanceFieldJobsCancel(DistanceFieldJobChunk* chunk)
+{
+    atomic_fetch_add_explicit(&chunk->generation, 1, memory_order_relaxed);
+}
+
+// Calls the callbacks of the jobs that finished since the last call, in the order they finished. Never waits.
+// Returns the number of callbacks.
+static int distanceFieldJobsPoll(DistanceFieldJobs* jobs)
+{
+    DistanceFieldJob* newest = atomic_exchange_explicit(&jobs->finished, NULL, memory_order_acquire);
+
+    DistanceFieldJob* oldest = NULL;
+    while (newest)
+    {
+        DistanceFieldJob* next = newest->next;
+        newest->next = oldest;
+        oldest = newest;
+        newest = next;
+    }
+
+    int count = 0;
+    while (oldest)
+    {
+        // the callback may reuse the job
+        DistanceFieldJob* job = oldest;
+        oldest = job->next;
+
+        // submit and cancel run on this thread, so this is the final word on whether the job is stale
+        const bool current = job->generation == atomic_load_explicit(&job->chunk->generation, memory_order_relaxed);
+        job->callback(job, job->computed && current ? DISTANCE_FIELD_JOB_DONE : DISTANCE_FIELD_JOB_CANCELLED);
+        count++;
+    }
+    return count;
+}
+
+// Stops and joins the workers. The jobs that didn't run are reported as cancelled by the next poll, which should be
+// called after this to get the callbacks of all jobs. Can be called after a failed start and more than once.
+static void distanceFieldJobsStop(DistanceFieldJobs* jobs)
+{
+    atomic_store(&jobs->stop, true);
+    for (int i = 0; i < jobs->threadCount; i++)
+        sem_post(&jobs->wake);
+    for (int i = 0; i < jobs->threadCount; i++)
+        pthread_join(jobs->threads[i], NULL);
+    // the semaphore only lives while there are workers (start destroys it if none started, the end of stop sets
+    // threadCount to 0)
+    if (jobs->threadCount > 0)
+        sem_destroy(&jobs->wake);
+
+    // the workers are gone, so this thread can empty their deques as well
+    for (int b = 0; b < DF_JOBS_BUCKETS; b++)
+    {
+        DistanceFieldJob* job;
+        for (int w = 0; w < jobs->workerCount; w++)
+            while ((job = distanceFieldJobDequeSteal(&jobs->local[w][b])))
+            {
+                job->next = atomic_load_explicit(&jobs->finished, memory_order_relaxed);
+                atomic_store_explicit(&jobs->finished, job, memory_order_relaxed);
+            }
+        while ((job = distanceFieldJobDequeSteal(&jobs->queues[b])))
+        {
+            job->next = atomic_load_explicit(&jobs->finished, memory_order_relaxed);
+            atomic_store_explicit(&jobs->finished, job, memory_order_relaxed);
+        }
+    }
+    jobs->threadCount = 0;
+}
+
+// Usage Example
+static void testDistanceFieldJobsDone(DistanceFieldJob* job, DistanceFieldJobStatus status)
+{
+    // on the thread calling poll: upload job->o_distanceField if status is DISTANCE_FIELD_JOB_DONE, then free or reuse
+    // the job and its buffers
+    int* doneCount = job->user;
+    *doneCount += status == DISTANCE_FIELD_JOB_DONE;
+}
+
+void testDistanceFieldJobs()
+{
+    const int SIZE = 16, CHUNKS = 64;
+
+    static DistanceFieldJobs jobs;
+    if (!distanceFieldJobsStart(&jobs, 0, 64.0f))
+        return;
+
+    bool boolArr[SIZE * SIZE * SIZE];
+    memset(&boolArr, 0, SIZE * SIZE * SIZE * sizeof(bool));
+    memset(&boolArr, 1, 4 * SIZE * SIZE * sizeof(bool));
+
+    static uint8_t distanceFields[64][16 * 16 * 16];
+    static DistanceFieldJob chunkJobs[64];
+    static DistanceFieldJobChunk chunks[64];
+    int doneCount = 0;
+
+    // a row of chunks along x with the camera at x = 0
+    for (int i = 0; i < CHUNKS; i++)
+    {
+        chunkJobs[i] = (DistanceFieldJob) {.boolArr = boolArr, .o_distanceField = distanceFields[i], .sizeX = SIZE, .sizeY = SIZE,
+                                           .sizeZ = SIZE, .callback = testDistanceFieldJobsDone, .user = &doneCount};
+        distanceFieldJobsSubmit(&jobs, &chunkJobs[i], &chunks[i], (float) (i * SIZE));
+    }
+
+    // once per frame in the game loop, here until everything is through
+    for (int handled = 0; handled < CHUNKS; sched_yield())
+        handled += distanceFieldJobsPoll(&jobs);
+
+    distanceFieldJobsStop(&jobs);
+    distanceFieldJobsPoll(&jobs);
+}
+
+#endif //VOXELDEVSCRIPTS_DISTANCEFIELDJOBS_H
@@ -0,0 +1,335 @@
+#ifndef VOXELDEVSCRIPTS_FIELDSAMPLER_H
+#define VOXELDEVSCRIPTS_FIELDSAMPLER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+#include "VoxelStats.h"
+// cpmath defines generic macros (min, div, length, ...), so it has to be included after the standard headers
+#include "cpmath.h"
+
+/*
+ * Trilinear sampling of distance fields (the uint8 Manhattan field of BoolArrToManhattan.h, or any float field) at
+ * arbitrary points, with the gradient, for smooth collision responses, soft shadows, ... Positions are in voxels, voxel
+ * (x, y, z) occupies [x, x + 1] x [y, y + 1] x [z, z + 1] and its value is at its center.
+ *
+ * The gradient is the central difference of the interpolated field with a step of one voxel:
+ * (f(p + x) - f(p - x)) / 2, ... That's 6 more trilinear lookups, but they overlap with the one for the value: all 7
+ * together only need 32 samples, the 4 rows of 4 voxels (x0 - 1 .. x0 + 2) at (y0 .. y0 + 1, z0 .. z0 + 1), and the middle
+ * 2 voxels of the 8 rows next to them along y and z. So a point costs 12 row fetches, no matter which of the 7 values
+ * they are for.
+ *
+ * fieldSampleU8 / fieldSampleF32 sample batches of points, FIELD_SAMPLER_LANES at a time:
+ *  -   AVX2: 8 points, the rows are fetched with gathers. A row of the uint8 field is a single 32 bit gather lane
+ *      (the 4 bytes x0 - 1 .. x0 + 2), so 8 points take 12 gathers. The float field takes 32.
+ *  -   SSE4.1: 4 points, every row is fetched with one unaligned load per point (4 bytes or 4 floats, which are next to
+ *      each other in memory) and transposed into the lanes.
+ *  -   otherwise: 1 point, plain C.
+ * The 7 interpolations run on all lanes at once after that.
+ *
+ * Points are clamped to [1.5, size - 1.5] along every axis, so the rows around them are always inside of the volume
+ * (the volume needs at least 4 voxels along each axis). Outside of that, the values and gradients are the ones of the
+ * closest clamped point, which is what you want for a chunk with a border of a voxel or two from its neighbours.
+ */
+
+#if defined(__AVX2__)
+#define FIELD_SAMPLER_LANES 8
+#define FIELD_SAMPLER_F __m256
+#define FIELD_SAMPLER_I __m256i
+#define sampler_loadu _mm256_loadu_ps
+#define sampler_storeu _mm256_storeu_ps
+#define sampler_set1 _mm256_set1_ps
+#define sampler_add _mm256_add_ps
+#define sampler_sub _mm256_sub_ps
+#define sampler_mul _mm256_mul_ps
+#define sampler_min _mm256_min_ps
+#define sampler_max _mm256_max_ps
+#define sampler_floor _mm256_floor_ps
+#define sampler_cvtf _mm256_cvtepi32_ps
+#define sampler_cvti _mm256_cvttps_epi32
+#define sampler_set1i _mm256_set1_epi32
+#define sampler_addi _mm256_add_epi32
+#define sampler_mini _mm256_min_epi32
+#define sampler_mulli _mm256_mullo_epi32
+#elif defined(__SSE4_1__)
+#define FIELD_SAMPLER_LANES 4
+#define FIELD_SAMPLER_F __m128
+#define FIELD_SAMPLER_I __m128i
+#define sampler_loadu _mm_loadu_ps
+#define sampler_storeu _mm_storeu_ps
+#define sampler_set1 _mm_set1_ps
+#define sampler_add _mm_add_ps
+#define sampler_sub _mm_sub_ps
+#define sampler_mul _mm_mul_ps
+#define sampler_min _mm_min_ps
+#define sampler_max _mm_max_ps
+#define sampler_floor _mm_floor_ps
+#define sampler_cvtf _mm_cvtepi32_ps
+#define sampler_cvti _mm_cvttps_epi32
+#define sampler_set1i _mm_set1_epi32
+#define sampler_addi _mm_add_epi32
+#define sampler_mini _mm_min_epi32
+#define sampler_mulli _mm_mullo_epi32
+#else
+#define FIELD_SAMPLER_LANES 1
+#define FIELD_SAMPLER_F float
+#define FIELD_SAMPLER_I int32_t
+#define sampler_loadu(p) (*(p))
+#define sampler_storeu(p, a) (*(p) = (a))
+#define sampler_set1(a) (a)
+#define sampler_add(a, b) ((a) + (b))
+#define sampler_sub(a, b) ((a) - (b))
+#define sampler_mul(a, b) ((a) * (b))
+// the same operand order as minps / maxps: a NaN in a gives b
+#define sampler_min(a, b) ((a) < (b) ? (a) : (b))
+#define sampler_max(a, b) ((a) > (b) ? (a) : (b))
+#define sampler_floor floorf
+#define sampler_cvtf(a) ((float) (a))
+#define sampler_cvti(a) ((int32_t) (a))
+#define sampler_set1i(a) (a)
+#define sampler_addi(a, b) ((a) + (b))
+#define sampler_mini(a, b) ((a) < (b) ? (a) : (b))
+#define sampler_mulli(a, b) ((a) * (b))
+#endif
+
+#define sampler_lerp(a, b, t) sampler_add(a, sampler_mul(t, sampler_sub(b, a)))
+
+// rows 0 - 3 are (y0 + dy, z0 + dz) for dy, dz in 0, 1 (dy + 2 * dz), 4 - 7 the ones at y0 - 1 and y0 + 2
+// (z0, z0 + 1, z0, z0 + 1), 8 - 11 the ones at z0 - 1 and z0 + 2 (y0, y0 + 1, y0, y0 + 1)
+#define FIELD_SAMPLER_ROWS 12
+
+// The offsets of the rows (from the start of row (y0, z0)).
+static inline void fieldSamplerRowOffsets(int sizeX, int sizeY, int32_t o_offsets[FIELD_SAMPLER_ROWS])
+{
+    const int32_t sx = sizeX, sxy = sizeX * sizeY;
+    const int32_t offsets[FIELD_SAMPLER_ROWS] = {
+        0, sx, sxy, sx + sxy,
+        -sx, -sx + sxy, 2 * sx, 2 * sx + sxy,
+        -sxy, sx - sxy, 2 * sxy, sx + 2 * sxy,
+    };
+    memcpy(o_offsets, offsets, sizeof(offsets));
+}
+
+// The interpolation weights of the lanes and the index of voxel (x0 - 1, y0, z0) of each of them.
+static inline FIELD_SAMPLER_I fieldSamplerSetup(const cp_vec3* points, int sizeX, int sizeY, int sizeZ,
+                                                FIELD_SAMPLER_F* o_fx, FIELD_SAMPLER_F* o_fy, FIELD_SAMPLER_F* o_fz)
+{
+    float coordinates[3][FIELD_SAMPLER_LANES];
+    for (int lane = 0; lane < FIELD_SAMPLER_LANES; lane++)
+    {
+        coordinates[0][lane] = points[lane].x;
+        coordinates[1][lane] = points[lane].y;
+        coordinates[2][lane] = points[lane].z;
+    }
+
+    const int sizes[3] = {sizeX, sizeY, sizeZ};
+    FIELD_SAMPLER_I cell[3];
+    FIELD_SAMPLER_F* fractions[3] = {o_fx, o_fy, o_fz};
+    for (int axis = 0; axis < 3; axis++)
+    {
+        // voxel centers at integer coordinates, clamped to [1, size - 2], the cell to [1, size - 3]
+        FIELD_SAMPLER_F g = sampler_sub(sampler_loadu(coordinates[axis]), sampler_set1(0.5f));
+        g = sampler_min(sampler_max(g, sampler_set1(1.0f)), sampler_set1((float) sizes[axis] - 2.0f));
+        cell[axis] = sampler_mini(sampler_cvti(sampler_floor(g)), sampler_set1i(sizes[axis] - 3));
+        *fractions[axis] = sampler_sub(g, sampler_cvtf(cell[axis]));
+    }
+
+    const FIELD_SAMPLER_I row = sampler_addi(sampler_mulli(cell[2], sampler_set1i(sizeY)), cell[1]);
+    return sampler_addi(sampler_mulli(row, sampler_set1i(sizeX)), sampler_addi(cell[0], sampler_set1i(-1)));
+}
+
+/**
+ * Row fetches
+ */
+
+// all 4 voxels of the first 4 rows, the middle 2 (1 and 2) of the others
+static inline void fieldSamplerFetchU8(const uint8_t* field, FIELD_SAMPLER_I base, const int32_t offsets[FIELD_SAMPLER_ROWS],
+                                       FIELD_SAMPLER_F o_rows[FIELD_SAMPLER_ROWS][4])
+{
+#if defined(__AVX2__)
+    for (int r = 0; r < FIELD_SAMPLER_ROWS; r++)
+    {
+        // the 4 bytes x0 - 1 .. x0 + 2 in one lane, the clamping keeps them inside of the field
+        const __m256i row = _mm256_i32gather_epi32((const int*) field, _mm256_add_epi32(base, _mm256_set1_epi32(offsets[r])), 1);
+        for (int k = 0; k < 4; k++)
+            o_rows[r][k] = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(row, 8 * k), _mm256_set1_epi32(0xFF)));
+    }
+#elif defined(__SSE4_1__)
+    int32_t bases[4];
+    _mm_storeu_si128((__m128i*) bases, base);
+    for (int r = 0; r < FIELD_SAMPLER_ROWS; r++)
+    {
+        uint32_t words[4];
+        for (int lane = 0; lane < 4; lane++)
+            memcpy(words + lane, field + bases[lane] + offsets[r], sizeof(uint32_t));
+        const __m128i row = _mm_loadu_si128((const __m128i*) words);
+        for (int k = 0; k < 4; k++)
+            o_rows[r][k] = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(row, 8 * k), _mm_set1_epi32(0xFF)));
+    }
+#else
+    for (int r = 0; r < FIELD_SAMPLER_ROWS; r++)
+        for (int k = 0; k < 4; k++)
+            o_rows[r][k] = (float) field[base + offsets[r] + k];
+#endif
+}
+
+static inline void fieldSamplerFetchF32(const float* field, FIELD_SAMPLER_I base, const int32_t offsets[FIELD_SAMPLER_ROWS],
+                                        FIELD_SAMPLER_F o_rows[FIELD_SAMPLER_ROWS][4])
+{
+#if defined(__AVX2__)
+    for (int r = 0; r < FIELD_SAMPLER_ROWS; r++)
+    {
+        const __m256i row = _mm256_add_epi32(base, _mm256_set1_epi32(offsets[r]));
+        for (int k = r < 4 ? 0 : 1; k < (r < 4 ? 4 : 3); k++)
+            o_rows[r][k] = _mm256_i32gather_ps(field, _mm256_add_epi32(row, _mm256_set1_epi32(k)), 4);
+    }
+#elif defined(__SSE4_1__)
+    int32_t bases[4];
+    _mm_storeu_si128((__m128i*) bases, base);
+    for (int r = 0; r < FIELD_SAMPLER_ROWS; r++)
+    {
+        __m128 l0 = _mm_loadu_ps(field + bases[0] + offsets[r]), l1 = _mm_loadu_ps(field + bases[1] + offsets[r]);
+        __m128 l2 = _mm_loadu_ps(field + bases[2] + offsets[r]), l3 = _mm_loadu_ps(field + bases[3] + offsets[r]);
+        _MM_TRANSPOSE4_PS(l0, l1, l2, l3);
+        o_rows[r][0] = l0, o_rows[r][1] = l1, o_rows[r][2] = l2, o_rows[r][3] = l3;
+    }
+#else
+    for (int r = 0; r < FIELD_SAMPLER_ROWS; r++)
+        for (int k = 0; k < 4; k++)
+            o_rows[r][k] = field[base + offsets[r] + k];
+#endif
+}
+
+/**
+ * Interpolation
+ */
+
+// value and central differences of the lanes from their rows, written to points [0, count) of the outputs
+static inline void fieldSamplerCombine(FIELD_SAMPLER_F rows[FIELD_SAMPLER_ROWS][4], FIELD_SAMPLER_F fx, FIELD_SAMPLER_F fy,
+                                       FIELD_SAMPLER_F fz, int count, float* o_values, cp_vec3* o_gradients)
+{
+    // along x: the rows at x (center), x + 1 and x - 1 for the core rows, at x for the others
+    FIELD_SAMPLER_F center[FIELD_SAMPLER_ROWS], plusX[4], minusX[4];
+    for (int r = 0; r < FIELD_SAMPLER_ROWS; r++)
+        center[r] = sampler_lerp(rows[r][1], rows[r][2], fx);
+    for (int r = 0; r < 4; r++)
+    {
+        plusX[r] = sampler_lerp(rows[r][2], rows[r][3], fx);
+        minusX[r] = sampler_lerp(rows[r][0], rows[r][1], fx);
+    }
+
+    // along y and z, the bilinear interpolation of the 4 core rows
+#define SAMPLER_BILERP(r0, r1, r2, r3) sampler_lerp(sampler_lerp(r0, r1, fy), sampler_lerp(r2, r3, fy), fz)
+    const FIELD_SAMPLER_F value = SAMPLER_BILERP(center[0], center[1], center[2], center[3]);
+    const FIELD_SAMPLER_F valuePlusX = SAMPLER_BILERP(plusX[0], plusX[1], plusX[2], plusX[3]);
+    const FIELD_SAMPLER_F valueMinusX = SAMPLER_BILERP(minusX[0], minusX[1], minusX[2], minusX[3]);
+    const FIELD_SAMPLER_F valuePlusY = SAMPLER_BILERP(center[1], center[6], center[3], center[7]);
+    const FIELD_SAMPLER_F valueMinusY = SAMPLER_BILERP(center[4], center[0], center[5], center[2]);
+    const FIELD_SAMPLER_F valuePlusZ = SAMPLER_BILERP(center[2], center[3], center[10], center[11]);
+    const FIELD_SAMPLER_F valueMinusZ = SAMPLER_BILERP(center[8], center[9], center[0], center[1]);
+#undef SAMPLER_BILERP
+
+    const FIELD_SAMPLER_F half = sampler_set1(0.5f);
+    float values[FIELD_SAMPLER_LANES], gx[FIELD_SAMPLER_LANES], gy[FIELD_SAMPLER_LANES], gz[FIELD_SAMPLER_LANES];
+    sampler_storeu(values, value);
+    sampler_storeu(gx, sampler_mul(sampler_sub(valuePlusX, valueMinusX), half));
+    sampler_storeu(gy, sampler_mul(sampler_sub(valuePlusY, valueMinusY), half));
+    sampler_storeu(gz, sampler_mul(sampler_sub(valuePlusZ, valueMinusZ), half));
+
+    for (int lane = 0; lane < count; lane++)
+    {
+        o_values[lane] = values[lane];
+        o_gradients[lane] = (cp_vec3) {.x = gx[lane], .y = gy[lane], .z = gz[lane]};
+    }
+}
+
+// the next FIELD_SAMPLER_LANES points, or the last few of them padded with the last one
+static inline const cp_vec3* fieldSamplerPoints(const cp_vec3* points, int count, cp_vec3 padded[FIELD_SAMPLER_LANES])
+{
+    if (count >= FIELD_SAMPLER_LANES)
+        return points;
+
+    for (int lane = 0; lane < FIELD_SAMPLER_LANES; lane++)
+        padded[lane] = points[lane < count ? lane : count - 1];
+    return padded;
+}
+
+/**
+ * Batches
+ */
+
+// Samples the uint8 Manhattan field at count points, o_values gets the interpolated distances (in voxels) and o_gradients
+// the central differences (pointing away from the geometry, about 1 long away from the surface, shorter close to corners).
+static void fieldSampleU8(const uint8_t* field, int sizeX, int sizeY, int sizeZ, const cp_vec3* points, int count,
+                          float* o_values, cp_vec3* o_gradients)
+{
+    VOXEL_STATS_BEGIN(VOXEL_STATS_FIELD_SAMPLE);
+    int32_t offsets[FIELD_SAMPLER_ROWS];
+    fieldSamplerRowOffsets(sizeX, sizeY, offsets);
+
+    for (int i = 0; i < count; i += FIELD_SAMPLER_LANES)
+    {
+        cp_vec3 padded[FIELD_SAMPLER_LANES];
+        const cp_vec3* lanes = fieldSamplerPoints(points + i, count - i, padded);
+
+        FIELD_SAMPLER_F fx, fy, fz, rows[FIELD_SAMPLER_ROWS][4];
+        const FIELD_SAMPLER_I base = fieldSamplerSetup(lanes, sizeX, sizeY, sizeZ, &fx, &fy, &fz);
+        fieldSamplerFetchU8(field, base, offsets, rows);
+        fieldSamplerCombine(rows, fx, fy, fz, cp_mini(count - i, FIELD_SAMPLER_LANES), o_values + i, o_gradients + i);
+    }
+
+    VOXEL_STATS_END(VOXEL_STATS_FIELD_SAMPLE, count, (uint64_t) count * (sizeof(cp_vec3) * 2 + sizeof(float) + 12 * 4));
+}
+
+// Same for a float field.
+static void fieldSampleF32(const float* field, int sizeX, int sizeY, int sizeZ, const cp_vec3* points, int count,
+                           float* o_values, cp_vec3* o_gradients)
+{
+    VOXEL_STATS_BEGIN(VOXEL_STATS_FIELD_SAMPLE);
+    int32_t offsets[FIELD_SAMPLER_ROWS];
+    fieldSamplerRowOffsets(sizeX, sizeY, offsets);
+
+    for (int i = 0; i < count; i += FIELD_SAMPLER_LANES)
+    {
+        cp_vec3 padded[FIELD_SAMPLER_LANES];
+        const cp_vec3* lanes = fieldSamplerPoints(points + i, count - i, padded);
+
+        FIELD_SAMPLER_F fx, fy, fz, rows[FIELD_SAMPLER_ROWS][4];
+        const FIELD_SAMPLER_I base = fieldSamplerSetup(lanes, sizeX, sizeY, sizeZ, &fx, &fy, &fz);
+        fieldSamplerFetchF32(field, base, offsets, rows);
+        fieldSamplerCombine(rows, fx, fy, fz, cp_mini(count - i, FIELD_SAMPLER_LANES), o_values + i, o_gradients + i);
+    }
+
+    VOXEL_STATS_END(VOXEL_STATS_FIELD_SAMPLE, count, (uint64_t) count * (sizeof(cp_vec3) * 2 + sizeof(float) + 32 * 4));
+}
+
+// Usage Example
+void testFieldSampler()
+{
+    const int SIZE = 32;
+
+    // the Manhattan distance to a floor of 4 voxels, as boolArrToManhattanDF would compute it
+    uint8_t field[SIZE * SIZE * SIZE];
+    for (int z = 0; z < SIZE; z++)
+        memset(field + z * SIZE * SIZE, z < 4 ? 0 : z - 3, SIZE * SIZE);
+
+    // a few particles above the floor, the gradients point up (0, 0, 1), the values grow by 1 per voxel of height
+    cp_vec3 points[10];
+    for (int i = 0; i < 10; i++)
+        points[i] = (cp_vec3) {.x = 4.0f + 2.5f * (float) i, .y = 16.0f, .z = 6.0f + 0.3f * (float) i};
+
+    float distances[10];
+    cp_vec3 gradients[10];
+    fieldSampleU8(field, SIZE, SIZE, SIZE, points, 10, distances, gradients);
+
+    // push particles closer than 3 voxels out along the gradient
+    for (int i = 0; i < 10; i++)
+        if (distances[i] < 3.0f)
+            points[i] = cp_vec3_fmas2(gradients[i], 3.0f - distances[i], points[i]);
+}
+
+#endif //VOXELDEVSCRIPTS_FIELDSAMPLER_H
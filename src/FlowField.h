@@ -0,0 +1,307 @@
+#ifndef VOXELDEVSCRIPTS_FLOWFIELD_H
+#define VOXELDEVSCRIPTS_FLOWFIELD_H
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "VoxelStats.h"
+
+/*
+ * Flow fields towards a set of seed voxels (e.g. a player, a door or all food sources), built on the distance field passes.
+ * Instead of every agent searching its own path, one field per target is computed once, and every agent just looks up
+ * the direction stored at its position (O(1), see flowFieldStep).
+ *
+ * There are two versions:
+ *
+ *  -   flowFieldFromSeeds: free space. This uses the same XPASS -> YPASS -> ZPASS structure as BoolArrToManhattan.h, but
+ *      each pass carries the index of the seed a distance belongs to along with the distance (a "feature transform").
+ *      Since we know the nearest seed of every voxel, we can step along the axis with the biggest remaining difference,
+ *      which gives nice diagonal looking paths. Note that the passes can not go around obstacles, so this is only correct
+ *      for flying agents / open areas.
+ *
+ *  -   flowFieldFromSeedsBlocked: with obstacles. Once there are walls, the distance along a path is no longer a Manhattan
+ *      distance and can't be computed per axis, so this version uses a breadth first search from all seeds at once.
+ *      Each voxel is visited exactly once, so it's still O(n). The direction points to the voxel it was reached from.
+ *
+ * Both produce:
+ *  -   o_distance:     steps to the nearest seed (FLOW_FIELD_INFINITY if no seed is reachable)
+ *  -   o_nearestSeed:  flattened index of the nearest seed (FLOW_FIELD_NO_SEED if none), optional (pass NULL)
+ *  -   o_direction:    one of the FLOW_FIELD_* directions below, the step an agent has to take to get closer to its nearest seed
+ *
+ * Following the directions from any voxel leads to its nearest seed in exactly o_distance steps.
+ */
+
+#define FLOW_FIELD_INFINITY UINT16_MAX
+#define FLOW_FIELD_NO_SEED UINT32_MAX
+
+enum
+{
+    FLOW_FIELD_AT_SEED = 0,
+    FLOW_FIELD_NEG_X = 1,
+    FLOW_FIELD_POS_X = 2,
+    FLOW_FIELD_NEG_Y = 3,
+    FLOW_FIELD_POS_Y = 4,
+    FLOW_FIELD_NEG_Z = 5,
+    FLOW_FIELD_POS_Z = 6,
+    FLOW_FIELD_UNREACHABLE = 7
+};
+
+// step for each direction
+static const int8_t FLOW_FIELD_OFFSETS[8][3] = {
+        {0,  0,  0},
+        {-1, 0,  0},
+        {1,  0,  0},
+        {0,  -1, 0},
+        {0,  1,  0},
+        {0,  0,  -1},
+        {0,  0,  1},
+        {0,  0,  0}
+};
+
+// Moves an agent one voxel along the flow field. Returns false if the agent is already at a seed or no seed is reachable.
+static inline bool flowFieldStep(const uint8_t* direction, int sizeX, int sizeY, int* x, int* y, int* z)
+{
+    const uint8_t d = direction[*z * sizeX * sizeY + *y * sizeX + *x];
+    *x += FLOW_FIELD_OFFSETS[d][0];
+    *y += FLOW_FIELD_OFFSETS[d][1];
+    *z += FLOW_FIELD_OFFSETS[d][2];
+    return d != FLOW_FIELD_AT_SEED && d != FLOW_FIELD_UNREACHABLE;
+}
+
+/*
+ * Free space
+ */
+
+// moves distances (and their seeds) along the rows, just like the Y and Z passes of the distance field
+static inline void flowFieldRelaxRow(uint16_t* restrict distRow, uint32_t* restrict seedRow,
+                                     const uint16_t* restrict prevDistRow, const uint32_t* restrict prevSeedRow, int sizeX)
+{
+    for (int x = 0; x < sizeX; x++)
+    {
+        // prevDistRow[x] may be FLOW_FIELD_INFINITY, so we have to compute this as int
+        const int d = prevDistRow[x] + 1;
+        if (d < distRow[x])
+        {
+            distRow[x] = d;
+            seedRow[x] = prevSeedRow[x];
+            VOXEL_STATS_UPDATES(1);
+        }
+    }
+}
+
+static void flowFieldFromSeedsXPASS(const bool* seeds, uint16_t* o_distance, uint32_t* o_nearestSeed, int sizeX, int sizeY, int sizeZ)
+{
+    VOXEL_STATS_BEGIN(VOXEL_STATS_FLOW_FIELD_XPASS);
+
+    for (int z = 0; z < sizeZ; z++)
+        for (int y = 0; y < sizeY; y++)
+        {
+            const int rowStart = z * sizeX * sizeY + y * sizeX;
+
+            // distance to the last seed we saw in increasing direction
+            int lastSeed = -1;
+            for (int x = 0; x < sizeX; x++)
+            {
+                if (seeds[rowStart + x])
+                    lastSeed = x;
+                o_distance[rowStart + x] = lastSeed < 0 ? FLOW_FIELD_INFINITY : x - lastSeed;
+                o_nearestSeed[rowStart + x] = lastSeed < 0 ? FLOW_FIELD_NO_SEED : (uint32_t) (rowStart + lastSeed);
+            }
+
+            // and the same in opposite direction, keeping the closer one
+            lastSeed = -1;
+            for (int x = sizeX - 1; x >= 0; x--)
+            {
+                if (seeds[rowStart + x])
+                    lastSeed = x;
+                if (lastSeed >= 0 && lastSeed - x < o_distance[rowStart + x])
+                {
+                    o_distance[rowStart + x] = lastSeed - x;
+                    o_nearestSeed[rowStart + x] = rowStart + lastSeed;
+                }
+            }
+        }
+
+    // reads the seeds, writes distances (2 bytes) and nearest seeds (4 bytes)
+    VOXEL_STATS_END(VOXEL_STATS_FLOW_FIELD_XPASS, (uint64_t) sizeX * sizeY * sizeZ, 7ull * sizeX * sizeY * sizeZ);
+}
+
+static void flowFieldFromSeedsYPASS(uint16_t* o_distance, uint32_t* o_nearestSeed, int sizeX, int sizeY, int sizeZ)
+{
+    VOXEL_STATS_BEGIN(VOXEL_STATS_FLOW_FIELD_YPASS);
+
+    for (int z = 0; z < sizeZ; z++)
+    {
+        const int plane = z * sizeX * sizeY;
+
+        for (int y = 1; y < sizeY; y++)
+            flowFieldRelaxRow(o_distance + plane + y * sizeX, o_nearestSeed + plane + y * sizeX,
+                              o_distance + plane + (y - 1) * sizeX, o_nearestSeed + plane + (y - 1) * sizeX, sizeX);
+
+        for (int y = sizeY - 2; y >= 0; y--)
+            flowFieldRelaxRow(o_distance + plane + y * sizeX, o_nearestSeed + plane + y * sizeX,
+                              o_distance + plane + (y + 1) * sizeX, o_nearestSeed + plane + (y + 1) * sizeX, sizeX);
+    }
+
+    // reads and writes distances and nearest seeds
+    VOXEL_STATS_END(VOXEL_STATS_FLOW_FIELD_YPASS, (uint64_t) sizeX * sizeY * sizeZ, 12ull * sizeX * sizeY * sizeZ);
+}
+
+static void flowFieldFromSeedsZPASS(uint16_t* o_distance, uint32_t* o_nearestSeed, int sizeX, int sizeY, int sizeZ)
+{
+    const int planeSize = sizeX * sizeY;
+    VOXEL_STATS_BEGIN(VOXEL_STATS_FLOW_FIELD_ZPASS);
+
+    // planes are contiguous, so we relax a whole plane at once
+    for (int z = 1; z < sizeZ; z++)
+        flowFieldRelaxRow(o_distance + z * planeSize, o_nearestSeed + z * planeSize,
+                          o_distance + (z - 1) * planeSize, o_nearestSeed + (z - 1) * planeSize, planeSize);
+
+    for (int z = sizeZ - 2; z >= 0; z--)
+        flowFieldRelaxRow(o_distance + z * planeSize, o_nearestSeed + z * planeSize,
+                          o_distance + (z + 1) * planeSize, o_nearestSeed + (z + 1) * planeSize, planeSize);
+
+    VOXEL_STATS_END(VOXEL_STATS_FLOW_FIELD_ZPASS, (uint64_t) sizeX * sizeY * sizeZ, 12ull * sizeX * sizeY * sizeZ);
+}
+
+// Turns the nearest seed of every voxel into the direction to go. We step along the axis with the biggest remaining
+// difference, every step gets us exactly one closer to the seed.
+static void flowFieldFromSeedsDirections(const uint32_t* nearestSeed, uint8_t* o_direction, int sizeX, int sizeY, int sizeZ)
+{
+    VOXEL_STATS_BEGIN(VOXEL_STATS_FLOW_FIELD_DIRECTIONS);
+
+    for (int z = 0; z < sizeZ; z++)
+        for (int y = 0; y < sizeY; y++)
+            for (int x = 0; x < sizeX; x++)
+            {
+                const int index = z * sizeX * sizeY + y * sizeX + x;
+                const uint32_t seed = nearestSeed[index];
+
+                if (seed == FLOW_FIELD_NO_SEED)
+                {
+                    o_direction[index] = FLOW_FIELD_UNREACHABLE;
+                    continue;
+                }
+
+                // two divisions instead of three divisions and a modulo
+                const int seedZ = (int) seed / (sizeX * sizeY);
+                const int seedY = ((int) seed - seedZ * sizeX * sizeY) / sizeX;
+                const int seedX = (int) seed - seedZ * sizeX * sizeY - seedY * sizeX;
+
+                const int dx = seedX - x, dy = seedY - y, dz = seedZ - z;
+                const int ax = dx < 0 ? -dx : dx, ay = dy < 0 ? -dy : dy, az = dz < 0 ? -dz : dz;
+
+                if (ax == 0 && ay == 0 && az == 0)
+                    o_direction[index] = FLOW_FIELD_AT_SEED;
+                else if (ax >= ay && ax >= az)
+                    o_direction[index] = dx < 0 ? FLOW_FIELD_NEG_X : FLOW_FIELD_POS_X;
+                else if (ay >= az)
+                    o_direction[index] = dy < 0 ? FLOW_FIELD_NEG_Y : FLOW_FIELD_POS_Y;
+                else
+                    o_direction[index] = dz < 0 ? FLOW_FIELD_NEG_Z : FLOW_FIELD_POS_Z;
+            }
+
+    VOXEL_STATS_END(VOXEL_STATS_FLOW_FIELD_DIRECTIONS, (uint64_t) sizeX * sizeY * sizeZ, 5ull * sizeX * sizeY * sizeZ);
+}
+
+// o_nearestSeed is required here, as the passes need it to keep track of the seeds
+static void flowFieldFromSeeds(const bool* seeds, uint16_t* o_distance, uint32_t* o_nearestSeed, uint8_t* o_direction,
+                               int sizeX, int sizeY, int sizeZ)
+{
+    flowFieldFromSeedsXPASS(seeds, o_distance, o_nearestSeed, sizeX, sizeY, sizeZ);
+    flowFieldFromSeedsYPASS(o_distance, o_nearestSeed, sizeX, sizeY, sizeZ);
+    flowFieldFromSeedsZPASS(o_distance, o_nearestSeed, sizeX, sizeY, sizeZ);
+    flowFieldFromSeedsDirections(o_nearestSeed, o_direction, sizeX, sizeY, sizeZ);
+}
+
+/*
+ * With obstacles
+ */
+
+// queue is scratch memory for sizeX * sizeY * sizeZ indices, every voxel is put into it at most once.
+// Agents can't enter blocked voxels, seeds in blocked voxels are ignored. o_nearestSeed may be NULL.
+static void flowFieldFromSeedsBlocked(const bool* seeds, const bool* blocked, uint16_t* o_distance, uint32_t* o_nearestSeed,
+                                      uint8_t* o_direction, uint32_t* queue, int sizeX, int sizeY, int sizeZ)
+{
+    const int count = sizeX * sizeY * sizeZ;
+    int head = 0, tail = 0;
+
+    // all seeds start the search at the same time, with distance 0
+    for (int i = 0; i < count; i++)
+    {
+        if (seeds[i] && !blocked[i])
+        {
+            o_distance[i] = 0;
+            o_direction[i] = FLOW_FIELD_AT_SEED;
+            if (o_nearestSeed)
+                o_nearestSeed[i] = i;
+            queue[tail++] = i;
+        }
+        else
+        {
+            o_distance[i] = FLOW_FIELD_INFINITY;
+            o_direction[i] = FLOW_FIELD_UNREACHABLE;
+            if (o_nearestSeed)
+                o_nearestSeed[i] = FLOW_FIELD_NO_SEED;
+        }
+    }
+
+    // The first time a voxel is reached is via a shortest path. Its direction points back to the voxel we came from,
+    // which is the opposite of the direction we went (directions come in pairs: 1/2, 3/4, 5/6).
+    while (head < tail)
+    {
+        const uint32_t index = queue[head++];
+        const int x = index % sizeX, y = index / sizeX % sizeY, z = index / (sizeX * sizeY);
+        const int distance = o_distance[index] + 1;
+
+        for (int dir = FLOW_FIELD_NEG_X; dir <= FLOW_FIELD_POS_Z; dir++)
+        {
+            const int nx = x + FLOW_FIELD_OFFSETS[dir][0], ny = y + FLOW_FIELD_OFFSETS[dir][1], nz = z + FLOW_FIELD_OFFSETS[dir][2];
+            if (nx < 0 || ny < 0 || nz < 0 || nx >= sizeX || ny >= sizeY || nz >= sizeZ)
+                continue;
+
+            const uint32_t neighbour = nz * sizeX * sizeY + ny * sizeX + nx;
+            if (blocked[neighbour] || o_distance[neighbour] != FLOW_FIELD_INFINITY)
+                continue;
+
+            o_distance[neighbour] = distance < FLOW_FIELD_INFINITY ? distance : FLOW_FIELD_INFINITY - 1;
+            o_direction[neighbour] = dir & 1 ? dir + 1 : dir - 1;
+            if (o_nearestSeed)
+                o_nearestSeed[neighbour] = o_nearestSeed[index];
+            queue[tail++] = neighbour;
+        }
+    }
+}
+
+// Usage Example
+void testFlowField()
+{
+    const int SIZE = 32;
+
+    // the target, e.g. the player's position
+    bool seeds[SIZE * SIZE * SIZE];
+    memset(&seeds, 0, SIZE * SIZE * SIZE * sizeof(bool));
+    seeds[16 * SIZE * SIZE + 16 * SIZE + 16] = true;
+
+    // a wall at x = 8, with a hole at y = 30
+    bool blocked[SIZE * SIZE * SIZE];
+    memset(&blocked, 0, SIZE * SIZE * SIZE * sizeof(bool));
+    for (int z = 0; z < SIZE; z++)
+        for (int y = 0; y < SIZE - 2; y++)
+            blocked[z * SIZE * SIZE + y * SIZE + 8] = true;
+
+    uint16_t distance[SIZE * SIZE * SIZE];
+    uint8_t direction[SIZE * SIZE * SIZE];
+    uint32_t queue[SIZE * SIZE * SIZE];
+
+    flowFieldFromSeedsBlocked(seeds, blocked, distance, NULL, direction, queue, SIZE, SIZE, SIZE);
+
+    // every mob just follows the field, it walks through the hole in the wall
+    int x = 0, y = 0, z = 16;
+    while (flowFieldStep(direction, SIZE, SIZE, &x, &y, &z));
+
+    // x, y and z are now 16
+}
+
+#endif //VOXELDEVSCRIPTS_FLOWFIELD_H
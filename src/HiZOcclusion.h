@@ -0,0 +1,526 @@
+#ifndef VOXELDEVSCRIPTS_HIZOCCLUSION_H
+#define VOXELDEVSCRIPTS_HIZOCCLUSION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <immintrin.h>
+
+#include "VoxelStats.h"
+// cpmath defines generic macros (min, div, length, ...), so it has to be included after the standard headers
+#include "cpmath.h"
+
+/*
+ * CPU occlusion culling: large occluders (quads, e.g. the faces of solid chunks or building walls) are rasterised into a
+ * small depth buffer (something like 256x128), then a min/max pyramid of it is built and chunk AABBs are tested against
+ * the pyramid. Chunks behind the occluders are culled before they cost a draw call. Run it after frustum culling
+ * (cp_frustum_from_mat4 gives the planes for the same matrix).
+ *
+ * Depth is the NDC z of the OpenGL convention mapped to [0, 1] (0 near, 1 far), which is linear in screen space, so a
+ * quad's depth is a plane a * x + b * y + c. The buffer is cleared to 1.
+ *
+ * The rasteriser is conservative, it never makes something visible look occluded:
+ *  -   a pixel is only written if the quad covers all of it: every edge function is evaluated at the pixel's corner that's
+ *      closest to being outside (the center minus half the edge's gradient), so quads don't need to be split into
+ *      triangles (which would leave a line of uncovered pixels along the diagonal).
+ *  -   the depth written is the farthest depth of the quad inside of the pixel (again: center plus half the gradient).
+ *  -   quads that cross the near plane are skipped instead of clipped.
+ * The span loop tests 8 (AVX) or 4 (SSE) pixels at once.
+ *
+ * Level l of the pyramid has (width >> l) x (height >> l) texels, each with the min and max depth of the 2x2 texels below
+ * it. A box is projected (its 8 corners transformed with cp_mat4), its screen rectangle and its nearest depth give the
+ * test: we start at the level where the rectangle covers at most 2x2 texels.
+ *  -   if the nearest depth of the box is behind the max depth of all covered texels, the box is occluded.
+ *  -   if it's in front of the min depth of any covered texel, nothing below that texel can occlude it, it's visible.
+ *  -   otherwise we go down a level (up to HIZ_REFINE_LEVELS levels) and check the smaller texels.
+ * Boxes that cross the near plane are visible, boxes outside of the screen are not.
+ *
+ * Rasterisation splits the buffer into bands of HIZ_BAND_ROWS rows, every thread rasterises all occluders into its bands
+ * and builds the levels of the pyramid that only depend on them, the few small levels above are built after joining.
+ * Box tests are split across threads in ranges of boxes, like lineOfSightBatch.
+ */
+
+#define HIZ_MAX_LEVELS 8
+// how many levels below the first one a box test goes at most
+#define HIZ_REFINE_LEVELS 2
+// rows of the bands the threads rasterise, the levels up to log2(HIZ_BAND_ROWS) are built by the threads as well
+#define HIZ_BAND_ROWS 16
+// Below this many boxes per thread, starting a thread costs more than it saves.
+#define HIZ_BOXES_PER_THREAD 4096
+
+#ifdef __AVX__
+#define HIZ_F __m256
+#define HIZ_LANES 8
+#define hiz_set1 _mm256_set1_ps
+#define hiz_ramp() _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f)
+#define hiz_loadu _mm256_loadu_ps
+#define hiz_storeu _mm256_storeu_ps
+#define hiz_add _mm256_add_ps
+#define hiz_fmadd _mm256_fmadd_ps
+#define hiz_min _mm256_min_ps
+#define hiz_and _mm256_and_ps
+#define hiz_blend _mm256_blendv_ps
+#define hiz_cmpge(a, b) _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#else
+#define HIZ_F __m128
+#define HIZ_LANES 4
+#define hiz_set1 _mm_set1_ps
+#define hiz_ramp() _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f)
+#define hiz_loadu _mm_loadu_ps
+#define hiz_storeu _mm_storeu_ps
+#define hiz_add _mm_add_ps
+#define hiz_fmadd _mm_fmadd_ps
+#define hiz_min _mm_min_ps
+#define hiz_and _mm_and_ps
+#define hiz_blend _mm_blendv_ps
+#define hiz_cmpge _mm_cmpge_ps
+#endif
+
+// A planar, convex quad, the corners in order around it (either winding, occluders are double sided).
+typedef struct HiZOccluder
+{
+    cp_vec3 corners[4];
+} HiZOccluder;
+
+typedef struct HiZBuffer
+{
+    int width, height;
+    int levels;
+    float* minDepth[HIZ_MAX_LEVELS];    // (width >> l) * (height >> l) texels, row major, bottom row first
+    float* maxDepth[HIZ_MAX_LEVELS];    // level 0 is the depth buffer itself, minDepth[0] == maxDepth[0]
+    cp_mat4 viewProj;                   // of the last hiZRasterize
+} HiZBuffer;
+
+// a level for every factor of 2 of both sizes (up to HIZ_MAX_LEVELS)
+static inline int hiZLevelCount(int width, int height)
+{
+    int levels = 1;
+    while (levels < HIZ_MAX_LEVELS && (width >> levels) << levels == width && (height >> levels) << levels == height)
+        levels++;
+    return levels;
+}
+
+// floats of memory hiZInit needs
+static size_t hiZBufferFloats(int width, int height)
+{
+    size_t floats = (size_t) width * height;
+    for (int l = 1; l < hiZLevelCount(width, height); l++)
+        floats += 2 * (size_t) (width >> l) * (height >> l);
+    return floats;
+}
+
+// The width has to be a multiple of 8, memory needs hiZBufferFloats(width, height) floats.
+static void hiZInit(HiZBuffer* hiz, float* memory, int width, int height)
+{
+    *hiz = (HiZBuffer) {.width = width, .height = height, .levels = hiZLevelCount(width, height)};
+    hiz->minDepth[0] = hiz->maxDepth[0] = memory;
+    memory += (size_t) width * height;
+
+    for (int l = 1; l < hiz->levels; l++)
+    {
+        const size_t texels = (size_t) (width >> l) * (height >> l);
+        hiz->minDepth[l] = memory;
+        hiz->maxDepth[l] = memory + texels;
+        memory += 2 * texels;
+    }
+}
+
+/**
+ * Rasterisation
+ */
+
+// the screen space version of an occluder: inside if a[i] * x + b[i] * y + c[i] >= 0 for all edges
+typedef struct HiZScreenQuad
+{
+    float edgeA[4], edgeB[4], edgeC[4];
+    float depthA, depthB, depthC;
+    float minX, maxX, minY, maxY;
+} HiZScreenQuad;
+
+// false if the occluder can't be rasterised (crosses the near plane, is seen edge on or is off screen)
+static bool hiZSetupOccluder(const HiZBuffer* hiz, const HiZOccluder* occluder, HiZScreenQuad* o_quad)
+{
+    float x[4], y[4], depth[4];
+
+    for (int i = 0; i < 4; i++)
+    {
+        const cp_vec4 corner = {.x = occluder->corners[i].x, .y = occluder->corners[i].y, .z = occluder->corners[i].z, .w = 1.0f};
+        const cp_vec4 clip = cp_mat4_mul_vec4(&hiz->viewProj, corner);
+        if (clip.w <= 0.0f || clip.z < -clip.w)
+            return false;
+
+        x[i] = (clip.x / clip.w * 0.5f + 0.5f) * (float) hiz->width;
+        y[i] = (clip.y / clip.w * 0.5f + 0.5f) * (float) hiz->height;
+        depth[i] = clip.z / clip.w * 0.5f + 0.5f;
+    }
+
+    // twice the signed area, the edge functions below are positive inside of counter clockwise quads
+    float area = 0.0f;
+    for (int i = 0; i < 4; i++)
+        area += x[i] * y[(i + 1) & 3] - x[(i + 1) & 3] * y[i];
+    if (fabsf(area) < 1.0f)
+        return false;
+
+    const float winding = area > 0.0f ? 1.0f : -1.0f;
+    for (int i = 0; i < 4; i++)
+    {
+        const int j = (i + 1) & 3;
+        const float a = winding * (y[i] - y[j]), b = winding * (x[j] - x[i]);
+        o_quad->edgeA[i] = a;
+        o_quad->edgeB[i] = b;
+        // at the pixel corner that's furthest outside instead of the center, so only fully covered pixels pass
+        o_quad->edgeC[i] = -(a * x[i] + b * y[i]) - 0.5f * (fabsf(a) + fabsf(b));
+    }
+
+    // depth plane through the first 3 corners (the quad is planar, so the 4th is on it as well), moved to the farthest
+    // depth inside of the pixel
+    const float ux = x[1] - x[0], uy = y[1] - y[0], ud = depth[1] - depth[0];
+    const float vx = x[2] - x[0], vy = y[2] - y[0], vd = depth[2] - depth[0];
+    const float det = ux * vy - vx * uy;
+    if (fabsf(det) < 1e-6f)
+        return false;
+
+    o_quad->depthA = (ud * vy - vd * uy) / det;
+    o_quad->depthB = (vd * ux - ud * vx) / det;
+    o_quad->depthC = depth[0] - o_quad->depthA * x[0] - o_quad->depthB * y[0] + 0.5f * (fabsf(o_quad->depthA) + fabsf(o_quad->depthB));
+
+    o_quad->minX = cp_minf(cp_minf(x[0], x[1]), cp_minf(x[2], x[3]));
+    o_quad->maxX = cp_maxf(cp_maxf(x[0], x[1]), cp_maxf(x[2], x[3]));
+    o_quad->minY = cp_minf(cp_minf(y[0], y[1]), cp_minf(y[2], y[3]));
+    o_quad->maxY = cp_maxf(cp_maxf(y[0], y[1]), cp_maxf(y[2], y[3]));
+    return o_quad->maxX > 0.0f && o_quad->minX < (float) hiz->width && o_quad->maxY > 0.0f && o_quad->minY < (float) hiz->height;
+}
+
+// rasterises the rows [rowBegin, rowEnd) of quad
+static void hiZRasterizeQuad(HiZBuffer* hiz, const HiZScreenQuad* quad, int rowBegin, int rowEnd)
+{
+    // only whole pixels are covered, so the pixel range is inside of the bounds. x is aligned to the lanes, the width is
+    // a multiple of them
+    const int x0 = (int) cp_maxf(0.0f, floorf(quad->minX)) / HIZ_LANES * HIZ_LANES;
+    const int x1 = (int) cp_minf((float) hiz->width, ceilf(quad->maxX));
+    const int y0 = (int) cp_maxf((float) rowBegin, floorf(quad->minY));
+    const int y1 = (int) cp_minf((float) rowEnd, ceilf(quad->maxY));
+
+    HIZ_F edgeA[4], edgeB[4], edgeC[4];
+    for (int e = 0; e < 4; e++)
+    {
+        edgeA[e] = hiz_set1(quad->edgeA[e]);
+        edgeB[e] = hiz_set1(quad->edgeB[e]);
+        edgeC[e] = hiz_set1(quad->edgeC[e]);
+    }
+    const HIZ_F depthA = hiz_set1(quad->depthA), depthB = hiz_set1(quad->depthB), depthC = hiz_set1(quad->depthC);
+    const HIZ_F zero = hiz_set1(0.0f), ramp = hiz_ramp();
+
+    for (int y = y0; y < y1; y++)
+    {
+        const HIZ_F py = hiz_set1((float) y + 0.5f);
+        float* row = hiz->minDepth[0] + (size_t) y * hiz->width;
+
+        // the parts of the edge functions and the depth that only depend on y
+        HIZ_F rowC[4];
+        for (int e = 0; e < 4; e++)
+            rowC[e] = hiz_fmadd(edgeB[e], py, edgeC[e]);
+        const HIZ_F rowDepth = hiz_fmadd(depthB, py, depthC);
+
+        for (int x = x0; x < x1; x += HIZ_LANES)
+        {
+            const HIZ_F px = hiz_add(hiz_set1((float) x), ramp);
+            HIZ_F inside = hiz_cmpge(hiz_fmadd(edgeA[0], px, rowC[0]), zero);
+            inside = hiz_and(inside, hiz_cmpge(hiz_fmadd(edgeA[1], px, rowC[1]), zero));
+            inside = hiz_and(inside, hiz_cmpge(hiz_fmadd(edgeA[2], px, rowC[2]), zero));
+            inside = hiz_and(inside, hiz_cmpge(hiz_fmadd(edgeA[3], px, rowC[3]), zero));
+
+            const HIZ_F current = hiz_loadu(row + x);
+            const HIZ_F depth = hiz_min(current, hiz_fmadd(depthA, px, rowDepth));
+            hiz_storeu(row + x, hiz_blend(current, depth, inside));
+        }
+    }
+}
+
+// builds the levels [firstLevel, lastLevel] of the pyramid above the level 0 rows [rowBegin, rowEnd), both multiples of
+// the texel size of lastLevel
+static void hiZBuildLevels(HiZBuffer* hiz, int firstLevel, int lastLevel, int rowBegin, int rowEnd)
+{
+    for (int l = firstLevel; l <= lastLevel; l++)
+    {
+        const int width = hiz->width >> l, below = hiz->width >> (l - 1);
+        const float* minBelow = hiz->minDepth[l - 1];
+        const float* maxBelow = hiz->maxDepth[l - 1];
+
+        for (int y = rowBegin >> l; y < rowEnd >> l; y++)
+        {
+            const float* min0 = minBelow + (size_t) 2 * y * below, * min1 = min0 + below;
+            const float* max0 = maxBelow + (size_t) 2 * y * below, * max1 = max0 + below;
+            float* minRow = hiz->minDepth[l] + (size_t) y * width;
+            float* maxRow = hiz->maxDepth[l] + (size_t) y * width;
+
+            for (int x = 0; x < width; x++)
+            {
+                minRow[x] = cp_minf(cp_minf(min0[2 * x], min0[2 * x + 1]), cp_minf(min1[2 * x], min1[2 * x + 1]));
+                maxRow[x] = cp_maxf(cp_maxf(max0[2 * x], max0[2 * x + 1]), cp_maxf(max1[2 * x], max1[2 * x + 1]));
+            }
+        }
+    }
+}
+
+// the last level the threads build for their bands
+static inline int hiZBandLevel(const HiZBuffer* hiz)
+{
+    int level = 0;
+    while (level < hiz->levels - 1 && 2 << level <= HIZ_BAND_ROWS && hiz->height % (2 << level) == 0)
+        level++;
+    return level;
+}
+
+typedef struct HiZRasterizeJob
+{
+    HiZBuffer* hiz;
+    const HiZOccluder* occluders;
+    int count;
+    int rowBegin, rowEnd;
+    VoxelStats* stats;      // of the calling thread, the workers record into it as well
+} HiZRasterizeJob;
+
+static void* hiZRasterizeWorker(void* arg)
+{
+    HiZRasterizeJob* job = arg;
+    VoxelStats* previousStats = voxelStatsBind(job->stats);
+    HiZBuffer* hiz = job->hiz;
+    VOXEL_STATS_BEGIN(VOXEL_STATS_HIZ_RASTERIZE);
+
+    float* depth = hiz->minDepth[0] + (size_t) job->rowBegin * hiz->width;
+    for (size_t i = 0; i < (size_t) (job->rowEnd - job->rowBegin) * hiz->width; i++)
+        depth[i] = 1.0f;
+
+    // every band sets up all occluders itself, that's a few matrix multiplications per occluder and saves a sync point
+    for (int i = 0; i < job->count; i++)
+    {
+        HiZScreenQuad quad;
+        if (hiZSetupOccluder(hiz, job->occluders + i, &quad) && quad.maxY > (float) job->rowBegin && quad.minY < (float) job->rowEnd)
+            hiZRasterizeQuad(hiz, &quad, job->rowBegin, job->rowEnd);
+    }
+
+    hiZBuildLevels(hiz, 1, hiZBandLevel(hiz), job->rowBegin, job->rowEnd);
+
+    // the band's depth rows, read and written, and its part of the pyramid
+    VOXEL_STATS_END(VOXEL_STATS_HIZ_RASTERIZE, (uint64_t) (job->rowEnd - job->rowBegin) * hiz->width,
+                    (uint64_t) (job->rowEnd - job->rowBegin) * hiz->width * 3 * sizeof(float));
+    voxelStatsBind(previousStats);
+    return NULL;
+}
+
+// Clears hiz and rasterises the occluders seen through viewProj (projection * view) into it, then builds the pyramid.
+// threadCount <= 0 uses one thread per online CPU.
+static void hiZRasterize(HiZBuffer* hiz, const cp_mat4* viewProj, const HiZOccluder* occluders, int count, int threadCount)
+{
+    hiz->viewProj = *viewProj;
+
+    const int bandAlign = 1 << hiZBandLevel(hiz);
+    const int bandCount = hiz->height / bandAlign;
+    if (threadCount <= 0)
+        threadCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadCount > bandCount)
+        threadCount = bandCount;
+    if (threadCount < 1)
+        threadCount = 1;
+
+    const int bandsPerThread = (bandCount + threadCount - 1) / threadCount;
+    HiZRasterizeJob jobs[threadCount];
+    pthread_t threads[threadCount];
+    int started = 0;
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        const int begin = i * bandsPerThread * bandAlign, end = (i + 1) * bandsPerThread * bandAlign;
+        jobs[i] = (HiZRasterizeJob) {hiz, occluders, count, begin < hiz->height ? begin : hiz->height,
+                                     end < hiz->height ? end : hiz->height, voxelStatsGetCurrent()};
+    }
+
+    for (int i = 1; i < threadCount; i++)
+        if (pthread_create(&threads[started], NULL, hiZRasterizeWorker, &jobs[i]) == 0)
+            started++;
+        else
+            hiZRasterizeWorker(&jobs[i]);
+
+    hiZRasterizeWorker(&jobs[0]);
+
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    hiZBuildLevels(hiz, hiZBandLevel(hiz) + 1, hiz->levels - 1, 0, hiz->height);
+}
+
+/**
+ * Box tests
+ */
+
+// true if the box may be visible
+static bool hiZTestAabb(const HiZBuffer* hiz, cp_aabb box)
+{
+    const cp_mat4* m = &hiz->viewProj;
+
+    // corner (x, y, z) is col0 * x + col1 * y + col2 * z + col3, so the 8 corners are sums of 6 products
+    const __m128 xs[2] = {_mm_mul_ps(m->cols[0].i, _mm_set1_ps(box.min.x)), _mm_mul_ps(m->cols[0].i, _mm_set1_ps(box.max.x))};
+    const __m128 ys[2] = {_mm_mul_ps(m->cols[1].i, _mm_set1_ps(box.min.y)), _mm_mul_ps(m->cols[1].i, _mm_set1_ps(box.max.y))};
+    const __m128 zs[2] = {_mm_fmadd_ps(m->cols[2].i, _mm_set1_ps(box.min.z), m->cols[3].i),
+                          _mm_fmadd_ps(m->cols[2].i, _mm_set1_ps(box.max.z), m->cols[3].i)};
+
+    __m128 lo = _mm_set1_ps(INFINITY), hi = _mm_set1_ps(-INFINITY);
+    for (int c = 0; c < 8; c++)
+    {
+        const __m128 clip = _mm_add_ps(_mm_add_ps(xs[c & 1], ys[(c >> 1) & 1]), zs[c >> 2]);
+        const __m128 w = _mm_shuffle_ps(clip, clip, _MM_SHUFFLE(3, 3, 3, 3));
+        // a corner behind the camera: the box crosses the near plane (or is behind us, which the frustum test takes care of)
+        if (_mm_cvtss_f32(w) <= 0.0f)
+            return true;
+
+        const __m128 ndc = _mm_div_ps(clip, w);
+        lo = _mm_min_ps(lo, ndc);
+        hi = _mm_max_ps(hi, ndc);
+    }
+
+    // a corner in front of the near plane
+    const cp_vec4 ndcMin = {.i = lo}, ndcMax = {.i = hi};
+    if (ndcMin.z < -1.0f)
+        return true;
+    if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f || ndcMin.z > 1.0f)
+        return false;
+
+    const float width = (float) hiz->width, height = (float) hiz->height;
+    const int px0 = (int) cp_maxf(0.0f, (ndcMin.x * 0.5f + 0.5f) * width);
+    const int px1 = (int) cp_minf(width - 1.0f, (ndcMax.x * 0.5f + 0.5f) * width);
+    const int py0 = (int) cp_maxf(0.0f, (ndcMin.y * 0.5f + 0.5f) * height);
+    const int py1 = (int) cp_minf(height - 1.0f, (ndcMax.y * 0.5f + 0.5f) * height);
+    const float nearest = ndcMin.z * 0.5f + 0.5f;
+
+    // the first level where the rectangle covers at most 2x2 texels
+    int level = 0;
+    while (level < hiz->levels - 1 && ((px1 >> level) - (px0 >> level) > 1 || (py1 >> level) - (py0 >> level) > 1))
+        level++;
+
+    for (int l = level; l >= 0 && l >= level - HIZ_REFINE_LEVELS; l--)
+    {
+        const int levelWidth = hiz->width >> l;
+        bool occluded = true;
+
+        for (int y = py0 >> l; y <= py1 >> l; y++)
+            for (int x = px0 >> l; x <= px1 >> l; x++)
+            {
+                if (hiz->minDepth[l][y * levelWidth + x] >= nearest)
+                    return true;
+                if (hiz->maxDepth[l][y * levelWidth + x] >= nearest)
+                    occluded = false;
+            }
+
+        if (occluded)
+            return false;
+    }
+
+    return true;
+}
+
+static void hiZCullRange(const HiZBuffer* hiz, const cp_aabb_soa* boxes, int begin, int end, uint64_t* o_visible)
+{
+    VOXEL_STATS_BEGIN(VOXEL_STATS_HIZ_CULL);
+
+    for (int i = begin; i < end; i++)
+    {
+        const cp_aabb box = {.min = {.x = boxes->minX[i], .y = boxes->minY[i], .z = boxes->minZ[i]},
+                             .max = {.x = boxes->maxX[i], .y = boxes->maxY[i], .z = boxes->maxZ[i]}};
+        if (hiZTestAabb(hiz, box))
+            o_visible[i >> 6] |= 1ull << (i & 63);
+    }
+
+    // the texels that are read depend on the boxes, only the boxes and the results are counted
+    VOXEL_STATS_END(VOXEL_STATS_HIZ_CULL, end - begin, (uint64_t) (end - begin) * 6 * sizeof(float) + (end - begin + 7) / 8);
+}
+
+typedef struct HiZCullJob
+{
+    const HiZBuffer* hiz;
+    const cp_aabb_soa* boxes;
+    int begin, end;
+    uint64_t* o_visible;
+    VoxelStats* stats;
+} HiZCullJob;
+
+static void* hiZCullWorker(void* arg)
+{
+    HiZCullJob* job = arg;
+    VoxelStats* previousStats = voxelStatsBind(job->stats);
+    hiZCullRange(job->hiz, job->boxes, job->begin, job->end, job->o_visible);
+    voxelStatsBind(previousStats);
+    return NULL;
+}
+
+// Tests the boxes against the buffer of the last hiZRasterize and sets bit i % 64 of o_visible[i / 64] if box i may be
+// visible. o_visible needs (boxes->count + 63) / 64 words. threadCount <= 0 uses one thread per online CPU (large
+// batches only).
+static void hiZCullAabbs(const HiZBuffer* hiz, const cp_aabb_soa* boxes, uint64_t* o_visible, int threadCount)
+{
+    const int count = (int) boxes->count;
+    memset(o_visible, 0, (size_t) (count + 63) / 64 * sizeof(uint64_t));
+
+    if (threadCount <= 0)
+        threadCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadCount > count / HIZ_BOXES_PER_THREAD)
+        threadCount = count / HIZ_BOXES_PER_THREAD;
+    if (threadCount < 1)
+        threadCount = 1;
+
+    // every thread gets a range of whole words of the bitmask, so no two threads write to the same word
+    const int wordsPerThread = (count + 63) / 64 / threadCount + 1;
+    HiZCullJob jobs[threadCount];
+    pthread_t threads[threadCount];
+    int started = 0;
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        const int begin = i * wordsPerThread * 64, end = (i + 1) * wordsPerThread * 64;
+        jobs[i] = (HiZCullJob) {hiz, boxes, begin < count ? begin : count, end < count ? end : count, o_visible, voxelStatsGetCurrent()};
+    }
+
+    for (int i = 1; i < threadCount; i++)
+        if (pthread_create(&threads[started], NULL, hiZCullWorker, &jobs[i]) == 0)
+            started++;
+        else
+            hiZCullWorker(&jobs[i]);
+
+    hiZCullWorker(&jobs[0]);
+
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+}
+
+// Usage Example
+void testHiZOcclusion()
+{
+    static float memory[256 * 128 * 2];
+    HiZBuffer hiz;
+    hiZInit(&hiz, memory, 256, 128);     // hiZBufferFloats(256, 128) <= 256 * 128 * 2
+
+    // camera at the origin looking along -z, a 20x10 wall 10 units in front of it
+    const cp_mat4 projection = cp_mat4_perspective(cp_radiansf(90.0f), 2.0f, 0.1f, 1000.0f);
+    const cp_mat4 view = cp_mat4_look_at((cp_vec3) {.x = 0.0f, .y = 0.0f, .z = 0.0f}, (cp_vec3) {.x = 0.0f, .y = 0.0f, .z = -1.0f},
+                                         (cp_vec3) {.x = 0.0f, .y = 1.0f, .z = 0.0f});
+    const cp_mat4 viewProj = cp_mat4_mul(&projection, &view);
+    const HiZOccluder wall = {.corners = {
+        {.x = -10.0f, .y = -5.0f, .z = -10.0f}, {.x = 10.0f, .y = -5.0f, .z = -10.0f},
+        {.x = 10.0f, .y = 5.0f, .z = -10.0f}, {.x = -10.0f, .y = 5.0f, .z = -10.0f},
+    }};
+    hiZRasterize(&hiz, &viewProj, &wall, 1, 1);
+
+    // a chunk right behind the wall and one off to the side
+    float minX[2] = {-2.0f, 60.0f}, minY[2] = {-2.0f, -2.0f}, minZ[2] = {-40.0f, -40.0f};
+    float maxX[2] = {2.0f, 64.0f}, maxY[2] = {2.0f, 2.0f}, maxZ[2] = {-36.0f, -36.0f};
+    const cp_aabb_soa boxes = {minX, minY, minZ, maxX, maxY, maxZ, 2};
+    uint64_t visible[1];
+    hiZCullAabbs(&hiz, &boxes, visible, 1);
+
+    // visible[0] == 2: the first chunk is hidden by the wall
+}
+
+#endif //VOXELDEVSCRIPTS_HIZOCCLUSION_H
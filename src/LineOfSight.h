@@ -0,0 +1,315 @@
+#ifndef VOXELDEVSCRIPTS_LINEOFSIGHT_H
+#define VOXELDEVSCRIPTS_LINEOFSIGHT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "VoxelStats.h"
+// cpmath defines generic macros (min, div, length, ...), so it has to be included after the standard headers
+#include "cpmath.h"
+
+/*
+ * Line of sight checks ("can A see B") against the voxels of a Manhattan distance field (BoolArrToManhattan.h), voxels
+ * with distance 0 are solid. Voxel (x, y, z) occupies [x, x + 1] x [y, y + 1] x [z, z + 1], positions are in voxels.
+ * B is visible from A if the segment between them doesn't pass through a solid voxel (the voxels of A and B included).
+ *
+ * We walk along the segment and look at the distance field at the current point:
+ *  -   if the voxel has the distance D, every point of a solid voxel is at least D - 3 away (Manhattan distance, every
+ *      axis can lose up to one voxel because the point can be anywhere in its voxel), so we can jump D - 3 ahead.
+ *  -   close to geometry (D < 4), we step to the next voxel along the segment, like a regular DDA would.
+ *  -   D == 0 means we hit a solid voxel.
+ * In open space this needs a handful of lookups instead of one per voxel. Segments that only graze the edge or corner of a
+ * solid voxel (by less than LINE_OF_SIGHT_EPSILON) may miss it.
+ *
+ * The batch version runs 8 queries at once in AVX2 lanes. Every lane has its own position along its segment and is refilled
+ * with the next query as soon as its current one terminates, so long and short queries don't hold each other up.
+ * Large batches are split across threads. Voxels outside of the volume are treated as empty.
+ */
+
+// the DDA steps land this far (in voxels) behind the voxel boundary, so the next lookup is in the next voxel
+#define LINE_OF_SIGHT_EPSILON 0.0001f
+
+// Lower bound of the Manhattan distance (in voxels) from voxel (x, y, z) to the closest solid voxel.
+// Outside of the volume, the distance to the volume is added to the distance of the closest voxel inside of it.
+static inline int lineOfSightDistance(const uint8_t* distanceField, int sizeX, int sizeY, int sizeZ, int x, int y, int z)
+{
+    const int cx = x < 0 ? 0 : x >= sizeX ? sizeX - 1 : x;
+    const int cy = y < 0 ? 0 : y >= sizeY ? sizeY - 1 : y;
+    const int cz = z < 0 ? 0 : z >= sizeZ ? sizeZ - 1 : z;
+    const int outside = abs(x - cx) + abs(y - cy) + abs(z - cz);
+
+    return outside + distanceField[(uint64_t) cz * sizeX * sizeY + (uint64_t) cy * sizeX + cx];
+}
+
+// The t (0 at from, 1 at to) at which the segment leaves the voxel containing from + direction * t.
+static inline float lineOfSightNextVoxel(const float from[3], const float direction[3], float t)
+{
+    float next = INFINITY;
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (direction[i] == 0.0f)
+            continue;
+
+        const float p = from[i] + direction[i] * t;
+        const float boundary = direction[i] > 0.0f ? floorf(p) + 1.0f : floorf(p);
+        const float tBoundary = (boundary - from[i]) / direction[i];
+        next = fminf(next, tBoundary);
+    }
+
+    return next;
+}
+
+// Returns true if to is visible from from.
+static bool lineOfSight(const uint8_t* distanceField, int sizeX, int sizeY, int sizeZ, cp_vec3 from, cp_vec3 to)
+{
+    const float f[3] = {from.x, from.y, from.z};
+    const float d[3] = {to.x - from.x, to.y - from.y, to.z - from.z};
+    const float lengthL1 = fabsf(d[0]) + fabsf(d[1]) + fabsf(d[2]);
+    const float maxComponent = fmaxf(fabsf(d[0]), fmaxf(fabsf(d[1]), fabsf(d[2])));
+    const float epsilon = maxComponent > 0.0f ? LINE_OF_SIGHT_EPSILON / maxComponent : 1.0f;
+    float t = 0.0f;
+
+    while (true)
+    {
+        const int distance = lineOfSightDistance(distanceField, sizeX, sizeY, sizeZ, (int) floorf(f[0] + d[0] * t),
+                                                 (int) floorf(f[1] + d[1] * t), (int) floorf(f[2] + d[2] * t));
+        if (distance == 0)
+            return false;
+
+        if (distance >= 4)
+            t += (float) (distance - 3) / lengthL1;
+        else
+            t = fmaxf(lineOfSightNextVoxel(f, d, t), t) + epsilon;
+
+        if (t > 1.0f)
+            return true;
+    }
+}
+
+#ifdef __AVX2__
+// State of the 8 lanes of lineOfSightRange, one query per lane.
+typedef struct LineOfSightLanes
+{
+    float fromX[8], fromY[8], fromZ[8];
+    float directionX[8], directionY[8], directionZ[8];
+    float invLengthL1[8];
+    float epsilon[8];
+    float t[8];
+    int query[8];
+} LineOfSightLanes;
+
+static inline void lineOfSightLoadLane(LineOfSightLanes* lanes, int lane, int query, cp_vec3 from, cp_vec3 to)
+{
+    const float dx = to.x - from.x, dy = to.y - from.y, dz = to.z - from.z;
+    const float lengthL1 = fabsf(dx) + fabsf(dy) + fabsf(dz);
+    const float maxComponent = fmaxf(fabsf(dx), fmaxf(fabsf(dy), fabsf(dz)));
+
+    lanes->fromX[lane] = from.x, lanes->fromY[lane] = from.y, lanes->fromZ[lane] = from.z;
+    lanes->directionX[lane] = dx, lanes->directionY[lane] = dy, lanes->directionZ[lane] = dz;
+    // a zero length segment only checks its voxel, the first step ends it
+    lanes->invLengthL1[lane] = lengthL1 > 0.0f ? 1.0f / lengthL1 : INFINITY;
+    lanes->epsilon[lane] = maxComponent > 0.0f ? LINE_OF_SIGHT_EPSILON / maxComponent : 2.0f;
+    lanes->t[lane] = 0.0f;
+    lanes->query[lane] = query;
+}
+
+// t of the next voxel boundary along one axis, +infinity if the segment is parallel to it
+static inline __m256 lineOfSightNextBoundary8(__m256 from, __m256 direction, __m256 p)
+{
+    __m256 positive = _mm256_cmp_ps(direction, _mm256_setzero_ps(), _CMP_GT_OQ);
+    __m256 boundary = _mm256_add_ps(_mm256_floor_ps(p), _mm256_and_ps(positive, _mm256_set1_ps(1.0f)));
+    __m256 t = _mm256_div_ps(_mm256_sub_ps(boundary, from), direction);
+    return _mm256_blendv_ps(t, _mm256_set1_ps(INFINITY), _mm256_cmp_ps(direction, _mm256_setzero_ps(), _CMP_EQ_OQ));
+}
+#endif
+
+// Checks the queries [begin, end) and sets bit i of o_visible for every visible query i. The words of o_visible covering
+// the range must be zeroed, begin and end must be multiples of 64 (except for end == count) if threads share o_visible.
+static void lineOfSightRange(const uint8_t* distanceField, int sizeX, int sizeY, int sizeZ, const cp_vec3* from, const cp_vec3* to,
+                             int begin, int end, uint64_t* o_visible)
+{
+    int next = begin;
+    VOXEL_STATS_BEGIN(VOXEL_STATS_LINE_OF_SIGHT);
+
+#ifdef __AVX2__
+    LineOfSightLanes lanes;
+    uint32_t active = 0;
+
+    for (int lane = 0; lane < 8 && next < end; lane++, next++)
+    {
+        lineOfSightLoadLane(&lanes, lane, next, from[next], to[next]);
+        active |= 1u << lane;
+    }
+
+    const __m256i sizeX8 = _mm256_set1_epi32(sizeX), sizeY8 = _mm256_set1_epi32(sizeY), sizeZ8 = _mm256_set1_epi32(sizeZ);
+    const __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi32(1);
+
+    // only the full lanes are run with SIMD, the last few queries (fewer than 8 in flight) are finished one by one below
+    while (active == 0xFF)
+    {
+        const __m256 fx = _mm256_loadu_ps(lanes.fromX), fy = _mm256_loadu_ps(lanes.fromY), fz = _mm256_loadu_ps(lanes.fromZ);
+        const __m256 dx = _mm256_loadu_ps(lanes.directionX), dy = _mm256_loadu_ps(lanes.directionY), dz = _mm256_loadu_ps(lanes.directionZ);
+        const __m256 t = _mm256_loadu_ps(lanes.t);
+
+        const __m256 px = _mm256_fmadd_ps(dx, t, fx), py = _mm256_fmadd_ps(dy, t, fy), pz = _mm256_fmadd_ps(dz, t, fz);
+        const __m256i vx = _mm256_cvttps_epi32(_mm256_floor_ps(px));
+        const __m256i vy = _mm256_cvttps_epi32(_mm256_floor_ps(py));
+        const __m256i vz = _mm256_cvttps_epi32(_mm256_floor_ps(pz));
+
+        // clamp to the volume, the distance to the volume is added to the distance field value
+        const __m256i cx = _mm256_max_epi32(_mm256_min_epi32(vx, _mm256_sub_epi32(sizeX8, one)), zero);
+        const __m256i cy = _mm256_max_epi32(_mm256_min_epi32(vy, _mm256_sub_epi32(sizeY8, one)), zero);
+        const __m256i cz = _mm256_max_epi32(_mm256_min_epi32(vz, _mm256_sub_epi32(sizeZ8, one)), zero);
+        const __m256i outside = _mm256_add_epi32(_mm256_abs_epi32(_mm256_sub_epi32(vx, cx)),
+                                                 _mm256_add_epi32(_mm256_abs_epi32(_mm256_sub_epi32(vy, cy)), _mm256_abs_epi32(_mm256_sub_epi32(vz, cz))));
+        const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_add_epi32(_mm256_mullo_epi32(cz, sizeY8), cy), sizeX8), cx);
+
+        // the field is made of bytes, an 8 lane gather of 32 bit values could read past the end of it
+        int32_t indices[8];
+        _mm256_storeu_si256((__m256i*) indices, index);
+        const __m256i samples = _mm256_setr_epi32(distanceField[indices[0]], distanceField[indices[1]], distanceField[indices[2]],
+                                                  distanceField[indices[3]], distanceField[indices[4]], distanceField[indices[5]],
+                                                  distanceField[indices[6]], distanceField[indices[7]]);
+        const __m256i distance = _mm256_add_epi32(samples, outside);
+
+        // jump D - 3 ahead in open space, go to the next voxel close to geometry
+        const __m256 jump = _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(distance, _mm256_set1_epi32(3))), _mm256_loadu_ps(lanes.invLengthL1), t);
+        __m256 dda = _mm256_min_ps(lineOfSightNextBoundary8(fx, dx, px), _mm256_min_ps(lineOfSightNextBoundary8(fy, dy, py), lineOfSightNextBoundary8(fz, dz, pz)));
+        dda = _mm256_add_ps(_mm256_max_ps(dda, t), _mm256_loadu_ps(lanes.epsilon));
+        const __m256 far = _mm256_castsi256_ps(_mm256_cmpgt_epi32(distance, _mm256_set1_epi32(3)));
+        const __m256 tNext = _mm256_blendv_ps(dda, jump, far);
+        _mm256_storeu_ps(lanes.t, tNext);
+
+        // lanes terminate when they hit a solid voxel or pass the end of their segment
+        const uint32_t blocked = (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(distance, zero)));
+        const uint32_t visible = (uint32_t) _mm256_movemask_ps(_mm256_cmp_ps(tNext, _mm256_set1_ps(1.0f), _CMP_GT_OQ)) & ~blocked;
+
+        for (uint32_t done = blocked | visible; done; done &= done - 1)
+        {
+            const int lane = __builtin_ctz(done);
+            const int query = lanes.query[lane];
+            if ((visible >> lane) & 1)
+                o_visible[query >> 6] |= 1ull << (query & 63);
+
+            if (next < end)
+            {
+                lineOfSightLoadLane(&lanes, lane, next, from[next], to[next]);
+                next++;
+            }
+            else
+                active &= ~(1u << lane);
+        }
+    }
+
+    // the queries still in flight restart with the scalar version
+    for (int lane = 0; lane < 8; lane++)
+        if ((active >> lane) & 1)
+        {
+            const int query = lanes.query[lane];
+            if (lineOfSight(distanceField, sizeX, sizeY, sizeZ, from[query], to[query]))
+                o_visible[query >> 6] |= 1ull << (query & 63);
+        }
+#endif
+
+    for (; next < end; next++)
+        if (lineOfSight(distanceField, sizeX, sizeY, sizeZ, from[next], to[next]))
+            o_visible[next >> 6] |= 1ull << (next & 63);
+
+    // the traffic depends on how far the rays get, only the queries and the results are counted
+    VOXEL_STATS_END(VOXEL_STATS_LINE_OF_SIGHT, end - begin, (uint64_t) (end - begin) * 2 * sizeof(cp_vec3) + (end - begin + 7) / 8);
+}
+
+typedef struct LineOfSightJob
+{
+    const uint8_t* distanceField;
+    int sizeX, sizeY, sizeZ;
+    const cp_vec3* from;
+    const cp_vec3* to;
+    int begin, end;
+    uint64_t* o_visible;
+    VoxelStats* stats;      // of the calling thread, the workers record into it as well
+} LineOfSightJob;
+
+static void* lineOfSightWorker(void* arg)
+{
+    LineOfSightJob* job = arg;
+    VoxelStats* previousStats = voxelStatsBind(job->stats);
+    lineOfSightRange(job->distanceField, job->sizeX, job->sizeY, job->sizeZ, job->from, job->to, job->begin, job->end, job->o_visible);
+    voxelStatsBind(previousStats);
+    return NULL;
+}
+
+// Below this many queries per thread, starting a thread costs more than it saves.
+#define LINE_OF_SIGHT_QUERIES_PER_THREAD 4096
+
+// Checks count (from[i], to[i]) pairs and sets bit i % 64 of o_visible[i / 64] if to[i] is visible from from[i].
+// o_visible needs (count + 63) / 64 words. threadCount <= 0 uses one thread per online CPU (large batches only).
+static void lineOfSightBatch(const uint8_t* distanceField, int sizeX, int sizeY, int sizeZ, const cp_vec3* from, const cp_vec3* to,
+                             int count, uint64_t* o_visible, int threadCount)
+{
+    VOXEL_STATS_BEGIN(VOXEL_STATS_LINE_OF_SIGHT_BATCH);
+    memset(o_visible, 0, (size_t) (count + 63) / 64 * sizeof(uint64_t));
+
+    if (threadCount <= 0)
+        threadCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadCount > count / LINE_OF_SIGHT_QUERIES_PER_THREAD)
+        threadCount = count / LINE_OF_SIGHT_QUERIES_PER_THREAD;
+    if (threadCount < 1)
+        threadCount = 1;
+
+    // every thread gets a range of whole words of the bitmask, so no two threads write to the same word
+    const int wordsPerThread = (count + 63) / 64 / threadCount + 1;
+    LineOfSightJob jobs[threadCount];
+    pthread_t threads[threadCount];
+    int started = 0;
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        const int begin = i * wordsPerThread * 64, end = (i + 1) * wordsPerThread * 64;
+        jobs[i] = (LineOfSightJob) {distanceField, sizeX, sizeY, sizeZ, from, to,
+                                    begin < count ? begin : count, end < count ? end : count, o_visible, voxelStatsGetCurrent()};
+    }
+
+    for (int i = 1; i < threadCount; i++)
+        if (pthread_create(&threads[started], NULL, lineOfSightWorker, &jobs[i]) == 0)
+            started++;
+        else
+            lineOfSightWorker(&jobs[i]);
+
+    lineOfSightWorker(&jobs[0]);
+
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    VOXEL_STATS_END(VOXEL_STATS_LINE_OF_SIGHT_BATCH, count, (uint64_t) count * 2 * sizeof(cp_vec3) + (count + 7) / 8);
+}
+
+// Usage Example
+void testLineOfSight()
+{
+    const int SIZE = 32;
+
+    // an empty volume with a wall at x = 16 (usually the distance field comes from boolArrToManhattanDF)
+    uint8_t distanceField[SIZE * SIZE * SIZE];
+    for (int i = 0; i < SIZE * SIZE * SIZE; i++)
+        distanceField[i] = (uint8_t) abs(i % SIZE - 16);
+
+    cp_vec3 from[2] = {{.x = 4.5f, .y = 4.5f, .z = 4.5f}, {.x = 4.5f, .y = 4.5f, .z = 4.5f}};
+    cp_vec3 to[2] = {{.x = 12.5f, .y = 20.5f, .z = 8.5f}, {.x = 28.5f, .y = 4.5f, .z = 4.5f}};
+
+    uint64_t visible[1];
+    lineOfSightBatch(distanceField, SIZE, SIZE, SIZE, from, to, 2, visible, 0);
+
+    // visible[0] == 1: the first pair can see each other, the second one is separated by the wall
+}
+
+#endif //VOXELDEVSCRIPTS_LINEOFSIGHT_H
@@ -0,0 +1,208 @@
+#ifndef VOXELDEVSCRIPTS_MATERIALDISTANCEFIELD_H
+#define VOXELDEVSCRIPTS_MATERIALDISTANCEFIELD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "BoolArrToManhattan.h"
+
+/*
+ * Manhattan distance fields to several classes of materials at once ("distance to the closest water", "... lava",
+ * "... solid voxel"), computed from a material (palette index) array in a single set of passes.
+ *
+ * Instead of building a bool array per class and running boolArrToManhattanDF on each of them, classMasks maps every
+ * material to the classes it belongs to: bit c of classMasks[material] is set if voxels of that material are sources of
+ * channel c (a material can belong to several classes, or to none). Up to 8 channels are supported.
+ *
+ * The channels are interleaved: channel c of voxel i is o_fields[i * channels + c]. That way the channels of a voxel
+ * update together:
+ *  -   the X pass packs the 8 channels of a voxel into one 64 bit lane and scans two rows at once, so every step of the
+ *      (inherently serial) scan along x updates 16 distances with one add and one min.
+ *  -   the Y and Z passes relax whole rows / planes of sizeX * channels bytes, which is the same loop as for a single field,
+ *      just longer. All channels of all voxels of a row are updated by the same vector instructions.
+ * So 3 channels cost much less than 3 distance fields, the Y and Z passes move the same bytes as 3 separate fields would,
+ * but the X pass reads the material array only once and there's no per channel bool array to build.
+ *
+ * Every channel is the same as boolArrToManhattanDF of a bool array that is true for the voxels in the class (0 in the
+ * class, at most maxDistance = min(254, sizeX + sizeY + sizeZ) otherwise, maxDistance if there is no voxel of the class).
+ */
+
+#define MATERIAL_DF_MAX_CHANNELS 8
+
+// Packed init values of every material: byte c is 0 if the material belongs to channel c, maxDistance otherwise.
+static void materialDFInitTable(const uint8_t classMasks[256], int maxDistance, uint64_t o_table[256])
+{
+    for (int material = 0; material < 256; material++)
+    {
+        uint64_t init = 0;
+        for (int c = 0; c < MATERIAL_DF_MAX_CHANNELS; c++)
+            if (!((classMasks[material] >> c) & 1))
+                init |= (uint64_t) maxDistance << (8 * c);
+        o_table[material] = init;
+    }
+}
+
+// Writes the first channels bytes of every packed voxel of a row to o_row. As long as 8 bytes fit into the row, we store
+// all of them, the extra bytes are overwritten by the next voxel.
+static inline void materialDFStoreRow(const uint64_t* packed, int packedStride, uint8_t* o_row, int channels, int sizeX)
+{
+    int x = 0;
+    for (; x * channels + 8 <= sizeX * channels; x++)
+        memcpy(o_row + x * channels, packed + x * packedStride, 8);
+    for (; x < sizeX; x++)
+        memcpy(o_row + x * channels, packed + x * packedStride, channels);
+}
+
+// forward and backward scan of rows a and b (may be the same row), packed is scratch memory for 2 * sizeX words
+static inline void materialDFXRows(const uint8_t* materialsA, const uint8_t* materialsB, const uint64_t* table, uint64_t* packed,
+                                   uint8_t* o_rowA, uint8_t* o_rowB, int channels, int sizeX)
+{
+#ifdef __SSE2__
+    // row a lives in the low, row b in the high 64 bits. Values never exceed 254 and 255 is never reached, so the
+    // saturating add only matters for the "no previous voxel" start value
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i d = _mm_set1_epi8((char) 255);
+
+    for (int x = 0; x < sizeX; x++)
+    {
+        const __m128i init = _mm_set_epi64x((long long) table[materialsB[x]], (long long) table[materialsA[x]]);
+        d = _mm_min_epu8(init, _mm_adds_epu8(d, one));
+        _mm_storeu_si128((__m128i*) (packed + 2 * x), d);
+    }
+
+    for (int x = sizeX - 2; x >= 0; x--)
+    {
+        d = _mm_min_epu8(_mm_loadu_si128((const __m128i*) (packed + 2 * x)), _mm_adds_epu8(d, one));
+        _mm_storeu_si128((__m128i*) (packed + 2 * x), d);
+    }
+#else
+    uint8_t* bytes = (uint8_t*) packed;
+    for (int x = 0; x < sizeX; x++)
+    {
+        memcpy(bytes + 16 * x, table + materialsA[x], 8);
+        memcpy(bytes + 16 * x + 8, table + materialsB[x], 8);
+        if (x > 0)
+            for (int i = 0; i < 16; i++)
+                bytes[16 * x + i] = min(bytes[16 * x + i], bytes[16 * (x - 1) + i] + 1);
+    }
+
+    for (int x = sizeX - 2; x >= 0; x--)
+        for (int i = 0; i < 16; i++)
+            bytes[16 * x + i] = min(bytes[16 * x + i], bytes[16 * (x + 1) + i] + 1);
+#endif
+
+    materialDFStoreRow(packed, 2, o_rowA, channels, sizeX);
+    if (o_rowB != o_rowA)
+        materialDFStoreRow(packed + 1, 2, o_rowB, channels, sizeX);
+}
+
+static void materialArrToManhattanDFXPASS(const uint8_t* materials, const uint8_t classMasks[256], int channels, uint8_t* o_fields,
+                                          int sizeX, int sizeY, int sizeZ)
+{
+    const int maxDistance = min(254, sizeX + sizeY + sizeZ);
+    const int rowCount = sizeY * sizeZ;
+    uint64_t table[256];
+    uint64_t packed[2 * sizeX];
+    VOXEL_STATS_BEGIN(VOXEL_STATS_MATERIAL_DF_XPASS);
+
+    materialDFInitTable(classMasks, maxDistance, table);
+
+    // rows are independent, so we take them two at a time (the last one is paired with itself if the count is odd)
+    for (int r = 0; r < rowCount; r += 2)
+    {
+        const int rb = r + 1 < rowCount ? r + 1 : r;
+        materialDFXRows(materials + (uint64_t) r * sizeX, materials + (uint64_t) rb * sizeX, table, packed,
+                        o_fields + (uint64_t) r * sizeX * channels, o_fields + (uint64_t) rb * sizeX * channels, channels, sizeX);
+    }
+
+    // reads the materials, writes all channels
+    VOXEL_STATS_END(VOXEL_STATS_MATERIAL_DF_XPASS, (uint64_t) sizeX * sizeY * sizeZ, (1ull + channels) * sizeX * sizeY * sizeZ);
+}
+
+static void materialArrToManhattanDFYPASS(uint8_t* o_fields, int channels, int sizeX, int sizeY, int sizeZ)
+{
+    const int rowSize = sizeX * channels;
+    VOXEL_STATS_BEGIN(VOXEL_STATS_MATERIAL_DF_YPASS);
+
+    // the channels are interleaved, so a row of the multi channel field is just a longer row of a regular one
+    for (int z = 0; z < sizeZ; z++)
+    {
+        uint8_t* plane = o_fields + (uint64_t) z * sizeY * rowSize;
+
+        for (int y = 1; y < sizeY; y++)
+            boolArrToManhattanDFRelaxRow(plane + y * rowSize, plane + (y - 1) * rowSize, rowSize);
+
+        for (int y = sizeY - 2; y >= 0; y--)
+            boolArrToManhattanDFRelaxRow(plane + y * rowSize, plane + (y + 1) * rowSize, rowSize);
+    }
+
+    VOXEL_STATS_END(VOXEL_STATS_MATERIAL_DF_YPASS, (uint64_t) sizeX * sizeY * sizeZ, 2ull * channels * sizeX * sizeY * sizeZ);
+}
+
+static void materialArrToManhattanDFZPASS(uint8_t* o_fields, int channels, int sizeX, int sizeY, int sizeZ)
+{
+    const int planeSize = sizeX * sizeY * channels;
+    VOXEL_STATS_BEGIN(VOXEL_STATS_MATERIAL_DF_ZPASS);
+
+    for (int z = 1; z < sizeZ; z++)
+        boolArrToManhattanDFRelaxRow(o_fields + (uint64_t) z * planeSize, o_fields + (uint64_t) (z - 1) * planeSize, planeSize);
+
+    for (int z = sizeZ - 2; z >= 0; z--)
+        boolArrToManhattanDFRelaxRow(o_fields + (uint64_t) z * planeSize, o_fields + (uint64_t) (z + 1) * planeSize, planeSize);
+
+    VOXEL_STATS_END(VOXEL_STATS_MATERIAL_DF_ZPASS, (uint64_t) sizeX * sizeY * sizeZ, 2ull * channels * sizeX * sizeY * sizeZ);
+}
+
+// Computes channels (1 to 8) interleaved distance fields (o_fields holds sizeX * sizeY * sizeZ * channels bytes) from a
+// material array. Bit c of classMasks[material] makes the material a source of channel c.
+static void materialArrToManhattanDF(const uint8_t* materials, const uint8_t classMasks[256], int channels, uint8_t* o_fields,
+                                     int sizeX, int sizeY, int sizeZ)
+{
+    materialArrToManhattanDFXPASS(materials, classMasks, channels, o_fields, sizeX, sizeY, sizeZ);
+    materialArrToManhattanDFYPASS(o_fields, channels, sizeX, sizeY, sizeZ);
+    materialArrToManhattanDFZPASS(o_fields, channels, sizeX, sizeY, sizeZ);
+}
+
+static inline uint8_t materialDFGet(const uint8_t* fields, int channels, int sizeX, int sizeY, int x, int y, int z, int channel)
+{
+    return fields[((uint64_t) z * sizeX * sizeY + (uint64_t) y * sizeX + x) * channels + channel];
+}
+
+// Usage Example
+void testMaterialDF()
+{
+    enum { AIR, STONE, DIRT, WATER, LAVA };
+    enum { SOLID = 1, FLUID_WATER = 2, FLUID_LAVA = 4 };
+    const int SIZE = 32;
+
+    // the class of every material of the palette, materials without an entry (e.g. air) aren't a source of anything
+    uint8_t classMasks[256] = {0};
+    classMasks[STONE] = SOLID;
+    classMasks[DIRT] = SOLID;
+    classMasks[WATER] = FLUID_WATER;
+    classMasks[LAVA] = FLUID_LAVA;
+
+    static uint8_t materials[32 * 32 * 32];
+    static uint8_t fields[32 * 32 * 32 * 3];
+
+    // a stone floor with a lava pool at one end and water at the other
+    memset(materials, AIR, sizeof(materials));
+    for (int z = 0; z < SIZE; z++)
+        for (int x = 0; x < SIZE; x++)
+        {
+            materials[z * SIZE * SIZE + x] = STONE;
+            materials[z * SIZE * SIZE + SIZE + x] = x < 4 ? LAVA : x >= SIZE - 4 ? WATER : DIRT;
+        }
+
+    materialArrToManhattanDF(materials, classMasks, 3, fields, SIZE, SIZE, SIZE);
+
+    // a voxel in the middle, 10 voxels above the surface: 10 away from solid ground, 12 + 10 from the water and 13 + 10
+    // from the lava
+    const int solid = materialDFGet(fields, 3, SIZE, SIZE, 16, 11, 16, 0);      // 10
+    const int water = materialDFGet(fields, 3, SIZE, SIZE, 16, 11, 16, 1);      // 22
+    const int lava = materialDFGet(fields, 3, SIZE, SIZE, 16, 11, 16, 2);       // 23
+    (void) solid, (void) water, (void) lava;
+}
+
+#endif //VOXELDEVSCRIPTS_MATERIALDISTANCEFIELD_H
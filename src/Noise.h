@@ -0,0 +1,615 @@
+#ifndef VOXELDEVSCRIPTS_NOISE_H
+#define VOXELDEVSCRIPTS_NOISE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+// cpmath defines generic macros (min, div, length, ...), so it has to be included after the distance field script
+#include "BoolArrToManhattan.h"
+#include "cpmath.h"
+
+/*
+ * Value and simplex noise (2D and 3D), fractal noise (fBm) on top of them and a small terrain generator that writes
+ * the result straight into the bool array / bit array layout the distance field scripts take.
+ *
+ * All noise functions evaluate several sample positions at once, one per SIMD lane: the x4 functions take __m128
+ * (so the .i member of a cp_vec4 holding 4 x / y / z coordinates), the x8 functions take __m256 and are only available
+ * with AVX2. For single samples there are wrappers taking cp_vec2 / cp_vec3 at the bottom.
+ * Both noise types return values in about [-1, 1] and are deterministic for a given seed, so neighbouring chunks fit together.
+ *
+ * The terrain generator computes
+ *      density = fBm(worldPosition) + (groundHeight - worldZ) * heightFalloff
+ * for every voxel and sets it to true if density > threshold. With heightFalloff == 0 this gives 3D blobs / caves, with
+ * heightFalloff > 0 it gives a ground surface (z is up) with overhangs. In 2D mode the noise is evaluated once per column,
+ * which gives heightmap terrain and is a lot cheaper.
+ *
+ * noiseTerrainToManhattanDF fuses generation and the X pass of the distance field: every row is generated into a scratch
+ * row and run through the X pass while it's still in L1, so the bool array doesn't need to be stored (or read back) at
+ * all. Pass NULL as o_boolArr for that, or a bool array to get a copy of the terrain as well.
+ *
+ * Requirements are the same as for cpmath.h (SSE4.1 and FMA), AVX2 is optional and doubles the width.
+ */
+
+typedef enum NoiseType
+{
+    NOISE_VALUE,
+    NOISE_SIMPLEX
+} NoiseType;
+
+typedef struct NoiseParams
+{
+    NoiseType type;
+    int seed;
+    float frequency;    // sample positions are multiplied with this, so 1 / frequency is the size of the features (in voxels) of the first octave
+    int octaves;        // every octave adds noise with lacunarity times the frequency and gain times the amplitude of the previous one, at least 1 (less counts as 1)
+    float lacunarity;   // usually 2
+    float gain;         // usually 0.5
+} NoiseParams;
+
+typedef struct NoiseTerrain
+{
+    NoiseParams noise;
+    int dimensions;         // 2: heightmap terrain (noise per column), 3: noise per voxel
+    float threshold;
+    float groundHeight;     // world z of the surface where the noise is 0
+    float heightFalloff;    // per voxel, 0 disables the ground surface
+    int offsetX;            // world position of voxel (0, 0, 0), so chunks can be generated separately
+    int offsetY;
+    int offsetZ;
+} NoiseTerrain;
+
+// primes for hashing the lattice coordinates, the hash of x + 1 is the hash of x + NOISE_PRIME_X
+#define NOISE_PRIME_X 0x8DA6B343
+#define NOISE_PRIME_Y 0xD8163841
+#define NOISE_PRIME_Z 0xCB1AB31F
+#define NOISE_PRIME_SEED 0x27D4EB2F
+
+// the seed mixed into the hashes, in uint32_t since the product overflows an int for most seeds
+#define NOISE_SEED_HASH(seed) ((int) ((uint32_t) (seed) * NOISE_PRIME_SEED))
+#define NOISE_OCTAVE_SEED(seed, octave) ((int) ((uint32_t) (seed) + (uint32_t) (octave)))
+
+#define NOISE_SIMPLEX2_SKEW 0.36602540378f      // (sqrt(3) - 1) / 2
+#define NOISE_SIMPLEX2_UNSKEW 0.21132486540f    // (3 - sqrt(3)) / 6
+#define NOISE_SIMPLEX3_SKEW (1.0f / 3.0f)
+#define NOISE_SIMPLEX3_UNSKEW (1.0f / 6.0f)
+
+/**
+ * SIMD Operations
+ */
+
+// The kernels below are written once (NOISE_DEFINE_KERNELS) against these names and instantiated for 4 and 8 lanes.
+#define NOISE_F4 __m128
+#define NOISE_I4 __m128i
+#define noise4_setf _mm_set1_ps
+#define noise4_seti _mm_set1_epi32
+#define noise4_ramp() _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f)
+#define noise4_loadu _mm_loadu_ps
+#define noise4_storeu _mm_storeu_ps
+#define noise4_add _mm_add_ps
+#define noise4_sub _mm_sub_ps
+#define noise4_mul _mm_mul_ps
+#define noise4_fmadd _mm_fmadd_ps
+#define noise4_max _mm_max_ps
+#define noise4_floor _mm_floor_ps
+#define noise4_and _mm_and_ps
+#define noise4_or _mm_or_ps
+#define noise4_xor _mm_xor_ps
+#define noise4_andnot _mm_andnot_ps
+#define noise4_blend _mm_blendv_ps
+#define noise4_cmpge _mm_cmpge_ps
+#define noise4_cmpgt _mm_cmpgt_ps
+#define noise4_movemask _mm_movemask_ps
+#define noise4_ftoi _mm_cvttps_epi32
+#define noise4_itof _mm_cvtepi32_ps
+#define noise4_castif _mm_castsi128_ps
+#define noise4_castfi _mm_castps_si128
+#define noise4_addi _mm_add_epi32
+#define noise4_muli _mm_mullo_epi32
+#define noise4_andi _mm_and_si128
+#define noise4_ori _mm_or_si128
+#define noise4_xori _mm_xor_si128
+#define noise4_srli _mm_srli_epi32
+#define noise4_slli _mm_slli_epi32
+#define noise4_cmpeqi _mm_cmpeq_epi32
+#define noise4_cmpgti _mm_cmpgt_epi32
+
+#ifdef __AVX2__
+#define NOISE_F8 __m256
+#define NOISE_I8 __m256i
+#define noise8_setf _mm256_set1_ps
+#define noise8_seti _mm256_set1_epi32
+#define noise8_ramp() _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f)
+#define noise8_loadu _mm256_loadu_ps
+#define noise8_storeu _mm256_storeu_ps
+#define noise8_add _mm256_add_ps
+#define noise8_sub _mm256_sub_ps
+#define noise8_mul _mm256_mul_ps
+#define noise8_fmadd _mm256_fmadd_ps
+#define noise8_max _mm256_max_ps
+#define noise8_floor _mm256_floor_ps
+#define noise8_and _mm256_and_ps
+#define noise8_or _mm256_or_ps
+#define noise8_xor _mm256_xor_ps
+#define noise8_andnot _mm256_andnot_ps
+#define noise8_blend _mm256_blendv_ps
+#define noise8_cmpge(a, b) _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#define noise8_cmpgt(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define noise8_movemask _mm256_movemask_ps
+#define noise8_ftoi _mm256_cvttps_epi32
+#define noise8_itof _mm256_cvtepi32_ps
+#define noise8_castif _mm256_castsi256_ps
+#define noise8_castfi _mm256_castps_si256
+#define noise8_addi _mm256_add_epi32
+#define noise8_muli _mm256_mullo_epi32
+#define noise8_andi _mm256_and_si256
+#define noise8_ori _mm256_or_si256
+#define noise8_xori _mm256_xor_si256
+#define noise8_srli _mm256_srli_epi32
+#define noise8_slli _mm256_slli_epi32
+#define noise8_cmpeqi _mm256_cmpeq_epi32
+#define noise8_cmpgti _mm256_cmpgt_epi32
+#endif
+
+/**
+ * Kernels
+ */
+
+// Note: the comments inside of the macro have to be block comments because of the line continuations.
+#define NOISE_DEFINE_KERNELS(W)                                                                                         \
+                                                                                                                        \
+/* finalizes the xor of the lattice hashes, so that neighbouring cells get unrelated values */                          \
+static inline NOISE_I##W noiseHashMix##W(NOISE_I##W h)                                                                  \
+{                                                                                                                       \
+    h = noise##W##_xori(h, noise##W##_srli(h, 15));                                                                     \
+    h = noise##W##_muli(h, noise##W##_seti(0x2C1B3C6D));                                                                \
+    return noise##W##_xori(h, noise##W##_srli(h, 12));                                                                  \
+}                                                                                                                       \
+                                                                                                                        \
+/* upper 24 bits of the hash -> [-1, 1) */                                                                              \
+static inline NOISE_F##W noiseHashToFloat##W(NOISE_I##W h)                                                             \
+{                                                                                                                       \
+    return noise##W##_fmadd(noise##W##_itof(noise##W##_srli(h, 8)), noise##W##_setf(1.0f / 8388608.0f),                 \
+                            noise##W##_setf(-1.0f));                                                                    \
+}                                                                                                                       \
+                                                                                                                        \
+/* t * t * (3 - 2t) */                                                                                                  \
+static inline NOISE_F##W noiseSmooth##W(NOISE_F##W t)                                                                   \
+{                                                                                                                       \
+    return noise##W##_mul(noise##W##_mul(t, t), noise##W##_fmadd(noise##W##_setf(-2.0f), t, noise##W##_setf(3.0f)));   \
+}                                                                                                                       \
+                                                                                                                        \
+static inline NOISE_F##W noiseLerp##W(NOISE_F##W a, NOISE_F##W b, NOISE_F##W t)                                        \
+{                                                                                                                       \
+    return noise##W##_fmadd(t, noise##W##_sub(b, a), a);                                                                \
+}                                                                                                                       \
+                                                                                                                        \
+/* one of the 8 gradients (+-1, +-2), (+-2, +-1) dotted with (x, y) */                                                  \
+static inline NOISE_F##W noiseGrad2##W(NOISE_I##W h, NOISE_F##W x, NOISE_F##W y)                                       \
+{                                                                                                                       \
+    NOISE_F##W swap = noise##W##_castif(noise##W##_cmpeqi(noise##W##_andi(h, noise##W##_seti(4)), noise##W##_seti(4))); \
+    NOISE_F##W u = noise##W##_blend(x, y, swap);                                                                        \
+    NOISE_F##W v = noise##W##_blend(y, x, swap);                                                                        \
+    u = noise##W##_xor(u, noise##W##_castif(noise##W##_slli(noise##W##_andi(h, noise##W##_seti(1)), 31)));             \
+    v = noise##W##_xor(v, noise##W##_castif(noise##W##_slli(noise##W##_andi(h, noise##W##_seti(2)), 30)));             \
+    return noise##W##_fmadd(v, noise##W##_setf(2.0f), u);                                                              \
+}                                                                                                                       \
+                                                                                                                        \
+/* the 12 gradients to the edge centers of a cube (4 of them twice) dotted with (x, y, z), the branchless version of    \
+   the classic h & 15 switch */                                                                                         \
+static inline NOISE_F##W noiseGrad3##W(NOISE_I##W h, NOISE_F##W x, NOISE_F##W y, NOISE_F##W z)                         \
+{                                                                                                                       \
+    NOISE_I##W h15 = noise##W##_andi(h, noise##W##_seti(15));                                                           \
+    NOISE_F##W lessThan8 = noise##W##_castif(noise##W##_cmpgti(noise##W##_seti(8), h15));                               \
+    NOISE_F##W lessThan4 = noise##W##_castif(noise##W##_cmpgti(noise##W##_seti(4), h15));                               \
+    NOISE_F##W is12or14 = noise##W##_castif(noise##W##_cmpeqi(noise##W##_ori(h15, noise##W##_seti(2)), noise##W##_seti(14))); \
+    NOISE_F##W u = noise##W##_blend(y, x, lessThan8);                                                                   \
+    NOISE_F##W v = noise##W##_blend(noise##W##_blend(z, x, is12or14), y, lessThan4);                                    \
+    u = noise##W##_xor(u, noise##W##_castif(noise##W##_slli(noise##W##_andi(h, noise##W##_seti(1)), 31)));             \
+    v = noise##W##_xor(v, noise##W##_castif(noise##W##_slli(noise##W##_andi(h, noise##W##_seti(2)), 30)));             \
+    return noise##W##_add(u, v);                                                                                        \
+}                                                                                                                       \
+                                                                                                                        \
+static inline NOISE_F##W noiseValue2x##W(NOISE_F##W x, NOISE_F##W y, int seed)                                         \
+{                                                                                                                       \
+    NOISE_F##W fx = noise##W##_floor(x), fy = noise##W##_floor(y);                                                      \
+    NOISE_F##W tx = noiseSmooth##W(noise##W##_sub(x, fx)), ty = noiseSmooth##W(noise##W##_sub(y, fy));                  \
+                                                                                                                        \
+    /* hash(x + 1) = hash(x) + prime, so we only need one multiplication per axis */                                    \
+    NOISE_I##W hx0 = noise##W##_muli(noise##W##_ftoi(fx), noise##W##_seti(NOISE_PRIME_X));                              \
+    NOISE_I##W hy0 = noise##W##_muli(noise##W##_ftoi(fy), noise##W##_seti(NOISE_PRIME_Y));                              \
+    NOISE_I##W hx1 = noise##W##_addi(hx0, noise##W##_seti(NOISE_PRIME_X));                                              \
+    NOISE_I##W hy1 = noise##W##_addi(hy0, noise##W##_seti(NOISE_PRIME_Y));                                              \
+    hy0 = noise##W##_xori(hy0, noise##W##_seti(NOISE_SEED_HASH(seed)));                                                 \
+    hy1 = noise##W##_xori(hy1, noise##W##_seti(NOISE_SEED_HASH(seed)));                                                 \
+                                                                                                                        \
+    NOISE_F##W v00 = noiseHashToFloat##W(noiseHashMix##W(noise##W##_xori(hx0, hy0)));                                   \
+    NOISE_F##W v10 = noiseHashToFloat##W(noiseHashMix##W(noise##W##_xori(hx1, hy0)));                                   \
+    NOISE_F##W v01 = noiseHashToFloat##W(noiseHashMix##W(noise##W##_xori(hx0, hy1)));                                   \
+    NOISE_F##W v11 = noiseHashToFloat##W(noiseHashMix##W(noise##W##_xori(hx1, hy1)));                                   \
+                                                                                                                        \
+    return noiseLerp##W(noiseLerp##W(v00, v10, tx), noiseLerp##W(v01, v11, tx), ty);                                    \
+}                                                                                                                       \
+                                                                                                                        \
+static inline NOISE_F##W noiseValue3x##W(NOISE_F##W x, NOISE_F##W y, NOISE_F##W z, int seed)                           \
+{                                                                                                                       \
+    NOISE_F##W fx = noise##W##_floor(x), fy = noise##W##_floor(y), fz = noise##W##_floor(z);                            \
+    NOISE_F##W tx = noiseSmooth##W(noise##W##_sub(x, fx));                                                              \
+    NOISE_F##W ty = noiseSmooth##W(noise##W##_sub(y, fy));                                                              \
+    NOISE_F##W tz = noiseSmooth##W(noise##W##_sub(z, fz));                                                              \
+                                                                                                                        \
+    NOISE_I##W hx0 = noise##W##_muli(noise##W##_ftoi(fx), noise##W##_seti(NOISE_PRIME_X));                              \
+    NOISE_I##W hy0 = noise##W##_muli(noise##W##_ftoi(fy), noise##W##_seti(NOISE_PRIME_Y));                              \
+    NOISE_I##W hz0 = noise##W##_muli(noise##W##_ftoi(fz), noise##W##_seti(NOISE_PRIME_Z));                              \
+    NOISE_I##W hx1 = noise##W##_addi(hx0, noise##W##_seti(NOISE_PRIME_X));                                              \
+    NOISE_I##W hy1 = noise##W##_addi(hy0, noise##W##_seti(NOISE_PRIME_Y));                                              \
+    NOISE_I##W hz1 = noise##W##_addi(hz0, noise##W##_seti(NOISE_PRIME_Z));                                              \
+    hz0 = noise##W##_xori(hz0, noise##W##_seti(NOISE_SEED_HASH(seed)));                                                 \
+    hz1 = noise##W##_xori(hz1, noise##W##_seti(NOISE_SEED_HASH(seed)));                                                 \
+                                                                                                                        \
+    NOISE_I##W h00 = noise##W##_xori(hy0, hz0), h10 = noise##W##_xori(hy1, hz0);                                        \
+    NOISE_I##W h01 = noise##W##_xori(hy0, hz1), h11 = noise##W##_xori(hy1, hz1);                                        \
+                                                                                                                        \
+    NOISE_F##W c00 = noiseLerp##W(noiseHashToFloat##W(noiseHashMix##W(noise##W##_xori(hx0, h00))),                      \
+                                  noiseHashToFloat##W(noiseHashMix##W(noise##W##_xori(hx1, h00))), tx);                 \
+    NOISE_F##W c10 = noiseLerp##W(noiseHashToFloat##W(noiseHashMix##W(noise##W##_xori(hx0, h10))),                      \
+                                  noiseHashToFloat##W(noiseHashMix##W(noise##W##_xori(hx1, h10))), tx);                 \
+    NOISE_F##W c01 = noiseLerp##W(noiseHashToFloat##W(noiseHashMix##W(noise##W##_xori(hx0, h01))),                      \
+                                  noiseHashToFloat##W(noiseHashMix##W(noise##W##_xori(hx1, h01))), tx);                 \
+    NOISE_F##W c11 = noiseLerp##W(noiseHashToFloat##W(noiseHashMix##W(noise##W##_xori(hx0, h11))),                      \
+                                  noiseHashToFloat##W(noiseHashMix##W(noise##W##_xori(hx1, h11))), tx);                 \
+                                                                                                                        \
+    return noiseLerp##W(noiseLerp##W(c00, c10, ty), noiseLerp##W(c01, c11, ty), tz);                                    \
+}                                                                                                                       \
+                                                                                                                        \
+/* contribution of one simplex corner, t^4 * dot(gradient, offset) with t = r^2 - |offset|^2 clamped to 0 */            \
+static inline NOISE_F##W noiseSimplexCorner2##W(NOISE_I##W h, NOISE_F##W x, NOISE_F##W y)                              \
+{                                                                                                                       \
+    NOISE_F##W t = noise##W##_sub(noise##W##_setf(0.5f), noise##W##_fmadd(x, x, noise##W##_mul(y, y)));                 \
+    t = noise##W##_max(t, noise##W##_setf(0.0f));                                                                       \
+    t = noise##W##_mul(t, t);                                                                                           \
+    return noise##W##_mul(noise##W##_mul(t, t), noiseGrad2##W(noiseHashMix##W(h), x, y));                               \
+}                                                                                                                       \
+                                                                                                                        \
+static inline NOISE_F##W noiseSimplexCorner3##W(NOISE_I##W h, NOISE_F##W x, NOISE_F##W y, NOISE_F##W z)                \
+{                                                                                                                       \
+    NOISE_F##W t = noise##W##_sub(noise##W##_setf(0.6f),                                                                \
+                                  noise##W##_fmadd(x, x, noise##W##_fmadd(y, y, noise##W##_mul(z, z))));                \
+    t = noise##W##_max(t, noise##W##_setf(0.0f));                                                                       \
+    t = noise##W##_mul(t, t);                                                                                           \
+    return noise##W##_mul(noise##W##_mul(t, t), noiseGrad3##W(noiseHashMix##W(h), x, y, z));                            \
+}                                                                                                                       \
+                                                                                                                        \
+static inline NOISE_F##W noiseSimplex2x##W(NOISE_F##W x, NOISE_F##W y, int seed)                                       \
+{                                                                                                                       \
+    /* skew the input space to find the simplex (triangle) we're in */                                                  \
+    NOISE_F##W s = noise##W##_mul(noise##W##_add(x, y), noise##W##_setf(NOISE_SIMPLEX2_SKEW));                          \
+    NOISE_F##W fi = noise##W##_floor(noise##W##_add(x, s)), fj = noise##W##_floor(noise##W##_add(y, s));                \
+    NOISE_F##W t = noise##W##_mul(noise##W##_add(fi, fj), noise##W##_setf(NOISE_SIMPLEX2_UNSKEW));                      \
+    NOISE_F##W x0 = noise##W##_sub(x, noise##W##_sub(fi, t)), y0 = noise##W##_sub(y, noise##W##_sub(fj, t));            \
+                                                                                                                        \
+    /* the middle corner is (1, 0) in the lower triangle (x0 > y0) and (0, 1) in the upper one */                       \
+    NOISE_F##W lower = noise##W##_cmpgt(x0, y0);                                                                        \
+    NOISE_F##W upper = noise##W##_andnot(lower, noise##W##_castif(noise##W##_seti(-1)));                                \
+    NOISE_F##W g1 = noise##W##_setf(NOISE_SIMPLEX2_UNSKEW);                                                             \
+    NOISE_F##W g2 = noise##W##_setf(2.0f * NOISE_SIMPLEX2_UNSKEW - 1.0f);                                               \
+    NOISE_F##W x1 = noise##W##_add(noise##W##_sub(x0, noise##W##_and(lower, noise##W##_setf(1.0f))), g1);               \
+    NOISE_F##W y1 = noise##W##_add(noise##W##_sub(y0, noise##W##_and(upper, noise##W##_setf(1.0f))), g1);               \
+    NOISE_F##W x2 = noise##W##_add(x0, g2), y2 = noise##W##_add(y0, g2);                                                \
+                                                                                                                        \
+    NOISE_I##W primeX = noise##W##_seti(NOISE_PRIME_X), primeY = noise##W##_seti(NOISE_PRIME_Y);                        \
+    NOISE_I##W hx = noise##W##_muli(noise##W##_ftoi(fi), primeX);                                                       \
+    NOISE_I##W hy = noise##W##_muli(noise##W##_ftoi(fj), primeY);                                                       \
+    NOISE_I##W seedHash = noise##W##_seti(NOISE_SEED_HASH(seed));                                                       \
+                                                                                                                        \
+    /* the hashes of the other corners as offsets of the first one (the masks are all ones where the offset is 1) */    \
+    NOISE_I##W h0 = noise##W##_xori(noise##W##_xori(hx, hy), seedHash);                                                 \
+    NOISE_I##W h1 = noise##W##_xori(noise##W##_xori(noise##W##_addi(hx, noise##W##_andi(noise##W##_castfi(lower), primeX)), \
+                                                    noise##W##_addi(hy, noise##W##_andi(noise##W##_castfi(upper), primeY))), \
+                                    seedHash);                                                                          \
+    NOISE_I##W h2 = noise##W##_xori(noise##W##_xori(noise##W##_addi(hx, primeX), noise##W##_addi(hy, primeY)), seedHash); \
+                                                                                                                        \
+    NOISE_F##W n = noiseSimplexCorner2##W(h0, x0, y0);                                                                  \
+    n = noise##W##_add(n, noiseSimplexCorner2##W(h1, x1, y1));                                                          \
+    n = noise##W##_add(n, noiseSimplexCorner2##W(h2, x2, y2));                                                          \
+                                                                                                                        \
+    /* scales the result to about [-1, 1] */                                                                            \
+    return noise##W##_mul(n, noise##W##_setf(NOISE_SIMPLEX2_SCALE));                                                    \
+}                                                                                                                       \
+                                                                                                                        \
+static inline NOISE_F##W noiseSimplex3x##W(NOISE_F##W x, NOISE_F##W y, NOISE_F##W z, int seed)                          \
+{                                                                                                                       \
+    NOISE_F##W s = noise##W##_mul(noise##W##_add(noise##W##_add(x, y), z), noise##W##_setf(NOISE_SIMPLEX3_SKEW));       \
+    NOISE_F##W fi = noise##W##_floor(noise##W##_add(x, s));                                                             \
+    NOISE_F##W fj = noise##W##_floor(noise##W##_add(y, s));                                                             \
+    NOISE_F##W fk = noise##W##_floor(noise##W##_add(z, s));                                                             \
+    NOISE_F##W t = noise##W##_mul(noise##W##_add(noise##W##_add(fi, fj), fk), noise##W##_setf(NOISE_SIMPLEX3_UNSKEW));  \
+    NOISE_F##W x0 = noise##W##_sub(x, noise##W##_sub(fi, t));                                                           \
+    NOISE_F##W y0 = noise##W##_sub(y, noise##W##_sub(fj, t));                                                           \
+    NOISE_F##W z0 = noise##W##_sub(z, noise##W##_sub(fk, t));                                                           \
+                                                                                                                        \
+    /* the order of x0, y0 and z0 decides which of the 6 simplices (tetrahedra) of the cube we're in, i1/j1/k1 is the   \
+       offset of its second corner and i2/j2/k2 the one of its third corner */                                          \
+    NOISE_F##W ones = noise##W##_castif(noise##W##_seti(-1));                                                           \
+    NOISE_F##W xy = noise##W##_cmpge(x0, y0), yz = noise##W##_cmpge(y0, z0), xz = noise##W##_cmpge(x0, z0);             \
+    NOISE_F##W i1 = noise##W##_and(xy, xz);                                                                             \
+    NOISE_F##W j1 = noise##W##_andnot(xy, yz);                                                                          \
+    NOISE_F##W k1 = noise##W##_andnot(noise##W##_or(xz, yz), ones);                                                     \
+    NOISE_F##W i2 = noise##W##_or(xy, xz);                                                                              \
+    NOISE_F##W j2 = noise##W##_or(noise##W##_andnot(xy, ones), yz);                                                     \
+    NOISE_F##W k2 = noise##W##_andnot(noise##W##_and(xz, yz), ones);                                                    \
+                                                                                                                        \
+    NOISE_F##W one = noise##W##_setf(1.0f);                                                                             \
+    NOISE_F##W g1 = noise##W##_setf(NOISE_SIMPLEX3_UNSKEW);                                                             \
+    NOISE_F##W g2 = noise##W##_setf(2.0f * NOISE_SIMPLEX3_UNSKEW);                                                      \
+    NOISE_F##W g3 = noise##W##_setf(3.0f * NOISE_SIMPLEX3_UNSKEW - 1.0f);                                               \
+    NOISE_F##W x1 = noise##W##_add(noise##W##_sub(x0, noise##W##_and(i1, one)), g1);                                    \
+    NOISE_F##W y1 = noise##W##_add(noise##W##_sub(y0, noise##W##_and(j1, one)), g1);                                    \
+    NOISE_F##W z1 = noise##W##_add(noise##W##_sub(z0, noise##W##_and(k1, one)), g1);                                    \
+    NOISE_F##W x2 = noise##W##_add(noise##W##_sub(x0, noise##W##_and(i2, one)), g2);                                    \
+    NOISE_F##W y2 = noise##W##_add(noise##W##_sub(y0, noise##W##_and(j2, one)), g2);                                    \
+    NOISE_F##W z2 = noise##W##_add(noise##W##_sub(z0, noise##W##_and(k2, one)), g2);                                    \
+    NOISE_F##W x3 = noise##W##_add(x0, g3), y3 = noise##W##_add(y0, g3), z3 = noise##W##_add(z0, g3);                   \
+                                                                                                                        \
+    NOISE_I##W primeX = noise##W##_seti(NOISE_PRIME_X);                                                                 \
+    NOISE_I##W primeY = noise##W##_seti(NOISE_PRIME_Y);                                                                 \
+    NOISE_I##W primeZ = noise##W##_seti(NOISE_PRIME_Z);                                                                 \
+    NOISE_I##W hx = noise##W##_muli(noise##W##_ftoi(fi), primeX);                                                       \
+    NOISE_I##W hy = noise##W##_muli(noise##W##_ftoi(fj), primeY);                                                       \
+    NOISE_I##W hz = noise##W##_muli(noise##W##_ftoi(fk), primeZ);                                                       \
+    NOISE_I##W seedHash = noise##W##_seti(NOISE_SEED_HASH(seed));                                                       \
+                                                                                                                        \
+    NOISE_I##W h0 = noise##W##_xori(noise##W##_xori(hx, hy), noise##W##_xori(hz, seedHash));                            \
+    NOISE_I##W h1 = noise##W##_xori(noise##W##_xori(noise##W##_addi(hx, noise##W##_andi(noise##W##_castfi(i1), primeX)), \
+                                                    noise##W##_addi(hy, noise##W##_andi(noise##W##_castfi(j1), primeY))), \
+                                    noise##W##_xori(noise##W##_addi(hz, noise##W##_andi(noise##W##_castfi(k1), primeZ)), \
+                                                    seedHash));                                                         \
+    NOISE_I##W h2 = noise##W##_xori(noise##W##_xori(noise##W##_addi(hx, noise##W##_andi(noise##W##_castfi(i2), primeX)), \
+                                                    noise##W##_addi(hy, noise##W##_andi(noise##W##_castfi(j2), primeY))), \
+                                    noise##W##_xori(noise##W##_addi(hz, noise##W##_andi(noise##W##_castfi(k2), primeZ)), \
+                                                    seedHash));                                                         \
+    NOISE_I##W h3 = noise##W##_xori(noise##W##_xori(noise##W##_addi(hx, primeX), noise##W##_addi(hy, primeY)),          \
+                                    noise##W##_xori(noise##W##_addi(hz, primeZ), seedHash));                            \
+                                                                                                                        \
+    NOISE_F##W n = noiseSimplexCorner3##W(h0, x0, y0, z0);                                                              \
+    n = noise##W##_add(n, noiseSimplexCorner3##W(h1, x1, y1, z1));                                                      \
+    n = noise##W##_add(n, noiseSimplexCorner3##W(h2, x2, y2, z2));                                                      \
+    n = noise##W##_add(n, noiseSimplexCorner3##W(h3, x3, y3, z3));                                                      \
+                                                                                                                        \
+    return noise##W##_mul(n, noise##W##_setf(NOISE_SIMPLEX3_SCALE));                                                    \
+}                                                                                                                       \
+                                                                                                                        \
+/* fractal noise: sums up params->octaves octaves of noise and normalizes the result back to about [-1, 1] */          \
+static inline NOISE_F##W noiseFbm2x##W(const NoiseParams* params, NOISE_F##W x, NOISE_F##W y)                          \
+{                                                                                                                       \
+    NOISE_F##W sum = noise##W##_setf(0.0f);                                                                             \
+    float amplitude = 1.0f, frequency = params->frequency, amplitudeSum = 0.0f;                                         \
+                                                                                                                        \
+    /* at least one octave, otherwise amplitudeSum would be 0 */                                                        \
+    const int octaves = params->octaves > 1 ? params->octaves : 1;                                                      \
+    for (int octave = 0; octave < octaves; octave++)                                                                    \
+    {                                                                                                                   \
+        NOISE_F##W fx = noise##W##_mul(x, noise##W##_setf(frequency)), fy = noise##W##_mul(y, noise##W##_setf(frequency)); \
+        /* every octave gets its own seed, otherwise all of them would have a peak at the origin */                     \
+        const int seed = NOISE_OCTAVE_SEED(params->seed, octave);                                                       \
+        NOISE_F##W n = params->type == NOISE_SIMPLEX ? noiseSimplex2x##W(fx, fy, seed)                                  \
+                                                     : noiseValue2x##W(fx, fy, seed);                                   \
+        sum = noise##W##_fmadd(n, noise##W##_setf(amplitude), sum);                                                     \
+        amplitudeSum += amplitude;                                                                                      \
+        amplitude *= params->gain;                                                                                      \
+        frequency *= params->lacunarity;                                                                                \
+    }                                                                                                                   \
+                                                                                                                        \
+    return noise##W##_mul(sum, noise##W##_setf(1.0f / amplitudeSum));                                                   \
+}                                                                                                                       \
+                                                                                                                        \
+static inline NOISE_F##W noiseFbm3x##W(const NoiseParams* params, NOISE_F##W x, NOISE_F##W y, NOISE_F##W z)            \
+{                                                                                                                       \
+    NOISE_F##W sum = noise##W##_setf(0.0f);                                                                             \
+    float amplitude = 1.0f, frequency = params->frequency, amplitudeSum = 0.0f;                                         \
+                                                                                                                        \
+    /* at least one octave, otherwise amplitudeSum would be 0 */                                                        \
+    const int octaves = params->octaves > 1 ? params->octaves : 1;                                                      \
+    for (int octave = 0; octave < octaves; octave++)                                                                    \
+    {                                                                                                                   \
+        NOISE_F##W f = noise##W##_setf(frequency);                                                                      \
+        NOISE_F##W fx = noise##W##_mul(x, f), fy = noise##W##_mul(y, f), fz = noise##W##_mul(z, f);                     \
+        const int seed = NOISE_OCTAVE_SEED(params->seed, octave);                                                       \
+        NOISE_F##W n = params->type == NOISE_SIMPLEX ? noiseSimplex3x##W(fx, fy, fz, seed)                              \
+                                                     : noiseValue3x##W(fx, fy, fz, seed);                               \
+        sum = noise##W##_fmadd(n, noise##W##_setf(amplitude), sum);                                                     \
+        amplitudeSum += amplitude;                                                                                      \
+        amplitude *= params->gain;                                                                                      \
+        frequency *= params->lacunarity;                                                                                \
+    }                                                                                                                   \
+                                                                                                                        \
+    return noise##W##_mul(sum, noise##W##_setf(1.0f / amplitudeSum));                                                   \
+}                                                                                                                       \
+                                                                                                                        \
+/* 2D fBm for sizeX columns starting at world (startX, worldY), o_row needs space for sizeX rounded up to W floats */   \
+static inline void noiseTerrainHeightRow##W(const NoiseTerrain* terrain, float startX, float worldY, float* o_row, int sizeX) \
+{                                                                                                                       \
+    for (int x = 0; x < sizeX; x += W)                                                                                  \
+    {                                                                                                                   \
+        NOISE_F##W px = noise##W##_add(noise##W##_setf(startX + (float) x), noise##W##_ramp());                         \
+        noise##W##_storeu(o_row + x, noiseFbm2x##W(&terrain->noise, px, noise##W##_setf(worldY)));                      \
+    }                                                                                                                   \
+}                                                                                                                       \
+                                                                                                                        \
+/* Thresholds one row of voxels into o_boolRow and (if it's not NULL) into o_bitArr starting at bit bitOffset.           \
+   heightRow is the result of noiseTerrainHeightRow in 2D mode and NULL in 3D mode. */                                  \
+static inline void noiseTerrainRow##W(const NoiseTerrain* terrain, float startX, float worldY, float worldZ, const float* heightRow, \
+                                      bool* o_boolRow, uint64_t* o_bitArr, uint64_t bitOffset, int sizeX)               \
+{                                                                                                                       \
+    const NOISE_F##W threshold = noise##W##_setf(terrain->threshold - (terrain->groundHeight - worldZ) * terrain->heightFalloff); \
+                                                                                                                        \
+    for (int x = 0; x < sizeX; x += W)                                                                                  \
+    {                                                                                                                   \
+        NOISE_F##W density;                                                                                             \
+        if (heightRow)                                                                                                  \
+            density = noise##W##_loadu(heightRow + x);                                                                  \
+        else                                                                                                            \
+        {                                                                                                               \
+            NOISE_F##W px = noise##W##_add(noise##W##_setf(startX + (float) x), noise##W##_ramp());                     \
+            density = noiseFbm3x##W(&terrain->noise, px, noise##W##_setf(worldY), noise##W##_setf(worldZ));             \
+        }                                                                                                               \
+                                                                                                                        \
+        /* the lanes past the end of the row are masked off */                                                          \
+        const int lanes = sizeX - x < W ? sizeX - x : W;                                                                \
+        const uint32_t mask = (uint32_t) noise##W##_movemask(noise##W##_cmpgt(density, threshold)) & ((1u << lanes) - 1); \
+                                                                                                                        \
+        for (int i = 0; i < lanes; i++)                                                                                 \
+            o_boolRow[x + i] = (mask >> i) & 1;                                                                         \
+                                                                                                                        \
+        if (o_bitArr)                                                                                                   \
+        {                                                                                                               \
+            const uint64_t bit = bitOffset + x;                                                                         \
+            o_bitArr[bit >> 6] |= (uint64_t) mask << (bit & 63);                                                        \
+            if ((bit & 63) + lanes > 64)                                                                                \
+                o_bitArr[(bit >> 6) + 1] |= (uint64_t) mask >> (64 - (bit & 63));                                       \
+        }                                                                                                               \
+    }                                                                                                                   \
+}
+
+#define NOISE_SIMPLEX2_SCALE 45.0f
+#define NOISE_SIMPLEX3_SCALE 32.0f
+
+NOISE_DEFINE_KERNELS(4)
+
+#ifdef __AVX2__
+NOISE_DEFINE_KERNELS(8)
+
+#define NOISE_WIDTH 8
+#define noiseTerrainHeightRow noiseTerrainHeightRow8
+#define noiseTerrainRow noiseTerrainRow8
+#else
+#define NOISE_WIDTH 4
+#define noiseTerrainHeightRow noiseTerrainHeightRow4
+#define noiseTerrainRow noiseTerrainRow4
+#endif
+
+/**
+ * Terrain
+ */
+
+// Shared driver of the functions below, every output is optional.
+// The rows are generated y-major so that the height row (2D mode) can be reused for every z. Every row is generated into
+// a scratch row on the stack and only copied into o_boolArr if there is one.
+static void noiseTerrainGenerate(const NoiseTerrain* terrain, bool* o_boolArr, uint64_t* o_bitArr, uint8_t* o_distanceField,
+                                 int sizeX, int sizeY, int sizeZ)
+{
+    const int maxDistance = min(254, sizeX + sizeY + sizeZ);
+    float heightRow[sizeX + NOISE_WIDTH];
+    bool boolRow[sizeX];
+    VOXEL_STATS_BEGIN(VOXEL_STATS_NOISE_TERRAIN);
+
+    if (o_bitArr)
+        memset(o_bitArr, 0, ((uint64_t) sizeX * sizeY * sizeZ + 63) / 64 * sizeof(uint64_t));
+
+    for (int y = 0; y < sizeY; y++)
+    {
+        const float worldY = (float) (terrain->offsetY + y);
+        if (terrain->dimensions == 2)
+            noiseTerrainHeightRow(terrain, (float) terrain->offsetX, worldY, heightRow, sizeX);
+
+        for (int z = 0; z < sizeZ; z++)
+        {
+            const uint64_t index = (uint64_t) z * sizeX * sizeY + (uint64_t) y * sizeX;
+            noiseTerrainRow(terrain, (float) terrain->offsetX, worldY, (float) (terrain->offsetZ + z),
+                            terrain->dimensions == 2 ? heightRow : NULL, boolRow, o_bitArr, index, sizeX);
+
+            if (o_boolArr)
+                memcpy(o_boolArr + index, boolRow, sizeX);
+            // the row is still in L1, so this is the cheapest moment to run the X pass over it
+            if (o_distanceField)
+                manhattanDFXRow(boolRow, NULL, 0, o_distanceField + index, sizeX, maxDistance);
+        }
+    }
+
+    // writes the bool array, the bit array and the distance field (if requested)
+    VOXEL_STATS_END(VOXEL_STATS_NOISE_TERRAIN, (uint64_t) sizeX * sizeY * sizeZ,
+                    (uint64_t) sizeX * sizeY * sizeZ * ((o_boolArr != NULL) + (o_distanceField != NULL)) +
+                    (o_bitArr ? (uint64_t) sizeX * sizeY * sizeZ / 8 : 0));
+}
+
+static void noiseTerrainToBoolArr(const NoiseTerrain* terrain, bool* o_boolArr, int sizeX, int sizeY, int sizeZ)
+{
+    noiseTerrainGenerate(terrain, o_boolArr, NULL, NULL, sizeX, sizeY, sizeZ);
+}
+
+// Same as noiseTerrainToBoolArr, but also writes the bit array layout of bitArrToManhattanDF (voxel i is bit i % 64 of o_bitArr[i / 64]).
+// o_boolArr can be NULL if only the bit array is needed.
+static void noiseTerrainToBitArr(const NoiseTerrain* terrain, bool* o_boolArr, uint64_t* o_bitArr, int sizeX, int sizeY, int sizeZ)
+{
+    noiseTerrainGenerate(terrain, o_boolArr, o_bitArr, NULL, sizeX, sizeY, sizeZ);
+}
+
+// Generates the terrain and converts it into a distance field, with the X pass fused into generation. o_boolArr can be
+// NULL, then the bool array is never stored at all (the memory for it isn't needed either).
+static void noiseTerrainToManhattanDF(const NoiseTerrain* terrain, bool* o_boolArr, uint8_t* o_distanceField, int sizeX, int sizeY, int sizeZ)
+{
+    noiseTerrainGenerate(terrain, o_boolArr, NULL, o_distanceField, sizeX, sizeY, sizeZ);
+    boolArrToManhattanDFYPASS(o_distanceField, sizeX, sizeY, sizeZ);
+    boolArrToManhattanDFZPASS(o_distanceField, sizeX, sizeY, sizeZ);
+}
+
+/**
+ * Single samples
+ */
+
+static inline float noiseValue2(cp_vec2 p, int seed)
+{
+    return _mm_cvtss_f32(noiseValue2x4(_mm_set1_ps(p.x), _mm_set1_ps(p.y), seed));
+}
+
+static inline float noiseValue3(cp_vec3 p, int seed)
+{
+    return _mm_cvtss_f32(noiseValue3x4(_mm_set1_ps(p.x), _mm_set1_ps(p.y), _mm_set1_ps(p.z), seed));
+}
+
+static inline float noiseSimplex2(cp_vec2 p, int seed)
+{
+    return _mm_cvtss_f32(noiseSimplex2x4(_mm_set1_ps(p.x), _mm_set1_ps(p.y), seed));
+}
+
+static inline float noiseSimplex3(cp_vec3 p, int seed)
+{
+    return _mm_cvtss_f32(noiseSimplex3x4(_mm_set1_ps(p.x), _mm_set1_ps(p.y), _mm_set1_ps(p.z), seed));
+}
+
+static inline float noiseFbm3(const NoiseParams* params, cp_vec3 p)
+{
+    return _mm_cvtss_f32(noiseFbm3x4(params, _mm_set1_ps(p.x), _mm_set1_ps(p.y), _mm_set1_ps(p.z)));
+}
+
+// Usage Example
+void testNoise()
+{
+    const int SIZE = 64;
+
+    // rolling hills around z = 32 with some overhangs, features are about 32 voxels large
+    NoiseTerrain terrain = {
+        .noise = {.type = NOISE_SIMPLEX, .seed = 1337, .frequency = 1.0f / 32.0f, .octaves = 4, .lacunarity = 2.0f, .gain = 0.5f},
+        .dimensions = 3,
+        .threshold = 0.0f,
+        .groundHeight = 32.0f,
+        .heightFalloff = 1.0f / 16.0f,
+        .offsetX = 0, .offsetY = 0, .offsetZ = 0
+    };
+
+    bool boolArr[SIZE * SIZE * SIZE];
+    uint8_t distanceField[SIZE * SIZE * SIZE];
+
+    noiseTerrainToManhattanDF(&terrain, boolArr, distanceField, SIZE, SIZE, SIZE);
+
+    // the chunk next to it (in x direction) continues the same terrain, here only the distance field is kept
+    terrain.offsetX += SIZE;
+    noiseTerrainToManhattanDF(&terrain, NULL, distanceField, SIZE, SIZE, SIZE);
+
+    // single samples, e.g. for placing things
+    float density = noiseFbm3(&terrain.noise, (cp_vec3) {.x = 10.0f, .y = 20.0f, .z = 30.0f});
+    (void) density;
+}
+
+#endif //VOXELDEVSCRIPTS_NOISE_H
@@ -0,0 +1,255 @@
+#ifndef VOXELDEVSCRIPTS_OCCUPANCYLOD_H
+#define VOXELDEVSCRIPTS_OCCUPANCYLOD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+#include "BoolArrToManhattan.h"
+
+/*
+ * Occupancy LODs: every level halves the size along each axis, voxel (x, y, z) of a level is made of the 2x2x2 voxels
+ * (2x .. 2x + 1, ...) of the level below. A level is a regular bool (or bit) array, so boolArrToManhattanDF (or
+ * bitArrToManhattanDF), meshing and rays run on it unchanged, on 1/8, 1/64, 1/512 of the voxels.
+ *
+ * Two ways to reduce the 8 voxels:
+ *  -   OCCUPANCY_LOD_ANY: solid if any of them is solid. Conservative for collisions and occlusion (never loses geometry),
+ *      but grows surfaces by up to a voxel of the level.
+ *  -   OCCUPANCY_LOD_MAJORITY: solid if at least 4 of them are, which keeps the look of the terrain for far away meshes.
+ *      Ties count as solid, so floors and walls that are 1 voxel thick don't disappear (they always fill 4 of the 8).
+ * Coarser levels are built from the level below them, so a majority level 2 is the majority of majorities.
+ *
+ * The reduction works on whole rows: the 4 rows (y, z), (y + 1, z), (y, z + 1), (y + 1, z + 1) are combined first, then
+ * neighbouring voxels of the combined row.
+ *  -   bool arrays: SSE2 takes 32 bools of each row, ORs them (any) or adds them (majority, 0 - 4 per byte), then combines
+ *      the byte pairs in 16 bit lanes and packs them into 16 output bools.
+ *  -   bit arrays: 64 bits of each row at a time. Any is an OR, majority a bit sliced adder (the count of every column of
+ *      4 bits as 3 bits, then the sum of neighbouring columns compared to 4). The even bits are then packed into 32 output
+ *      bits (pext with BMI2).
+ * The sizes have to be multiples of 2 for every level that is built.
+ */
+
+typedef enum OccupancyLodMode
+{
+    OCCUPANCY_LOD_ANY,
+    OCCUPANCY_LOD_MAJORITY,
+} OccupancyLodMode;
+
+// the scalar version of the reduction, for the ends of the rows
+static inline bool occupancyLodReduce(int solidCount, OccupancyLodMode mode)
+{
+    return mode == OCCUPANCY_LOD_ANY ? solidCount > 0 : solidCount >= 4;
+}
+
+/**
+ * Bool arrays
+ */
+
+static void occupancyLodBoolRow(const bool* row00, const bool* row10, const bool* row01, const bool* row11, bool* o_row,
+                                int lodSizeX, OccupancyLodMode mode)
+{
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    for (; x + 16 <= lodSizeX; x += 16)
+    {
+        __m128i halves[2];
+        for (int h = 0; h < 2; h++)
+        {
+            const int offset = 2 * x + 16 * h;
+            const __m128i a = _mm_loadu_si128((const __m128i*) (row00 + offset));
+            const __m128i b = _mm_loadu_si128((const __m128i*) (row10 + offset));
+            const __m128i c = _mm_loadu_si128((const __m128i*) (row01 + offset));
+            const __m128i d = _mm_loadu_si128((const __m128i*) (row11 + offset));
+
+            if (mode == OCCUPANCY_LOD_ANY)
+            {
+                const __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+                halves[h] = _mm_and_si128(_mm_or_si128(any, _mm_srli_epi16(any, 8)), lowBytes);
+            }
+            else
+            {
+                // bools are 0 or 1, so the byte sums are 0 - 4 and the pair sums 0 - 8
+                const __m128i sum = _mm_add_epi8(_mm_add_epi8(a, b), _mm_add_epi8(c, d));
+                const __m128i pairs = _mm_add_epi16(_mm_and_si128(sum, lowBytes), _mm_srli_epi16(sum, 8));
+                halves[h] = _mm_srli_epi16(_mm_cmpgt_epi16(pairs, _mm_set1_epi16(3)), 15);
+            }
+        }
+        _mm_storeu_si128((__m128i*) (o_row + x), _mm_packus_epi16(halves[0], halves[1]));
+    }
+#endif
+    for (; x < lodSizeX; x++)
+        o_row[x] = occupancyLodReduce(row00[2 * x] + row00[2 * x + 1] + row10[2 * x] + row10[2 * x + 1]
+                                      + row01[2 * x] + row01[2 * x + 1] + row11[2 * x] + row11[2 * x + 1], mode);
+}
+
+// Halves boolArr (sizes multiples of 2) into o_lod ((sizeX / 2) * (sizeY / 2) * (sizeZ / 2) bools).
+static void occupancyLodDownsampleBool(const bool* boolArr, bool* o_lod, int sizeX, int sizeY, int sizeZ, OccupancyLodMode mode)
+{
+    const int lodSizeX = sizeX / 2, lodSizeY = sizeY / 2, lodSizeZ = sizeZ / 2;
+    VOXEL_STATS_BEGIN(VOXEL_STATS_OCCUPANCY_LOD);
+
+    for (int z = 0; z < lodSizeZ; z++)
+        for (int y = 0; y < lodSizeY; y++)
+        {
+            const bool* row00 = boolArr + ((size_t) 2 * z * sizeY + 2 * y) * sizeX;
+            const bool* row01 = row00 + (size_t) sizeX * sizeY;
+            occupancyLodBoolRow(row00, row00 + sizeX, row01, row01 + sizeX, o_lod + ((size_t) z * lodSizeY + y) * lodSizeX,
+                                lodSizeX, mode);
+        }
+
+    // reads every voxel, writes an eighth of them
+    VOXEL_STATS_END(VOXEL_STATS_OCCUPANCY_LOD, (uint64_t) sizeX * sizeY * sizeZ, (uint64_t) sizeX * sizeY * sizeZ * 9 / 8);
+}
+
+/**
+ * Bit arrays
+ */
+
+// reads n <= 64 consecutive bits, starting at bit index offset
+static inline uint64_t occupancyLodGetBits(const uint64_t* bitArr, uint64_t offset, int n)
+{
+    const int shift = offset & 63;
+    uint64_t bits = bitArr[offset >> 6] >> shift;
+    if (shift != 0 && shift + n > 64)
+        bits |= bitArr[(offset >> 6) + 1] << (64 - shift);
+    return n == 64 ? bits : bits & ((1ull << n) - 1);
+}
+
+// the even bits of bits, packed into the low 32 bits
+static inline uint32_t occupancyLodEvenBits(uint64_t bits)
+{
+#ifdef __BMI2__
+    return (uint32_t) _pext_u64(bits, 0x5555555555555555ull);
+#else
+    bits &= 0x5555555555555555ull;
+    bits = (bits | (bits >> 1)) & 0x3333333333333333ull;
+    bits = (bits | (bits >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+    bits = (bits | (bits >> 4)) & 0x00FF00FF00FF00FFull;
+    bits = (bits | (bits >> 8)) & 0x0000FFFF0000FFFFull;
+    return (uint32_t) (bits | (bits >> 16));
+#endif
+}
+
+// writes the n <= 32 low bits of bits starting at bit index offset, the bits have to be 0 before
+// (and the ones above n 0 in bits). Only touches the next word if the n bits reach into it.
+static inline void occupancyLodOrBits(uint64_t* bitArr, uint64_t offset, uint32_t bits, int n)
+{
+    const int shift = offset & 63;
+    bitArr[offset >> 6] |= (uint64_t) bits << shift;
+    if (shift + n > 64)
+        bitArr[(offset >> 6) + 1] |= (uint64_t) bits >> (64 - shift);
+}
+
+// Halves bitArr (sizes multiples of 2, voxel i is bit i % 64 of bitArr[i / 64]) into the bit array o_lod
+// (((sizeX / 2) * (sizeY / 2) * (sizeZ / 2) + 63) / 64 words).
+static void occupancyLodDownsampleBits(const uint64_t* bitArr, uint64_t* o_lod, int sizeX, int sizeY, int sizeZ, OccupancyLodMode mode)
+{
+    const int lodSizeX = sizeX / 2, lodSizeY = sizeY / 2, lodSizeZ = sizeZ / 2;
+    VOXEL_STATS_BEGIN(VOXEL_STATS_OCCUPANCY_LOD);
+    memset(o_lod, 0, ((size_t) lodSizeX * lodSizeY * lodSizeZ + 63) / 64 * sizeof(uint64_t));
+
+    for (int z = 0; z < lodSizeZ; z++)
+        for (int y = 0; y < lodSizeY; y++)
+        {
+            const uint64_t row00 = ((uint64_t) 2 * z * sizeY + 2 * y) * sizeX, row01 = row00 + (uint64_t) sizeX * sizeY;
+            const uint64_t lodRow = ((uint64_t) z * lodSizeY + y) * lodSizeX;
+
+            for (int x = 0; x < sizeX; x += 64)
+            {
+                const int n = sizeX - x < 64 ? sizeX - x : 64;
+                const uint64_t a = occupancyLodGetBits(bitArr, row00 + x, n), b = occupancyLodGetBits(bitArr, row00 + sizeX + x, n);
+                const uint64_t c = occupancyLodGetBits(bitArr, row01 + x, n), d = occupancyLodGetBits(bitArr, row01 + sizeX + x, n);
+                uint64_t solid;
+
+                if (mode == OCCUPANCY_LOD_ANY)
+                {
+                    const uint64_t any = a | b | c | d;
+                    solid = any | (any >> 1);
+                }
+                else
+                {
+                    // the number of solid bits of every column as s2 s1 s0, 0 - 4
+                    const uint64_t ab = a ^ b, cd = c ^ d, abCarry = a & b, cdCarry = c & d;
+                    const uint64_t s0 = ab ^ cd, carry = ab & cd;
+                    const uint64_t s1 = abCarry ^ cdCarry ^ carry;
+                    const uint64_t s2 = (abCarry & cdCarry) | (carry & (abCarry ^ cdCarry));
+
+                    // plus the count of the next column, at least 4 if bit 2 of the sum or its carry is set
+                    const uint64_t o0 = s0 >> 1, o1 = s1 >> 1, o2 = s2 >> 1;
+                    const uint64_t k0 = s0 & o0;
+                    const uint64_t k1 = (s1 & o1) | (k0 & (s1 ^ o1));
+                    solid = (s2 ^ o2 ^ k1) | (s2 & o2) | (k1 & (s2 ^ o2));
+                }
+
+                occupancyLodOrBits(o_lod, lodRow + x / 2, occupancyLodEvenBits(solid), n / 2);
+            }
+        }
+
+    VOXEL_STATS_END(VOXEL_STATS_OCCUPANCY_LOD, (uint64_t) sizeX * sizeY * sizeZ, (uint64_t) sizeX * sizeY * sizeZ * 9 / 64);
+}
+
+/**
+ * Pyramids
+ */
+
+// Builds levelCount levels, o_levels[l] is reduced by 2^(l + 1) along every axis (sizes multiples of 2^levelCount).
+static void occupancyLodBuildBool(const bool* boolArr, bool* const* o_levels, int levelCount, int sizeX, int sizeY, int sizeZ,
+                                  OccupancyLodMode mode)
+{
+    const bool* below = boolArr;
+    for (int l = 0; l < levelCount; l++)
+    {
+        occupancyLodDownsampleBool(below, o_levels[l], sizeX >> l, sizeY >> l, sizeZ >> l, mode);
+        below = o_levels[l];
+    }
+}
+
+static void occupancyLodBuildBits(const uint64_t* bitArr, uint64_t* const* o_levels, int levelCount, int sizeX, int sizeY, int sizeZ,
+                                  OccupancyLodMode mode)
+{
+    const uint64_t* below = bitArr;
+    for (int l = 0; l < levelCount; l++)
+    {
+        occupancyLodDownsampleBits(below, o_levels[l], sizeX >> l, sizeY >> l, sizeZ >> l, mode);
+        below = o_levels[l];
+    }
+}
+
+// Usage Example
+void testOccupancyLod()
+{
+    const int SIZE = 64;
+    static bool boolArr[64 * 64 * 64];
+    static bool lod2[32 * 32 * 32], lod4[16 * 16 * 16], lod8[8 * 8 * 8];
+    static uint8_t distanceField8[8 * 8 * 8];
+
+    // a floor that is 1 voxel thick
+    for (int i = 0; i < SIZE * SIZE * SIZE; i++)
+        boolArr[i] = i / SIZE % SIZE == 20;
+
+    bool* levels[3] = {lod2, lod4, lod8};
+    occupancyLodBuildBool(boolArr, levels, 3, SIZE, SIZE, SIZE, OCCUPANCY_LOD_MAJORITY);
+    // lod2 has the floor at y = 10, lod4 at y = 5, lod8 at y = 2
+
+    // the levels are regular bool arrays, e.g. for distance fields of far away chunks
+    boolArrToManhattanDF(lod8, distanceField8, 8, 8, 8);
+
+    // the same on bit arrays, 64 voxels per word
+    static uint64_t bitArr[64 * 64 * 64 / 64];
+    static uint64_t bits2[32 * 32 * 32 / 64], bits4[16 * 16 * 16 / 64], bits8[8 * 8 * 8 / 64];
+    for (int i = 0; i < SIZE * SIZE * SIZE; i++)
+        bitArr[i / 64] |= (uint64_t) boolArr[i] << (i % 64);
+
+    uint64_t* bitLevels[3] = {bits2, bits4, bits8};
+    occupancyLodBuildBits(bitArr, bitLevels, 3, SIZE, SIZE, SIZE, OCCUPANCY_LOD_MAJORITY);
+    // bit i of bits8 is set where lod8[i] is true
+}
+
+#endif //VOXELDEVSCRIPTS_OCCUPANCYLOD_H
@@ -0,0 +1,277 @@
+#ifndef VOXELDEVSCRIPTS_OCTANTDISTANCEFIELD_H
+#define VOXELDEVSCRIPTS_OCTANTDISTANCEFIELD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// cpmath defines generic macros (min, div, length, ...), so it has to be included after the standard headers
+#include "BoolArrToManhattan.h"
+#include "cpmath.h"
+
+/*
+ * Directional (per octant) Manhattan distance fields, for taking bigger steps along rays.
+ *
+ * A regular distance field (BoolArrToManhattan.h) is the distance to the closest solid voxel in any direction. A ray that
+ * moves away from a wall right next to it only gets distance 1 and takes tiny steps, even though it can never hit that wall.
+ * A ray with direction signs (sx, sy, sz) can only ever reach voxels in the octant "ahead" of its current voxel (x, y, z):
+ * voxels with x' >= x if it moves in +x, x' <= x otherwise, same for y and z. So we store 8 fields, one per octant, each
+ * holding the distance to the closest solid voxel within that octant only. These are never smaller than the regular
+ * distance and much larger in corridors and caves, where most of the geometry is beside or behind the ray.
+ *
+ * The regular passes already compute these: the X pass scans every row forward (distance to the closest solid voxel with
+ * x' <= x) and backward, and only combines the two. Here we keep both results (the -x and +x fields), run the Y pass
+ * forward and backward separately on each of them (4 fields) and do the same for the Z pass (8 fields). Every pass is one
+ * sided, so building all 8 fields costs 2 + 4 + 8 half passes instead of the 6 of a regular distance field.
+ * Octants include the planes of the voxel itself, e.g. a voxel in the same row counts for both the -x and the +x octants.
+ *
+ * The octant index has bit 0 set for +x, bit 1 for +y and bit 2 for +z, octantDFIndex picks it for a direction.
+ * octantDFRaycast traverses a ray using the field matching its direction. It works with a regular distance field as well
+ * (pass the same field 8 times), which is handy for comparisons.
+ *
+ * The catch is memory: 8 fields take 8 times the space, and rays in different directions read different fields. Fewer
+ * lookups only turn into less time while the fields stay in cache, e.g. for chunk sized volumes or batches of rays sorted
+ * by octant. For big volumes and incoherent rays, measure first (bench.c compares both).
+ */
+
+// octant of a direction, components that are 0 count as negative (the octants include their planes, so either works)
+static inline int octantDFIndex(cp_vec3 direction)
+{
+    return (direction.x > 0.0f) | (direction.y > 0.0f) << 1 | (direction.z > 0.0f) << 2;
+}
+
+// Scans a row forward into o_negative (closest true at x' <= x) and backward into o_positive (closest true at x' >= x).
+// These are the two halves of manhattanDFXRow (see BoolArrToManhattan.h), but both start from the bool array.
+static inline void octantDFXRow(const bool* boolRow, uint8_t* o_negative, uint8_t* o_positive, int sizeX, int maxDistance)
+{
+    int x = 0;
+    int d = maxDistance;
+
+#ifdef __SSE2__
+    // 255 (saturating) means there is no previous element
+    const __m128i maxDistance16 = _mm_set1_epi8((char) maxDistance);
+    int prev = 255;
+    for (; x + 16 <= sizeX; x += 16)
+    {
+        _mm_storeu_si128((__m128i*) (o_negative + x), manhattanDFScanForward16(manhattanDFInit16(boolRow + x, 0, maxDistance16), prev));
+        prev = o_negative[x + 15];
+    }
+    if (x > 0)
+        d = prev;
+#endif
+
+    for (; x < sizeX; x++)
+    {
+        d = boolRow[x] ? 0 : min(maxDistance, d + 1);
+        o_negative[x] = d;
+    }
+
+    // backward, whole registers from the end of the row, the first sizeX % 16 elements (rest) are left over for scalar
+    int rest = sizeX;
+    d = maxDistance;
+
+#ifdef __SSE2__
+    rest = sizeX % 16;
+    int next = 255;
+    for (x = sizeX - 16; x >= rest; x -= 16)
+    {
+        _mm_storeu_si128((__m128i*) (o_positive + x), manhattanDFScanBackward16(manhattanDFInit16(boolRow + x, 0, maxDistance16), next));
+        next = o_positive[x];
+    }
+    if (rest < sizeX)
+        d = next;
+#endif
+
+    for (int i = rest - 1; i >= 0; i--)
+    {
+        d = boolRow[i] ? 0 : min(maxDistance, d + 1);
+        o_positive[i] = d;
+    }
+}
+
+// one sided Y pass: looks at the previous rows (-y) if positive is false, at the next rows (+y) otherwise
+static void octantDFYPASS(uint8_t* field, int sizeX, int sizeY, int sizeZ, bool positive)
+{
+    for (int z = 0; z < sizeZ; z++)
+    {
+        uint8_t* plane = field + (uint64_t) z * sizeX * sizeY;
+
+        if (positive)
+            for (int y = sizeY - 2; y >= 0; y--)
+                boolArrToManhattanDFRelaxRow(plane + y * sizeX, plane + (y + 1) * sizeX, sizeX);
+        else
+            for (int y = 1; y < sizeY; y++)
+                boolArrToManhattanDFRelaxRow(plane + y * sizeX, plane + (y - 1) * sizeX, sizeX);
+    }
+}
+
+// one sided Z pass, planes are contiguous, so each one is relaxed like a single row
+static void octantDFZPASS(uint8_t* field, int sizeX, int sizeY, int sizeZ, bool positive)
+{
+    const int planeSize = sizeX * sizeY;
+
+    if (positive)
+        for (int z = sizeZ - 2; z >= 0; z--)
+            boolArrToManhattanDFRelaxRow(field + (uint64_t) z * planeSize, field + (uint64_t) (z + 1) * planeSize, planeSize);
+    else
+        for (int z = 1; z < sizeZ; z++)
+            boolArrToManhattanDFRelaxRow(field + (uint64_t) z * planeSize, field + (uint64_t) (z - 1) * planeSize, planeSize);
+}
+
+// Computes all 8 octant fields (o_fields[octant], each sizeX * sizeY * sizeZ bytes) from a bool array, true is solid.
+static void boolArrToOctantDF(const bool* boolArr, uint8_t* const o_fields[8], int sizeX, int sizeY, int sizeZ)
+{
+    const int maxDistance = min(254, sizeX + sizeY + sizeZ);
+    const size_t count = (size_t) sizeX * sizeY * sizeZ;
+    VOXEL_STATS_BEGIN(VOXEL_STATS_OCTANT_DF);
+
+    for (int z = 0; z < sizeZ; z++)
+        for (int y = 0; y < sizeY; y++)
+        {
+            const uint64_t rowStart = (uint64_t) z * sizeX * sizeY + (uint64_t) y * sizeX;
+            octantDFXRow(boolArr + rowStart, o_fields[0] + rowStart, o_fields[1] + rowStart, sizeX, maxDistance);
+        }
+
+    // every field splits into the one looking in -y (in place) and the one looking in +y (a copy), same for z
+    for (int octant = 0; octant < 2; octant++)
+    {
+        memcpy(o_fields[octant | 2], o_fields[octant], count);
+        octantDFYPASS(o_fields[octant], sizeX, sizeY, sizeZ, false);
+        octantDFYPASS(o_fields[octant | 2], sizeX, sizeY, sizeZ, true);
+    }
+
+    for (int octant = 0; octant < 4; octant++)
+    {
+        memcpy(o_fields[octant | 4], o_fields[octant], count);
+        octantDFZPASS(o_fields[octant], sizeX, sizeY, sizeZ, false);
+        octantDFZPASS(o_fields[octant | 4], sizeX, sizeY, sizeZ, true);
+    }
+
+    // X rows: bools in, 2 fields out. Y and Z: a copy (2 bytes) and two half passes (4 bytes) per split
+    VOXEL_STATS_END(VOXEL_STATS_OCTANT_DF, count, 3 * count + 2 * 6 * count + 4 * 6 * count);
+}
+
+/**
+ * Traversal
+ */
+
+typedef struct OctantDFHit
+{
+    bool hit;
+    float t;            // origin + direction * t is where the ray entered the solid voxel (maxT if there was no hit)
+    int x, y, z;        // the solid voxel
+    int steps;          // number of distance field lookups, for profiling
+} OctantDFHit;
+
+// Lower bound of the Manhattan distance from voxel (x, y, z) to the closest solid voxel in the octant of field.
+// Outside of the volume, the distance to the volume is added to the distance of the closest voxel inside of it (the
+// octant of the clamped voxel contains the octant of the original one, so this stays a lower bound).
+static inline int octantDFDistance(const uint8_t* field, int sizeX, int sizeY, int sizeZ, int x, int y, int z)
+{
+    const int cx = x < 0 ? 0 : x >= sizeX ? sizeX - 1 : x;
+    const int cy = y < 0 ? 0 : y >= sizeY ? sizeY - 1 : y;
+    const int cz = z < 0 ? 0 : z >= sizeZ ? sizeZ - 1 : z;
+    const int outside = abs(x - cx) + abs(y - cy) + abs(z - cz);
+
+    return outside + field[(uint64_t) cz * sizeX * sizeY + (uint64_t) cy * sizeX + cx];
+}
+
+// The t at which the ray leaves the voxel containing origin + direction * t.
+static inline float octantDFNextVoxel(const float origin[3], const float direction[3], float t)
+{
+    float next = INFINITY;
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (direction[i] == 0.0f)
+            continue;
+
+        const float p = origin[i] + direction[i] * t;
+        const float boundary = direction[i] > 0.0f ? floorf(p) + 1.0f : floorf(p);
+        next = fminf(next, (boundary - origin[i]) / direction[i]);
+    }
+
+    return next;
+}
+
+// Traverses origin + direction * t for t in [0, maxT] and stops at the first solid voxel, see lineOfSight (LineOfSight.h)
+// for how the steps work. Voxels outside of the volume are empty. Returns true on a hit.
+static bool octantDFRaycast(const uint8_t* const fields[8], int sizeX, int sizeY, int sizeZ, cp_vec3 origin, cp_vec3 direction,
+                            float maxT, OctantDFHit* o_hit)
+{
+    const uint8_t* field = fields[octantDFIndex(direction)];
+    const float o[3] = {origin.x, origin.y, origin.z};
+    const float d[3] = {direction.x, direction.y, direction.z};
+    const float lengthL1 = fabsf(d[0]) + fabsf(d[1]) + fabsf(d[2]);
+    const float maxComponent = fmaxf(fabsf(d[0]), fmaxf(fabsf(d[1]), fabsf(d[2])));
+
+    // the DDA steps land this far (in voxels) behind the voxel boundary, so the next lookup is in the next voxel
+    const float epsilon = maxComponent > 0.0f ? 0.0001f / maxComponent : INFINITY;
+
+    OctantDFHit hit = {.hit = false, .t = maxT};
+    float t = 0.0f, entry = 0.0f;
+
+    while (t <= maxT)
+    {
+        const int x = (int) floorf(o[0] + d[0] * t), y = (int) floorf(o[1] + d[1] * t), z = (int) floorf(o[2] + d[2] * t);
+        const int distance = octantDFDistance(field, sizeX, sizeY, sizeZ, x, y, z);
+        hit.steps++;
+
+        if (distance == 0)
+        {
+            hit.hit = true;
+            hit.t = entry;
+            hit.x = x, hit.y = y, hit.z = z;
+            break;
+        }
+
+        if (distance >= 4)
+            t += (float) (distance - 3) / lengthL1;
+        else
+        {
+            // entry is the exact boundary, t is a bit behind it
+            entry = fmaxf(octantDFNextVoxel(o, d, t), t);
+            t = entry + epsilon;
+            continue;
+        }
+        entry = t;
+    }
+
+    if (o_hit)
+        *o_hit = hit;
+    return hit.hit;
+}
+
+// Usage Example
+void testOctantDF()
+{
+    const int SIZE = 32;
+    const int COUNT = SIZE * SIZE * SIZE;
+
+    // a floor at z = 0 and a wall at x = 30
+    bool boolArr[COUNT];
+    for (int i = 0; i < COUNT; i++)
+        boolArr[i] = i / SIZE / SIZE == 0 || i % SIZE >= 30;
+
+    static uint8_t storage[8][32 * 32 * 32];
+    uint8_t* fields[8];
+    for (int i = 0; i < 8; i++)
+        fields[i] = storage[i];
+
+    boolArrToOctantDF(boolArr, fields, SIZE, SIZE, SIZE);
+
+    // a ray just above the floor: a regular distance field is 1 there and the ray would need a step per voxel. It moves
+    // away from the floor though, so the +x +z field only contains the wall and the ray gets there in a few big steps
+    cp_vec3 origin = {.x = 1.5f, .y = 16.5f, .z = 1.5f};
+    cp_vec3 direction = {.x = 1.0f, .y = 0.0f, .z = 0.25f};
+
+    OctantDFHit hit;
+    if (octantDFRaycast((const uint8_t* const*) fields, SIZE, SIZE, SIZE, origin, direction, 64.0f, &hit))
+    {
+        // hit.x == 30 and hit.t == 28.5, after a handful of steps
+    }
+}
+
+#endif //VOXELDEVSCRIPTS_OCTANTDISTANCEFIELD_H
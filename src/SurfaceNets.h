@@ -0,0 +1,410 @@
+#ifndef VOXELDEVSCRIPTS_SURFACENETS_H
+#define VOXELDEVSCRIPTS_SURFACENETS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+#include "VoxelStats.h"
+// cpmath defines generic macros (min, div, length, ...), so it has to be included after the standard headers
+#include "cpmath.h"
+
+/*
+ * Smooth isosurfaces with Surface Nets: a mesher for scalar volumes in the usual flattened layout
+ * (index = z * sizeX * sizeY + y * sizeX + x), either float volumes (density, noise, ...) or the signed Manhattan field of
+ * BoolArrToSignedManhattan.h.
+ *
+ * Samples below the iso level are inside (solid), the others outside. A cell is the cube between 8 neighbouring samples,
+ * every cell whose corners are not all on the same side gets exactly one vertex: the average of the points where its 12
+ * edges cross the iso level (linear interpolation along the edge). Every edge that crosses the iso level is shared by 4
+ * cells, their vertices form a quad (2 triangles, facing outside). This is the "mass point" flavour of dual contouring,
+ * without the normals and the QEF solve, so sharp edges come out rounded, but the mesh is watertight and has about a
+ * third of the triangles of marching cubes, without its tables.
+ * For the signed field (no zeros, the surface lies between -1 and 1) the iso level is 0, so the crossings are always
+ * halfway between the samples and the surface looks like a rounded version of the voxels.
+ *
+ * Finding the cells that need a vertex is done on bits: the samples of a row are compared with the iso level 8 at a time
+ * (AVX, 4 with SSE2) and packed into a bit row with movemask. A cell is on the surface if any but not all of its 8
+ * corners are inside, which for 64 cells of a row is a handful of ANDs and ORs of the 4 bit rows around them (and the
+ * same rows shifted by one for the +x corners). Only those cells are looked at one by one. In most terrain chunks, that's
+ * a few percent of the cells.
+ *
+ * The quad of an edge needs the vertices of the cells at -1 along the other two axes. They were created before (the
+ * cells are visited in memory order), and their indices are kept in two slices of the cell grid, the current z and
+ * the previous one, which swap roles after every slice. No hash map, and the only memory besides the output is those two
+ * slices (and two bit slices), on the stack.
+ * Every cell looks at the 3 edges that start at its min corner, so every edge is meshed once. Edges that don't have 4
+ * cells around them (on the faces of the volume) and the edges that leave the last cell along their axis are skipped.
+ * That way, chunks can be meshed seamlessly: give every chunk 2 layers of samples of its +x, +y and +z neighbours
+ * (sizeX = chunk size + 2, ...). The last cell of the chunk is the first cell of the neighbour, both get the same vertex,
+ * and every edge around it is meshed by exactly one of the two.
+ *
+ * surfaceNetsChunks meshes many chunks in parallel, the output buffers are provided by the caller, nothing is allocated.
+ * The output is PackedVec3 vertices in sample coordinates (sample (x, y, z) is at (x, y, z)) and triangles as 3 uint32
+ * indices each.
+ *
+ * The complexity is O(n) for n samples: the sign bits of every sample once, plus O(1) per surface cell.
+ */
+
+typedef struct SurfaceNetsMesh
+{
+    PackedVec3* vertices;
+    uint32_t* indices;          // 3 per triangle, 2 triangles per quad
+    uint32_t vertexCapacity;
+    uint32_t indexCapacity;
+    uint32_t vertexCount;       // set by the mesher
+    uint32_t indexCount;
+} SurfaceNetsMesh;
+
+// corner i of a cell is at (i & 1, (i >> 1) & 1, i >> 2)
+static const uint8_t SURFACE_NETS_EDGES[12][2] = {
+    {0, 1}, {2, 3}, {4, 5}, {6, 7},     // along x
+    {0, 2}, {1, 3}, {4, 6}, {5, 7},     // along y
+    {0, 4}, {1, 5}, {2, 6}, {3, 7},     // along z
+};
+
+/**
+ * Sign bits
+ */
+
+// bit x of row y (words of 64 per row) is set if the sample is inside
+static void surfaceNetsSliceSigns(const float* slice, uint64_t* o_bits, int sizeX, int sizeY, float isoLevel)
+{
+    const int words = (sizeX + 63) / 64;
+    memset(o_bits, 0, (size_t) words * sizeY * sizeof(uint64_t));
+
+    for (int y = 0; y < sizeY; y++)
+    {
+        const float* row = slice + (size_t) y * sizeX;
+        uint64_t* bits = o_bits + (size_t) y * words;
+
+        // x is a multiple of the lane count, so the lanes never straddle two words
+        int x = 0;
+#ifdef __AVX__
+        const __m256 iso = _mm256_set1_ps(isoLevel);
+        for (; x + 8 <= sizeX; x += 8)
+            bits[x >> 6] |= (uint64_t) _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(row + x), iso, _CMP_LT_OQ)) << (x & 63);
+#elif defined(__SSE2__)
+        const __m128 iso = _mm_set1_ps(isoLevel);
+        for (; x + 4 <= sizeX; x += 4)
+            bits[x >> 6] |= (uint64_t) _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(row + x), iso)) << (x & 63);
+#endif
+        for (; x < sizeX; x++)
+            bits[x >> 6] |= (uint64_t) (row[x] < isoLevel) << (x & 63);
+    }
+}
+
+// the bits of a row starting at sample 64 * w + 1, the +x corners of the cells of word w
+static inline uint64_t surfaceNetsShifted(const uint64_t* bits, int w, int words)
+{
+    return (bits[w] >> 1) | (w + 1 < words ? bits[w + 1] << 63 : 0);
+}
+
+/**
+ * Mesher
+ */
+
+static inline PackedVec3 surfaceNetsVertex(const float corners[8], int mask, float isoLevel, int x, int y, int z)
+{
+    float sumX = 0.0f, sumY = 0.0f, sumZ = 0.0f;
+    int crossings = 0;
+
+    for (int e = 0; e < 12; e++)
+    {
+        const int a = SURFACE_NETS_EDGES[e][0], b = SURFACE_NETS_EDGES[e][1];
+        if (!(((mask >> a) ^ (mask >> b)) & 1))
+            continue;
+
+        // one of the two is below the iso level and the other one isn't, so they can't be equal
+        const float t = (isoLevel - corners[a]) / (corners[b] - corners[a]);
+        sumX += (float) (a & 1) + t * (float) ((b & 1) - (a & 1));
+        sumY += (float) ((a >> 1) & 1) + t * (float) (((b >> 1) & 1) - ((a >> 1) & 1));
+        sumZ += (float) (a >> 2) + t * (float) ((b >> 2) - (a >> 2));
+        crossings++;
+    }
+
+    const float inv = 1.0f / (float) crossings;
+    return (PackedVec3) {(float) x + sumX * inv, (float) y + sumY * inv, (float) z + sumZ * inv};
+}
+
+// the quad a, b, c, d as 2 triangles, reversed if flip
+static inline bool surfaceNetsQuad(SurfaceNetsMesh* mesh, uint32_t a, uint32_t b, uint32_t c, uint32_t d, bool flip)
+{
+    if (mesh->indexCount + 6 > mesh->indexCapacity)
+        return false;
+
+    uint32_t* out = mesh->indices + mesh->indexCount;
+    if (flip)
+    {
+        uint32_t t = b;
+        b = d;
+        d = t;
+    }
+    out[0] = a;
+    out[1] = b;
+    out[2] = c;
+    out[3] = a;
+    out[4] = c;
+    out[5] = d;
+    mesh->indexCount += 6;
+    return true;
+}
+
+// the float samples of slice z, converted from the signed field into buffer if there is one
+static inline const float* surfaceNetsSlice(const float* volume, const int8_t* signedField, float* buffer, int z, int sizeX, int sizeY)
+{
+    const size_t sliceSize = (size_t) sizeX * sizeY;
+    if (volume)
+        return volume + (size_t) z * sliceSize;
+
+    const int8_t* in = signedField + (size_t) z * sliceSize;
+    for (size_t i = 0; i < sliceSize; i++)
+        buffer[i] = (float) in[i];
+    return buffer;
+}
+
+// Either volume or signedField is set. Returns false if the mesh didn't fit, the counts then hold what did.
+static bool surfaceNetsMesh(const float* volume, const int8_t* signedField, int sizeX, int sizeY, int sizeZ, float isoLevel,
+                            SurfaceNetsMesh* mesh)
+{
+    mesh->vertexCount = 0;
+    mesh->indexCount = 0;
+    if (sizeX < 2 || sizeY < 2 || sizeZ < 2)
+        return true;
+
+    const int words = (sizeX + 63) / 64;
+    const int cellsX = sizeX - 1, cellsY = sizeY - 1;
+    const size_t sliceSize = (size_t) sizeX * sizeY;
+    const size_t bitSlice = (size_t) words * sizeY;
+    const size_t cellSlice = (size_t) cellsX * cellsY;
+    // the cells of the last word that exist (none if sizeX is 64 * k + 1), the bits above them are the +x corners of
+    // cells beyond the volume
+    const int lastCells = cellsX - 64 * (words - 1);
+    const uint64_t lastWordCells = lastCells >= 64 ? ~0ull : (1ull << lastCells) - 1;
+
+    uint64_t signs[2 * bitSlice];
+    uint32_t cache[2 * cellSlice];
+    float buffer[signedField ? 2 * sliceSize : 1];
+
+    const float* slice0 = surfaceNetsSlice(volume, signedField, buffer, 0, sizeX, sizeY);
+    uint64_t* bits0 = signs;
+    uint64_t* bits1 = signs + bitSlice;
+    surfaceNetsSliceSigns(slice0, bits0, sizeX, sizeY, isoLevel);
+
+    for (int z = 0; z < sizeZ - 1; z++)
+    {
+        const float* slice1 = surfaceNetsSlice(volume, signedField, buffer + ((z + 1) & 1) * (signedField ? sliceSize : 0),
+                                               z + 1, sizeX, sizeY);
+        surfaceNetsSliceSigns(slice1, bits1, sizeX, sizeY, isoLevel);
+
+        uint32_t* current = cache + (z & 1) * cellSlice;
+        const uint32_t* previous = cache + ((z + 1) & 1) * cellSlice;
+
+        for (int y = 0; y < cellsY; y++)
+        {
+            const uint64_t* rows[4] = {bits0 + (size_t) y * words, bits0 + (size_t) (y + 1) * words,
+                                       bits1 + (size_t) y * words, bits1 + (size_t) (y + 1) * words};
+
+            for (int w = 0; w < words; w++)
+            {
+                uint64_t any = 0, all = ~0ull;
+                for (int r = 0; r < 4; r++)
+                {
+                    const uint64_t lo = rows[r][w], hi = surfaceNetsShifted(rows[r], w, words);
+                    any |= lo | hi;
+                    all &= lo & hi;
+                }
+
+                uint64_t active = any & ~all;
+                if (w == words - 1)
+                    active &= lastWordCells;
+
+                while (active)
+                {
+                    const int x = w * 64 + __builtin_ctzll(active);
+                    active &= active - 1;
+
+                    const size_t s = (size_t) y * sizeX + x;
+                    const float corners[8] = {slice0[s], slice0[s + 1], slice0[s + sizeX], slice0[s + sizeX + 1],
+                                              slice1[s], slice1[s + 1], slice1[s + sizeX], slice1[s + sizeX + 1]};
+                    int mask = 0;
+                    for (int i = 0; i < 8; i++)
+                        mask |= (corners[i] < isoLevel) << i;
+
+                    if (mesh->vertexCount >= mesh->vertexCapacity)
+                        return false;
+                    const size_t c = (size_t) y * cellsX + x;
+                    const uint32_t v = mesh->vertexCount++;
+                    mesh->vertices[v] = surfaceNetsVertex(corners, mask, isoLevel, x, y, z);
+                    current[c] = v;
+
+                    // the 3 edges starting at corner 0, the quads face away from the inside corner
+                    const bool flip = !(mask & 1);
+                    if (((mask ^ (mask >> 1)) & 1) && y > 0 && z > 0 && x < cellsX - 1)
+                        if (!surfaceNetsQuad(mesh, v, current[c - cellsX], previous[c - cellsX], previous[c], flip))
+                            return false;
+                    if (((mask ^ (mask >> 2)) & 1) && x > 0 && z > 0 && y < cellsY - 1)
+                        if (!surfaceNetsQuad(mesh, v, previous[c], previous[c - 1], current[c - 1], flip))
+                            return false;
+                    if (((mask ^ (mask >> 4)) & 1) && x > 0 && y > 0 && z < sizeZ - 2)
+                        if (!surfaceNetsQuad(mesh, v, current[c - 1], current[c - 1 - cellsX], current[c - cellsX], flip))
+                            return false;
+                }
+            }
+        }
+
+        slice0 = slice1;
+        uint64_t* t = bits0;
+        bits0 = bits1;
+        bits1 = t;
+    }
+
+    return true;
+}
+
+// Meshes the iso surface of a float volume (samples below isoLevel are inside). The volume should be chunk sized,
+// the mesher keeps a few slices of it on the stack. Returns false if mesh had too little capacity.
+static bool surfaceNetsExtract(const float* volume, int sizeX, int sizeY, int sizeZ, float isoLevel, SurfaceNetsMesh* mesh)
+{
+    VOXEL_STATS_BEGIN(VOXEL_STATS_SURFACE_NETS);
+    const bool fits = surfaceNetsMesh(volume, NULL, sizeX, sizeY, sizeZ, isoLevel, mesh);
+    VOXEL_STATS_END(VOXEL_STATS_SURFACE_NETS, (uint64_t) sizeX * sizeY * sizeZ,
+                    4ull * sizeX * sizeY * sizeZ + 12ull * mesh->vertexCount + 4ull * mesh->indexCount);
+    return fits;
+}
+
+// Same for the signed Manhattan field of boolArrToSignedManhattanDF (true voxels are inside).
+static bool surfaceNetsExtractSigned(const int8_t* signedField, int sizeX, int sizeY, int sizeZ, SurfaceNetsMesh* mesh)
+{
+    VOXEL_STATS_BEGIN(VOXEL_STATS_SURFACE_NETS);
+    const bool fits = surfaceNetsMesh(NULL, signedField, sizeX, sizeY, sizeZ, 0.0f, mesh);
+    VOXEL_STATS_END(VOXEL_STATS_SURFACE_NETS, (uint64_t) sizeX * sizeY * sizeZ,
+                    1ull * sizeX * sizeY * sizeZ + 12ull * mesh->vertexCount + 4ull * mesh->indexCount);
+    return fits;
+}
+
+/**
+ * Chunk driver
+ */
+
+typedef struct SurfaceNetsChunk
+{
+    const float* volume;        // a float volume (meshed at the isoLevel of surfaceNetsChunks)
+    const int8_t* signedField;  // or a signed Manhattan field, if volume is NULL
+    SurfaceNetsMesh mesh;
+    bool fits;                  // set by surfaceNetsChunks, false if the capacity of mesh was too small
+} SurfaceNetsChunk;
+
+typedef struct SurfaceNetsJob
+{
+    SurfaceNetsChunk* chunks;
+    int chunkCount;
+    int sizeX, sizeY, sizeZ;
+    float isoLevel;
+    VoxelStats* stats;      // of the calling thread, the workers record into it as well
+    atomic_int nextChunk;
+} SurfaceNetsJob;
+
+static void* surfaceNetsWorker(void* arg)
+{
+    SurfaceNetsJob* job = arg;
+    VoxelStats* previousStats = voxelStatsBind(job->stats);
+
+    // chunks are handed out one at a time, chunks without a surface take next to no time and others a lot
+    for (int i = atomic_fetch_add(&job->nextChunk, 1); i < job->chunkCount; i = atomic_fetch_add(&job->nextChunk, 1))
+    {
+        SurfaceNetsChunk* chunk = job->chunks + i;
+        chunk->fits = chunk->volume
+                      ? surfaceNetsExtract(chunk->volume, job->sizeX, job->sizeY, job->sizeZ, job->isoLevel, &chunk->mesh)
+                      : surfaceNetsExtractSigned(chunk->signedField, job->sizeX, job->sizeY, job->sizeZ, &chunk->mesh);
+    }
+
+    voxelStatsBind(previousStats);
+    return NULL;
+}
+
+// Meshes chunkCount chunks of the same size on threadCount threads (including the calling one).
+// threadCount <= 0 uses one thread per online CPU.
+static void surfaceNetsChunks(SurfaceNetsChunk* chunks, int chunkCount, int sizeX, int sizeY, int sizeZ, float isoLevel,
+                              int threadCount)
+{
+    if (threadCount <= 0)
+        threadCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadCount > chunkCount)
+        threadCount = chunkCount;
+    if (threadCount < 1)
+        threadCount = 1;
+
+    VOXEL_STATS_BEGIN(VOXEL_STATS_SURFACE_NETS_CHUNKS);
+    SurfaceNetsJob job = {.chunks = chunks, .chunkCount = chunkCount, .sizeX = sizeX, .sizeY = sizeY, .sizeZ = sizeZ,
+                          .isoLevel = isoLevel, .stats = voxelStatsGetCurrent()};
+    atomic_init(&job.nextChunk, 0);
+
+    pthread_t threads[threadCount];
+    int started = 0;
+    for (; started < threadCount - 1; started++)
+        if (pthread_create(&threads[started], NULL, surfaceNetsWorker, &job) != 0)
+            break; // the remaining threads do the work anyway
+
+    surfaceNetsWorker(&job);
+
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    VOXEL_STATS_END(VOXEL_STATS_SURFACE_NETS_CHUNKS, (uint64_t) chunkCount * sizeX * sizeY * sizeZ,
+                    4ull * chunkCount * sizeX * sizeY * sizeZ);
+}
+
+// Usage Example
+void testSurfaceNets()
+{
+    // a 32^3 chunk plus the 2 layers shared with the +x, +y and +z neighbours
+    const int SIZE = 34;
+
+    // a sphere of radius 12, negative inside
+    float volume[SIZE * SIZE * SIZE];
+    for (int z = 0; z < SIZE; z++)
+        for (int y = 0; y < SIZE; y++)
+            for (int x = 0; x < SIZE; x++)
+            {
+                const float dx = (float) x - 16.0f, dy = (float) y - 16.0f, dz = (float) z - 16.0f;
+                volume[(z * SIZE + y) * SIZE + x] = sqrtf(dx * dx + dy * dy + dz * dz) - 12.0f;
+            }
+
+    // a sphere of radius r has about 4 pi r^2 surface cells, 8192 vertices and 6 indices per vertex are plenty
+    static PackedVec3 vertices[8192];
+    static uint32_t indices[6 * 8192];
+    SurfaceNetsMesh mesh = {.vertices = vertices, .indices = indices, .vertexCapacity = 8192, .indexCapacity = 6 * 8192};
+
+    if (surfaceNetsExtract(volume, SIZE, SIZE, SIZE, 0.0f, &mesh))
+    {
+        // mesh.vertexCount vertices and mesh.indexCount / 3 triangles, ready for upload
+    }
+
+    // many chunks at once (the same one twice here), the meshes need their own buffers
+    static PackedVec3 vertices2[8192];
+    static uint32_t indices2[6 * 8192];
+    SurfaceNetsChunk chunks[2] = {
+        {.volume = volume, .mesh = {.vertices = vertices, .indices = indices, .vertexCapacity = 8192, .indexCapacity = 6 * 8192}},
+        {.volume = volume, .mesh = {.vertices = vertices2, .indices = indices2, .vertexCapacity = 8192, .indexCapacity = 6 * 8192}},
+    };
+    surfaceNetsChunks(chunks, 2, SIZE, SIZE, SIZE, 0.0f, 0);
+
+    // any size works, the rows don't have to fill the 64 bit words (65 samples are 64 cells, the second word has none)
+    const int SIZE_X = 65, SIZE_YZ = 8;
+    float slab[SIZE_X * SIZE_YZ * SIZE_YZ];
+    for (int z = 0; z < SIZE_YZ; z++)
+        for (int y = 0; y < SIZE_YZ; y++)
+            for (int x = 0; x < SIZE_X; x++)
+                slab[(z * SIZE_YZ + y) * SIZE_X + x] = (float) y - 3.5f;
+    surfaceNetsExtract(slab, SIZE_X, SIZE_YZ, SIZE_YZ, 0.0f, &mesh);
+}
+
+#endif //VOXELDEVSCRIPTS_SURFACENETS_H
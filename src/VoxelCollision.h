@@ -0,0 +1,244 @@
+#ifndef VOXELDEVSCRIPTS_VOXELCOLLISION_H
+#define VOXELDEVSCRIPTS_VOXELCOLLISION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "VoxelStats.h"
+// cpmath defines generic macros (min, div, length, ...), so it has to be included after the standard headers
+#include "cpmath.h"
+
+/*
+ * Swept AABB collision of moving boxes (entities) against the voxels of a Manhattan distance field (BoolArrToManhattan.h),
+ * voxels with distance 0 are solid. Voxel (x, y, z) occupies [x, x + 1] x [y, y + 1] x [z, z + 1], positions are in voxels.
+ *
+ * Checking every voxel overlapped by the swept box is expensive for long moves and big boxes. The distance field tells us
+ * how far we can move without looking at any voxel at all:
+ *  -   if the voxel containing the center of the box has the distance D, every point of a solid voxel is at least D - 3 away
+ *      from the center (Manhattan distance, each axis can lose up to one voxel because the center can be anywhere in its voxel).
+ *  -   every point of the box is at most R = halfExtents.x + halfExtents.y + halfExtents.z away from its center.
+ *  -   so the box can move (D - 3 - R) (again Manhattan distance) in any direction without touching a solid voxel.
+ * We take such conservative steps through open space and only fall back to exact tests against the individual voxels when
+ * we are less than one voxel away from geometry. The exact test then advances at most one voxel per step.
+ *
+ * The exact test treats touching as not colliding, so a box resting on the ground can slide along it. Contacts leave a small
+ * gap (VOXEL_COLLISION_SKIN) so that the next move doesn't start inside of the voxel because of rounding errors.
+ * Voxels that already overlap the box at the start of a move are ignored (there's no way to sweep out of them, use a signed
+ * distance field to push the box out). Voxels outside of the volume are treated as empty.
+ */
+
+#define VOXEL_COLLISION_SKIN 0.001f
+
+typedef struct VoxelCollisionHit
+{
+    bool hit;
+    float time;         // fraction of the motion that could be done before the contact (1 if there was no hit)
+    cp_vec3 position;   // center of the box at the contact (or at the end of the motion)
+    cp_vec3 normal;     // axis aligned normal of the contact, pointing away from the voxel, zero if there was no hit
+    cp_vec3 slide;      // the rest of the motion, with the component along the normal removed
+} VoxelCollisionHit;
+
+// Lower bound of the Manhattan distance (in voxels) from voxel (x, y, z) to the closest solid voxel.
+// Outside of the volume, the distance to the volume is added to the distance of the closest voxel inside of it.
+static inline int voxelCollisionDistance(const uint8_t* distanceField, int sizeX, int sizeY, int sizeZ, int x, int y, int z)
+{
+    const int cx = x < 0 ? 0 : x >= sizeX ? sizeX - 1 : x;
+    const int cy = y < 0 ? 0 : y >= sizeY ? sizeY - 1 : y;
+    const int cz = z < 0 ? 0 : z >= sizeZ ? sizeZ - 1 : z;
+    const int outside = abs(x - cx) + abs(y - cy) + abs(z - cz);
+
+    return outside + distanceField[(uint64_t) cz * sizeX * sizeY + (uint64_t) cy * sizeX + cx];
+}
+
+// Exact swept test of a box (center p, half extents e) moving by m * t for t in [0, tMax] against the voxel (x, y, z).
+// Returns the time of the first contact or a negative value, writes the axis (0 - 2) of the contact to o_axis.
+static inline float voxelCollisionSweepVoxel(const float p[3], const float e[3], const float m[3], float tMax, int x, int y, int z, int* o_axis)
+{
+    const int v[3] = {x, y, z};
+    float entry = -INFINITY, exit = tMax;
+    int axis = 0;
+
+    for (int i = 0; i < 3; i++)
+    {
+        // the center of the box overlaps the (open) interval of the voxel extended by the half extents
+        const float lo = (float) v[i] - e[i], hi = (float) v[i] + 1.0f + e[i];
+
+        if (m[i] == 0.0f)
+        {
+            if (p[i] <= lo || p[i] >= hi)
+                return -1.0f;
+            continue;
+        }
+
+        float t1 = (lo - p[i]) / m[i], t2 = (hi - p[i]) / m[i];
+        if (t1 > t2)
+        {
+            float tmp = t1;
+            t1 = t2;
+            t2 = tmp;
+        }
+
+        if (t1 > entry)
+            entry = t1, axis = i;
+        if (t2 < exit)
+            exit = t2;
+    }
+
+    // entry < 0 means the box already overlaps the voxel. If it's only by a rounding error (less than the skin), it's
+    // a contact at time 0, otherwise we ignore the voxel.
+    if (entry >= exit || entry * fabsf(m[axis]) < -VOXEL_COLLISION_SKIN)
+        return -1.0f;
+
+    *o_axis = axis;
+    return entry > 0.0f ? entry : 0.0f;
+}
+
+// Moves the box with the given center and half extents by motion and stops at the first solid voxel.
+static VoxelCollisionHit voxelCollisionSweep(const uint8_t* distanceField, int sizeX, int sizeY, int sizeZ,
+                                             cp_vec3 center, cp_vec3 halfExtents, cp_vec3 motion)
+{
+    const float e[3] = {halfExtents.x, halfExtents.y, halfExtents.z};
+    const float m[3] = {motion.x, motion.y, motion.z};
+    const float motionL1 = fabsf(m[0]) + fabsf(m[1]) + fabsf(m[2]);
+    const float motionMax = fmaxf(fabsf(m[0]), fmaxf(fabsf(m[1]), fabsf(m[2])));
+    const float radius = e[0] + e[1] + e[2];
+
+    VoxelCollisionHit result = {.hit = false, .time = 1.0f};
+    float t = 0.0f;
+
+    while (motionL1 > 0.0f && t < 1.0f)
+    {
+        const float p[3] = {center.x + m[0] * t, center.y + m[1] * t, center.z + m[2] * t};
+        const int distance = voxelCollisionDistance(distanceField, sizeX, sizeY, sizeZ,
+                                                    (int) floorf(p[0]), (int) floorf(p[1]), (int) floorf(p[2]));
+
+        // far enough from everything, step through open space without looking at voxels
+        const float safe = (float) distance - 3.0f - radius;
+        if (safe >= 1.0f)
+        {
+            t += safe / motionL1;
+            continue;
+        }
+
+        // close to geometry: test all voxels touched by the box while it moves at most one voxel along every axis
+        const float dt = fminf(1.0f - t, 1.0f / motionMax);
+        int lo[3], hi[3];
+        for (int i = 0; i < 3; i++)
+        {
+            const float a = p[i], b = p[i] + m[i] * dt;
+            lo[i] = (int) floorf(fminf(a, b) - e[i]);
+            hi[i] = (int) floorf(fmaxf(a, b) + e[i]);
+        }
+        lo[0] = lo[0] < 0 ? 0 : lo[0], hi[0] = hi[0] >= sizeX ? sizeX - 1 : hi[0];
+        lo[1] = lo[1] < 0 ? 0 : lo[1], hi[1] = hi[1] >= sizeY ? sizeY - 1 : hi[1];
+        lo[2] = lo[2] < 0 ? 0 : lo[2], hi[2] = hi[2] >= sizeZ ? sizeZ - 1 : hi[2];
+
+        float first = dt;
+        int firstAxis = -1;
+        for (int z = lo[2]; z <= hi[2]; z++)
+            for (int y = lo[1]; y <= hi[1]; y++)
+                for (int x = lo[0]; x <= hi[0]; x++)
+                {
+                    int axis;
+                    if (distanceField[(uint64_t) z * sizeX * sizeY + (uint64_t) y * sizeX + x] != 0)
+                        continue;
+
+                    const float contact = voxelCollisionSweepVoxel(p, e, m, dt, x, y, z, &axis);
+                    if (contact >= 0.0f && (contact < first || firstAxis < 0))
+                        first = contact, firstAxis = axis;
+                }
+
+        if (firstAxis >= 0)
+        {
+            result.hit = true;
+            result.time = t + first;
+            result.normal.arr[firstAxis] = m[firstAxis] > 0.0f ? -1.0f : 1.0f;
+            break;
+        }
+
+        t += dt;
+    }
+
+    result.time = result.time > 1.0f ? 1.0f : result.time;
+    result.position.x = center.x + m[0] * result.time;
+    result.position.y = center.y + m[1] * result.time;
+    result.position.z = center.z + m[2] * result.time;
+
+    if (result.hit)
+    {
+        // back off along the normal, so the box doesn't touch the voxel
+        for (int i = 0; i < 3; i++)
+        {
+            result.position.arr[i] += result.normal.arr[i] * VOXEL_COLLISION_SKIN;
+            result.slide.arr[i] = result.normal.arr[i] != 0.0f ? 0.0f : m[i] * (1.0f - result.time);
+        }
+    }
+
+    return result;
+}
+
+// Moves the box by motion and slides along the voxels it hits (at most 3 times, once per axis), like a character controller.
+// Returns the new center. o_contacts (may be NULL) gets a bit set for every normal of a contact on the way
+// (bit 0: -x, 1: +x, 2: -y, 3: +y, 4: -z, 5: +z), e.g. (*o_contacts & 32) means the box is standing on the ground.
+static cp_vec3 voxelCollisionMove(const uint8_t* distanceField, int sizeX, int sizeY, int sizeZ,
+                                  cp_vec3 center, cp_vec3 halfExtents, cp_vec3 motion, int* o_contacts)
+{
+    int contacts = 0;
+
+    for (int i = 0; i < 3; i++)
+    {
+        VoxelCollisionHit hit = voxelCollisionSweep(distanceField, sizeX, sizeY, sizeZ, center, halfExtents, motion);
+        center = hit.position;
+        if (!hit.hit)
+            break;
+
+        for (int axis = 0; axis < 3; axis++)
+            if (hit.normal.arr[axis] != 0.0f)
+                contacts |= 1 << (axis * 2 + (hit.normal.arr[axis] > 0.0f));
+
+        motion = hit.slide;
+    }
+
+    if (o_contacts)
+        *o_contacts = contacts;
+    return center;
+}
+
+// voxelCollisionMove for count entities, e.g. everything that moved during a tick. o_contacts may be NULL.
+static void voxelCollisionMoveBatch(const uint8_t* distanceField, int sizeX, int sizeY, int sizeZ, const cp_vec3* centers,
+                                    const cp_vec3* halfExtents, const cp_vec3* motions, cp_vec3* o_centers, int* o_contacts, int count)
+{
+    VOXEL_STATS_BEGIN(VOXEL_STATS_COLLISION_BATCH);
+    for (int i = 0; i < count; i++)
+        o_centers[i] = voxelCollisionMove(distanceField, sizeX, sizeY, sizeZ, centers[i], halfExtents[i], motions[i],
+                                          o_contacts ? o_contacts + i : NULL);
+    // the entities in and out, the distance field lookups aren't counted
+    VOXEL_STATS_END(VOXEL_STATS_COLLISION_BATCH, count, (uint64_t) count * (4 * sizeof(cp_vec3) + (o_contacts ? sizeof(int) : 0)));
+}
+
+// Usage Example
+void testVoxelCollision()
+{
+    const int SIZE = 32;
+
+    // the distance field of a floor at z = 0 is just z (usually this comes from boolArrToManhattanDF)
+    uint8_t distanceField[SIZE * SIZE * SIZE];
+    for (int z = 0; z < SIZE; z++)
+        memset(distanceField + z * SIZE * SIZE, z, SIZE * SIZE);
+
+    // a 0.6 x 0.6 x 1.8 entity falling and walking
+    cp_vec3 center = {.x = 10.0f, .y = 10.0f, .z = 5.0f};
+    cp_vec3 halfExtents = {.x = 0.3f, .y = 0.3f, .z = 0.9f};
+    cp_vec3 motion = {.x = 2.0f, .y = 0.0f, .z = -8.0f};
+
+    int contacts;
+    center = voxelCollisionMove(distanceField, SIZE, SIZE, SIZE, center, halfExtents, motion, &contacts);
+
+    // center is now at (12, 10, 1.901) and contacts == 32: it landed on the floor and slid the rest of the way
+    (void) center;
+}
+
+#endif //VOXELDEVSCRIPTS_VOXELCOLLISION_H
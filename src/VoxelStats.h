@@ -0,0 +1,253 @@
+#ifndef VOXELDEVSCRIPTS_VOXELSTATS_H
+#define VOXELDEVSCRIPTS_VOXELSTATS_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Opt-in instrumentation of the passes and drivers of the other scripts, for production telemetry without a profiler.
+ *
+ * Everything is compiled out unless VOXELDEVSCRIPTS_STATS is defined before including the scripts (or passed with
+ * -DVOXELDEVSCRIPTS_STATS). Without it, the macros below expand to nothing and the scripts are exactly what they
+ * were without this file.
+ *
+ * With it defined, every instrumented region (a pass like boolArrToManhattanDFXPASS, a batch like lineOfSightBatch, ...)
+ * records for each call:
+ *  -   nanoseconds (clock_gettime) and ticks (rdtsc, constant rate, see bench.c)
+ *  -   elements: voxels (or queries, entities, ...) processed
+ *  -   bytes: modeled memory traffic, the same model bench.c uses, not a hardware counter
+ *  -   updates: relaxations that actually changed a value (Y and Z passes of the distance fields, light passes, ...)
+ * The records go into the VoxelStats bound to the calling thread with voxelStatsBind (nothing is recorded on threads
+ * without one) and, if set, to its callback. Drivers that start threads (distanceFieldAOChunks, lineOfSightBatch) bind
+ * the caller's stats on their worker threads, so one VoxelStats collects everything a call did. The totals are atomic,
+ * the callback is called on the thread that did the work, so it has to be thread safe if there is more than one.
+ *
+ * Regions can be nested (blockLightRebuild runs the light passes), every region records its own time, updates are
+ * counted for the innermost region.
+ */
+
+typedef enum VoxelStatsId
+{
+    VOXEL_STATS_DF_XPASS,
+    VOXEL_STATS_DF_YPASS,
+    VOXEL_STATS_DF_ZPASS,
+    VOXEL_STATS_DF_MORTON,
+    VOXEL_STATS_SIGNED_DF_XPASS,
+    VOXEL_STATS_SIGNED_DF_YPASS,
+    VOXEL_STATS_SIGNED_DF_ZPASS,
+    VOXEL_STATS_OCTANT_DF,
+    VOXEL_STATS_MATERIAL_DF_XPASS,
+    VOXEL_STATS_MATERIAL_DF_YPASS,
+    VOXEL_STATS_MATERIAL_DF_ZPASS,
+    VOXEL_STATS_FLOW_FIELD_XPASS,
+    VOXEL_STATS_FLOW_FIELD_YPASS,
+    VOXEL_STATS_FLOW_FIELD_ZPASS,
+    VOXEL_STATS_FLOW_FIELD_DIRECTIONS,
+    VOXEL_STATS_BLOCK_LIGHT_XPASS,
+    VOXEL_STATS_BLOCK_LIGHT_YPASS,
+    VOXEL_STATS_BLOCK_LIGHT_ZPASS,
+    VOXEL_STATS_BLOCK_LIGHT_REBUILD,
+    VOXEL_STATS_BLOCK_LIGHT_UPDATE,
+    VOXEL_STATS_NOISE_TERRAIN,
+    VOXEL_STATS_AO,
+    VOXEL_STATS_AO_CHUNKS,
+    VOXEL_STATS_LINE_OF_SIGHT,
+    VOXEL_STATS_LINE_OF_SIGHT_BATCH,
+    VOXEL_STATS_COLLISION_BATCH,
+    VOXEL_STATS_CONNECTED_COMPONENTS,
+    VOXEL_STATS_HIZ_RASTERIZE,
+    VOXEL_STATS_HIZ_CULL,
+    VOXEL_STATS_OCCUPANCY_LOD,
+    VOXEL_STATS_SURFACE_NETS,
+    VOXEL_STATS_SURFACE_NETS_CHUNKS,
+    VOXEL_STATS_FIELD_SAMPLE,
+    VOXEL_STATS_COUNT
+} VoxelStatsId;
+
+static const char* const VOXEL_STATS_NAMES[VOXEL_STATS_COUNT] = {
+    "boolArrToManhattanDFXPASS", "boolArrToManhattanDFYPASS", "boolArrToManhattanDFZPASS", "boolArrToManhattanDFMorton",
+    "boolArrToSignedManhattanDFXPASS", "boolArrToSignedManhattanDFYPASS", "boolArrToSignedManhattanDFZPASS", "boolArrToOctantDF",
+    "materialArrToManhattanDFXPASS", "materialArrToManhattanDFYPASS", "materialArrToManhattanDFZPASS",
+    "flowFieldFromSeedsXPASS", "flowFieldFromSeedsYPASS", "flowFieldFromSeedsZPASS", "flowFieldFromSeedsDirections",
+    "blockLightXPASS", "blockLightYPASS", "blockLightZPASS", "blockLightRebuild", "blockLightUpdate",
+    "noiseTerrainGenerate", "distanceFieldAO", "distanceFieldAOChunks", "lineOfSightRange", "lineOfSightBatch",
+    "voxelCollisionMoveBatch", "connectedComponentsLabel", "hiZRasterize", "hiZCullAabbs",
+    "occupancyLodDownsample", "surfaceNetsExtract", "surfaceNetsChunks", "fieldSample",
+};
+
+// a single call of an instrumented region
+typedef struct VoxelStatsRecord
+{
+    VoxelStatsId id;
+    uint64_t nanoseconds;
+    uint64_t ticks;
+    uint64_t elements;
+    uint64_t bytes;
+    uint64_t updates;
+} VoxelStatsRecord;
+
+typedef void (*VoxelStatsCallback)(const VoxelStatsRecord* record, void* user);
+
+#ifdef VOXELDEVSCRIPTS_STATS
+
+#include <stdatomic.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// totals of all calls of a region
+typedef struct VoxelStatsEntry
+{
+    atomic_uint_fast64_t calls;
+    atomic_uint_fast64_t nanoseconds;
+    atomic_uint_fast64_t ticks;
+    atomic_uint_fast64_t elements;
+    atomic_uint_fast64_t bytes;
+    atomic_uint_fast64_t updates;
+} VoxelStatsEntry;
+
+#else
+
+typedef struct VoxelStatsEntry
+{
+    uint64_t calls, nanoseconds, ticks, elements, bytes, updates;
+} VoxelStatsEntry;
+
+#endif
+
+typedef struct VoxelStats
+{
+    VoxelStatsEntry entries[VOXEL_STATS_COUNT];
+    VoxelStatsCallback callback;    // may be NULL
+    void* user;
+} VoxelStats;
+
+// Clears the totals (not the callback). Not thread safe, don't call it while another thread records into stats.
+static inline void voxelStatsReset(VoxelStats* stats)
+{
+    memset(stats->entries, 0, sizeof(stats->entries));
+}
+
+#ifdef VOXELDEVSCRIPTS_STATS
+
+static _Thread_local VoxelStats* voxelStatsCurrent;
+static _Thread_local uint64_t voxelStatsPendingUpdates;
+
+typedef struct VoxelStatsTimer
+{
+    uint64_t nanoseconds;
+    uint64_t ticks;
+    uint64_t updates;
+} VoxelStatsTimer;
+
+static inline uint64_t voxelStatsTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static inline uint64_t voxelStatsNanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+// Records the calls of this thread into stats (NULL stops recording), returns the previously bound stats.
+static inline VoxelStats* voxelStatsBind(VoxelStats* stats)
+{
+    VoxelStats* previous = voxelStatsCurrent;
+    voxelStatsCurrent = stats;
+    return previous;
+}
+
+static inline VoxelStats* voxelStatsGetCurrent()
+{
+    return voxelStatsCurrent;
+}
+
+static inline VoxelStatsTimer voxelStatsStart()
+{
+    VoxelStatsTimer timer = {0, 0, voxelStatsPendingUpdates};
+    if (voxelStatsCurrent)
+    {
+        timer.nanoseconds = voxelStatsNanoseconds();
+        timer.ticks = voxelStatsTicks();
+    }
+    return timer;
+}
+
+static inline void voxelStatsStop(const VoxelStatsTimer* timer, VoxelStatsId id, uint64_t elements, uint64_t bytes)
+{
+    // updates counted inside of this region belong to it and not to the region around it
+    const uint64_t updates = voxelStatsPendingUpdates - timer->updates;
+    voxelStatsPendingUpdates = timer->updates;
+
+    VoxelStats* stats = voxelStatsCurrent;
+    if (!stats)
+        return;
+
+    const VoxelStatsRecord record = {id, voxelStatsNanoseconds() - timer->nanoseconds, voxelStatsTicks() - timer->ticks,
+                                     elements, bytes, updates};
+    VoxelStatsEntry* entry = stats->entries + id;
+    atomic_fetch_add_explicit(&entry->calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&entry->nanoseconds, record.nanoseconds, memory_order_relaxed);
+    atomic_fetch_add_explicit(&entry->ticks, record.ticks, memory_order_relaxed);
+    atomic_fetch_add_explicit(&entry->elements, record.elements, memory_order_relaxed);
+    atomic_fetch_add_explicit(&entry->bytes, record.bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&entry->updates, record.updates, memory_order_relaxed);
+
+    if (stats->callback)
+        stats->callback(&record, stats->user);
+}
+
+// VOXEL_STATS_BEGIN(id) ... VOXEL_STATS_END(id, elements, bytes) around a region, both in the same scope
+#define VOXEL_STATS_BEGIN(id) const VoxelStatsTimer voxelStatsTimer_##id = voxelStatsStart()
+#define VOXEL_STATS_END(id, elements, bytes) voxelStatsStop(&voxelStatsTimer_##id, id, (uint64_t) (elements), (uint64_t) (bytes))
+// adds n to the updates of the innermost region
+#define VOXEL_STATS_UPDATES(n) (voxelStatsPendingUpdates += (uint64_t) (n))
+// code that only exists in instrumented builds, e.g. counting updates in a loop
+#define VOXEL_STATS_ONLY(...) __VA_ARGS__
+
+#else
+
+static inline VoxelStats* voxelStatsBind(VoxelStats* stats)
+{
+    (void) stats;
+    return NULL;
+}
+
+static inline VoxelStats* voxelStatsGetCurrent()
+{
+    return NULL;
+}
+
+#define VOXEL_STATS_BEGIN(id)
+#define VOXEL_STATS_END(id, elements, bytes)
+#define VOXEL_STATS_UPDATES(n)
+#define VOXEL_STATS_ONLY(...)
+
+#endif
+
+// Usage Example
+void testVoxelStats()
+{
+    // compile with -DVOXELDEVSCRIPTS_STATS, otherwise the totals stay 0
+    static VoxelStats stats;
+    voxelStatsBind(&stats);
+
+    // ... rebuild some chunks, e.g. boolArrToManhattanDF(boolArr, distanceField, 32, 32, 32) ...
+
+    voxelStatsBind(NULL);
+
+    // stats.entries[VOXEL_STATS_DF_YPASS] now holds the calls, time, voxels, bytes and updates of all Y passes.
+    // For telemetry of single calls (spikes), set stats.callback instead of looking at the totals.
+    VoxelStatsEntry* yPass = &stats.entries[VOXEL_STATS_DF_YPASS];
+    (void) yPass;
+}
+
+#endif //VOXELDEVSCRIPTS_VOXELSTATS_H
@@ -66,6 +66,13 @@
  *  -   C11 (or equivalent compiler support for _Generic).
  *      If you do not have support for this, feel free to disable the macros at the bottom and use the explicit functions.
  *
+ *  -   BMI2 is optional. If it's enabled (e.g. -mbmi2 or -march=native), the morton functions use pdep/pext, otherwise they
+ *      fall back to regular bit twiddling. Note that pdep/pext are very slow on AMD CPUs before Zen 3, so you might want to
+ *      disable BMI2 there.
+ *
+ *  -   AVX is optional. If it's enabled, the batch culling functions test 8 boxes / spheres at once instead of 4, and the
+ *      8-wide ray intersection functions (cp_ray8, cp_ray_intersect_aabb8) become available.
+ *
  *
  * ###################
  * ##### VECTORS #####
@@ -90,7 +97,10 @@
  * ##### MATRICES #####
  * ####################
  *
- *  
+ * cp_mat4 (alias mat4), column major like glsl. So far only what's needed for transforms and culling:
+ *  cp_mat4_identity(), cp_mat4_mul(), cp_mat4_mul_vec4(), cp_mat4_perspective(), cp_mat4_look_at()
+ *  cp_frustum_from_mat4() for the frustum culling functions
+ * There are no generic macros for matrices (yet).
  *
  */
 
@@ -98,6 +108,7 @@
 #include <smmintrin.h>
 #include <immintrin.h>
 #include <stdint.h>
+#include <math.h>
 
 #define CP_M_PI		3.14159265358979323846
 
@@ -1571,6 +1582,651 @@ static CP_INLINE cp_vec3 cp_vec3_cross(cp_vec3 v1, cp_vec3 v2)
     };
 }
 
+// morton (Z-order) encoding
+// Interleaves the bits of x, y and z (x being the least significant bit). Points that are close to each other in 3D
+// are then mostly close to each other in memory, too, which helps with neighbourhood reads.
+// The 32 bit versions support 10 bits per component (up to 1024^3), the 64 bit versions 21 bits (up to 2097152^3).
+#define CP_MORTON32_X 0x09249249u
+#define CP_MORTON32_Y 0x12492492u
+#define CP_MORTON32_Z 0x24924924u
+#define CP_MORTON64_X 0x1249249249249249ull
+#define CP_MORTON64_Y 0x2492492492492492ull
+#define CP_MORTON64_Z 0x4924924924924924ull
+
+static CP_INLINE uint32_t cp_morton32_spread(uint32_t v)
+{
+#ifdef __BMI2__
+    return _pdep_u32(v, CP_MORTON32_X);
+#else
+    v &= 0x000003FFu;
+    v = (v | (v << 16)) & 0x030000FFu;
+    v = (v | (v << 8)) & 0x0300F00Fu;
+    v = (v | (v << 4)) & 0x030C30C3u;
+    v = (v | (v << 2)) & 0x09249249u;
+    return v;
+#endif
+}
+
+static CP_INLINE uint32_t cp_morton32_compact(uint32_t v)
+{
+#ifdef __BMI2__
+    return _pext_u32(v, CP_MORTON32_X);
+#else
+    v &= 0x09249249u;
+    v = (v | (v >> 2)) & 0x030C30C3u;
+    v = (v | (v >> 4)) & 0x0300F00Fu;
+    v = (v | (v >> 8)) & 0x030000FFu;
+    v = (v | (v >> 16)) & 0x000003FFu;
+    return v;
+#endif
+}
+
+static CP_INLINE uint64_t cp_morton64_spread(uint64_t v)
+{
+#ifdef __BMI2__
+    return _pdep_u64(v, CP_MORTON64_X);
+#else
+    v &= 0x00000000001FFFFFull;
+    v = (v | (v << 32)) & 0x001F00000000FFFFull;
+    v = (v | (v << 16)) & 0x001F0000FF0000FFull;
+    v = (v | (v << 8)) & 0x100F00F00F00F00Full;
+    v = (v | (v << 4)) & 0x10C30C30C30C30C3ull;
+    v = (v | (v << 2)) & 0x1249249249249249ull;
+    return v;
+#endif
+}
+
+static CP_INLINE uint64_t cp_morton64_compact(uint64_t v)
+{
+#ifdef __BMI2__
+    return _pext_u64(v, CP_MORTON64_X);
+#else
+    v &= 0x1249249249249249ull;
+    v = (v | (v >> 2)) & 0x10C30C30C30C30C3ull;
+    v = (v | (v >> 4)) & 0x100F00F00F00F00Full;
+    v = (v | (v >> 8)) & 0x001F0000FF0000FFull;
+    v = (v | (v >> 16)) & 0x001F00000000FFFFull;
+    v = (v | (v >> 32)) & 0x00000000001FFFFFull;
+    return v;
+#endif
+}
+
+static CP_INLINE uint32_t cp_uvec3_morton_encode(cp_uvec3 v)
+{
+#ifdef __BMI2__
+    return _pdep_u32(v.x, CP_MORTON32_X) | _pdep_u32(v.y, CP_MORTON32_Y) | _pdep_u32(v.z, CP_MORTON32_Z);
+#else
+    return cp_morton32_spread(v.x) | (cp_morton32_spread(v.y) << 1) | (cp_morton32_spread(v.z) << 2);
+#endif
+}
+
+static CP_INLINE cp_uvec3 cp_uvec3_morton_decode(uint32_t m)
+{
+#ifdef __BMI2__
+    return (cp_uvec3) {
+        .x = _pext_u32(m, CP_MORTON32_X),
+        .y = _pext_u32(m, CP_MORTON32_Y),
+        .z = _pext_u32(m, CP_MORTON32_Z)
+    };
+#else
+    return (cp_uvec3) {
+        .x = cp_morton32_compact(m),
+        .y = cp_morton32_compact(m >> 1),
+        .z = cp_morton32_compact(m >> 2)
+    };
+#endif
+}
+
+static CP_INLINE uint64_t cp_uvec3_morton_encode64(cp_uvec3 v)
+{
+#ifdef __BMI2__
+    return _pdep_u64(v.x, CP_MORTON64_X) | _pdep_u64(v.y, CP_MORTON64_Y) | _pdep_u64(v.z, CP_MORTON64_Z);
+#else
+    return cp_morton64_spread(v.x) | (cp_morton64_spread(v.y) << 1) | (cp_morton64_spread(v.z) << 2);
+#endif
+}
+
+static CP_INLINE cp_uvec3 cp_uvec3_morton_decode64(uint64_t m)
+{
+#ifdef __BMI2__
+    return (cp_uvec3) {
+        .x = (uint32_t) _pext_u64(m, CP_MORTON64_X),
+        .y = (uint32_t) _pext_u64(m, CP_MORTON64_Y),
+        .z = (uint32_t) _pext_u64(m, CP_MORTON64_Z)
+    };
+#else
+    return (cp_uvec3) {
+        .x = (uint32_t) cp_morton64_compact(m),
+        .y = (uint32_t) cp_morton64_compact(m >> 1),
+        .z = (uint32_t) cp_morton64_compact(m >> 2)
+    };
+#endif
+}
+
+// Adds two morton codes component wise without decoding them. The unused bits of each component are set to 1 first,
+// so the carry ripples through them to the next used bit. Negative offsets work as well if they are encoded in two's
+// complement (e.g. -1 -> cp_uvec3_morton_encode(1023, ...)), the result wraps around at 1024 like the codes themselves.
+// This is handy to step to neighbours: cp_morton32_add(m, 1) is the neighbour in +x, cp_morton32_add(m, CP_MORTON32_X) in -x.
+static CP_INLINE uint32_t cp_morton32_add(uint32_t m1, uint32_t m2)
+{
+    uint32_t x = ((m1 | ~CP_MORTON32_X) + (m2 & CP_MORTON32_X)) & CP_MORTON32_X;
+    uint32_t y = ((m1 | ~CP_MORTON32_Y) + (m2 & CP_MORTON32_Y)) & CP_MORTON32_Y;
+    uint32_t z = ((m1 | ~CP_MORTON32_Z) + (m2 & CP_MORTON32_Z)) & CP_MORTON32_Z;
+    return x | y | z;
+}
+
+static CP_INLINE uint64_t cp_morton64_add(uint64_t m1, uint64_t m2)
+{
+    uint64_t x = ((m1 | ~CP_MORTON64_X) + (m2 & CP_MORTON64_X)) & CP_MORTON64_X;
+    uint64_t y = ((m1 | ~CP_MORTON64_Y) + (m2 & CP_MORTON64_Y)) & CP_MORTON64_Y;
+    uint64_t z = ((m1 | ~CP_MORTON64_Z) + (m2 & CP_MORTON64_Z)) & CP_MORTON64_Z;
+    return x | y | z;
+}
+
+/**
+ * Matrices
+ */
+
+// Column major like glsl: cols[c] is column c and m[c][r] the element in row r of it, which is also the memory layout
+// OpenGL expects. Transforms follow the OpenGL conventions (right handed view space looking along -z, clip space z in [-w, w]).
+typedef union cp_mat4
+{
+    cp_vec4 cols[4];
+    float m[4][4];
+} cp_mat4;
+
+static CP_INLINE cp_mat4 cp_mat4_identity()
+{
+    return (cp_mat4) {.cols = {
+        {.x = 1.0f, .y = 0.0f, .z = 0.0f, .w = 0.0f},
+        {.x = 0.0f, .y = 1.0f, .z = 0.0f, .w = 0.0f},
+        {.x = 0.0f, .y = 0.0f, .z = 1.0f, .w = 0.0f},
+        {.x = 0.0f, .y = 0.0f, .z = 0.0f, .w = 1.0f},
+    }};
+}
+
+// m * v, the columns scaled by the components of v and summed up
+static CP_INLINE cp_vec4 cp_mat4_mul_vec4(const cp_mat4* m, cp_vec4 v)
+{
+    __m128 r = _mm_mul_ps(m->cols[0].i, _mm_shuffle_ps(v.i, v.i, _MM_SHUFFLE(0, 0, 0, 0)));
+    r = _mm_fmadd_ps(m->cols[1].i, _mm_shuffle_ps(v.i, v.i, _MM_SHUFFLE(1, 1, 1, 1)), r);
+    r = _mm_fmadd_ps(m->cols[2].i, _mm_shuffle_ps(v.i, v.i, _MM_SHUFFLE(2, 2, 2, 2)), r);
+    r = _mm_fmadd_ps(m->cols[3].i, _mm_shuffle_ps(v.i, v.i, _MM_SHUFFLE(3, 3, 3, 3)), r);
+    return (cp_vec4) {.i = r};
+}
+
+// a * b (b is applied first)
+static CP_INLINE cp_mat4 cp_mat4_mul(const cp_mat4* a, const cp_mat4* b)
+{
+    cp_mat4 r;
+    for (int c = 0; c < 4; c++)
+        r.cols[c] = cp_mat4_mul_vec4(a, b->cols[c]);
+    return r;
+}
+
+// fovY in radians, like gluPerspective
+static inline cp_mat4 cp_mat4_perspective(float fovY, float aspect, float near, float far)
+{
+    const float f = 1.0f / tanf(fovY * 0.5f);
+    return (cp_mat4) {.cols = {
+        {.x = f / aspect, .y = 0.0f, .z = 0.0f, .w = 0.0f},
+        {.x = 0.0f, .y = f, .z = 0.0f, .w = 0.0f},
+        {.x = 0.0f, .y = 0.0f, .z = (far + near) / (near - far), .w = -1.0f},
+        {.x = 0.0f, .y = 0.0f, .z = 2.0f * far * near / (near - far), .w = 0.0f},
+    }};
+}
+
+// like gluLookAt
+static inline cp_mat4 cp_mat4_look_at(cp_vec3 eye, cp_vec3 center, cp_vec3 up)
+{
+    // exact normalization, cp_vec3_normalize uses the approximate rsqrt
+    cp_vec3 f = cp_vec3_sub(center, eye);
+    f.i = _mm_div_ps(f.i, _mm_sqrt_ps(_mm_dp_ps(f.i, f.i, 0x7F)));
+    cp_vec3 s = cp_vec3_cross(f, up);
+    s.i = _mm_div_ps(s.i, _mm_sqrt_ps(_mm_dp_ps(s.i, s.i, 0x7F)));
+    const cp_vec3 u = cp_vec3_cross(s, f);
+
+    return (cp_mat4) {.cols = {
+        {.x = s.x, .y = u.x, .z = -f.x, .w = 0.0f},
+        {.x = s.y, .y = u.y, .z = -f.y, .w = 0.0f},
+        {.x = s.z, .y = u.z, .z = -f.z, .w = 0.0f},
+        {.x = -(s.x * eye.x + s.y * eye.y + s.z * eye.z), .y = -(u.x * eye.x + u.y * eye.y + u.z * eye.z),
+         .z = f.x * eye.x + f.y * eye.y + f.z * eye.z, .w = 1.0f},
+    }};
+}
+
+/**
+ * Culling
+ */
+
+// Batch culling works on arrays of boxes / spheres in SoA layout (one array per component), so 4 (SSE) or 8 (AVX)
+// of them can be loaded into one register each. The arrays don't need any padding, the remainder is tested with scalar code.
+typedef struct cp_aabb
+{
+    cp_vec3 min;
+    cp_vec3 max;
+} cp_aabb;
+
+typedef struct cp_aabb_soa
+{
+    float* minX;
+    float* minY;
+    float* minZ;
+    float* maxX;
+    float* maxY;
+    float* maxZ;
+    uint32_t count;
+} cp_aabb_soa;
+
+typedef struct cp_sphere_soa
+{
+    float* x;
+    float* y;
+    float* z;
+    float* radius;
+    uint32_t count;
+} cp_sphere_soa;
+
+// Each plane is stored as (normal.x, normal.y, normal.z, d) with the normal pointing inside of the frustum,
+// so a point p is inside if dot(normal, p) + d >= 0 for all 6 planes.
+typedef struct cp_frustum
+{
+    cp_vec4 planes[6];
+} cp_frustum;
+
+// Extracts the planes from a (projection * view) matrix (Gribb / Hartmann): the point is inside if -w <= x, y, z <= w
+// in clip space, so every plane is the last row plus or minus one of the others. In the order left, right, bottom, top,
+// near, far, normalized so the distances are in world units.
+static inline cp_frustum cp_frustum_from_mat4(const cp_mat4* viewProj)
+{
+    cp_frustum frustum;
+    for (int p = 0; p < 6; p++)
+    {
+        const int row = p / 2;
+        const float sign = p % 2 == 0 ? 1.0f : -1.0f;
+        cp_vec4 plane = {.x = viewProj->m[0][3] + sign * viewProj->m[0][row], .y = viewProj->m[1][3] + sign * viewProj->m[1][row],
+                         .z = viewProj->m[2][3] + sign * viewProj->m[2][row], .w = viewProj->m[3][3] + sign * viewProj->m[3][row]};
+        plane.i = _mm_div_ps(plane.i, _mm_sqrt_ps(_mm_dp_ps(plane.i, plane.i, 0x7F)));
+        frustum.planes[p] = plane;
+    }
+    return frustum;
+}
+
+// A box is outside of a plane if its corner that's furthest along the normal (the "positive vertex") is outside.
+// Per axis that's the max of normal * min and normal * max, so we don't need to pick the corner.
+static CP_INLINE int cp_frustum_test_aabb(const cp_frustum* frustum, cp_aabb box)
+{
+    for (int p = 0; p < 6; p++)
+    {
+        __m128 n = frustum->planes[p].i;
+        __m128 farthest = _mm_max_ps(_mm_mul_ps(n, box.min.i), _mm_mul_ps(n, box.max.i));
+        if (_mm_cvtss_f32(_mm_dp_ps(farthest, _mm_set1_ps(1.0f), 0x71)) + frustum->planes[p].w < 0.0f)
+            return 0;
+    }
+    return 1;
+}
+
+static CP_INLINE int cp_frustum_test_sphere(const cp_frustum* frustum, cp_vec3 center, float radius)
+{
+    for (int p = 0; p < 6; p++)
+        if (_mm_cvtss_f32(_mm_dp_ps(frustum->planes[p].i, center.i, 0x71)) + frustum->planes[p].w < -radius)
+            return 0;
+    return 1;
+}
+
+static CP_INLINE int cp_aabb_overlap(cp_aabb a, cp_aabb b)
+{
+    // only the first 3 components count
+    __m128 separated = _mm_or_ps(_mm_cmpgt_ps(a.min.i, b.max.i), _mm_cmpgt_ps(b.min.i, a.max.i));
+    return (_mm_movemask_ps(separated) & 7) == 0;
+}
+
+// writes the index of every set bit of mask (offset by base) to o_indices, returns how many there were
+static CP_INLINE uint32_t cp_compact_mask(uint32_t mask, uint32_t base, uint32_t* o_indices)
+{
+    uint32_t count = 0;
+    while (mask)
+    {
+        o_indices[count++] = base + __builtin_ctz(mask);
+        mask &= mask - 1;
+    }
+    return count;
+}
+
+// Tests all boxes against the frustum, writes the indices of the visible ones to o_visible and returns their count.
+// o_visible must have space for boxes->count indices.
+static inline uint32_t cp_frustum_cull_aabbs(const cp_frustum* frustum, const cp_aabb_soa* boxes, uint32_t* o_visible)
+{
+    uint32_t visibleCount = 0;
+    uint32_t i = 0;
+
+#ifdef __AVX__
+    for (; i + 8 <= boxes->count; i += 8)
+    {
+        __m256 minX = _mm256_loadu_ps(boxes->minX + i), maxX = _mm256_loadu_ps(boxes->maxX + i);
+        __m256 minY = _mm256_loadu_ps(boxes->minY + i), maxY = _mm256_loadu_ps(boxes->maxY + i);
+        __m256 minZ = _mm256_loadu_ps(boxes->minZ + i), maxZ = _mm256_loadu_ps(boxes->maxZ + i);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+        for (int p = 0; p < 6; p++)
+        {
+            __m256 nx = _mm256_set1_ps(frustum->planes[p].x);
+            __m256 ny = _mm256_set1_ps(frustum->planes[p].y);
+            __m256 nz = _mm256_set1_ps(frustum->planes[p].z);
+
+            __m256 d = _mm256_add_ps(_mm256_max_ps(_mm256_mul_ps(nx, minX), _mm256_mul_ps(nx, maxX)), _mm256_set1_ps(frustum->planes[p].w));
+            d = _mm256_add_ps(d, _mm256_max_ps(_mm256_mul_ps(ny, minY), _mm256_mul_ps(ny, maxY)));
+            d = _mm256_add_ps(d, _mm256_max_ps(_mm256_mul_ps(nz, minZ), _mm256_mul_ps(nz, maxZ)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        visibleCount += cp_compact_mask(_mm256_movemask_ps(inside), i, o_visible + visibleCount);
+    }
+#endif
+    for (; i + 4 <= boxes->count; i += 4)
+    {
+        __m128 minX = _mm_loadu_ps(boxes->minX + i), maxX = _mm_loadu_ps(boxes->maxX + i);
+        __m128 minY = _mm_loadu_ps(boxes->minY + i), maxY = _mm_loadu_ps(boxes->maxY + i);
+        __m128 minZ = _mm_loadu_ps(boxes->minZ + i), maxZ = _mm_loadu_ps(boxes->maxZ + i);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 nx = _mm_set1_ps(frustum->planes[p].x);
+            __m128 ny = _mm_set1_ps(frustum->planes[p].y);
+            __m128 nz = _mm_set1_ps(frustum->planes[p].z);
+
+            __m128 d = _mm_add_ps(_mm_max_ps(_mm_mul_ps(nx, minX), _mm_mul_ps(nx, maxX)), _mm_set1_ps(frustum->planes[p].w));
+            d = _mm_add_ps(d, _mm_max_ps(_mm_mul_ps(ny, minY), _mm_mul_ps(ny, maxY)));
+            d = _mm_add_ps(d, _mm_max_ps(_mm_mul_ps(nz, minZ), _mm_mul_ps(nz, maxZ)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+        }
+
+        visibleCount += cp_compact_mask(_mm_movemask_ps(inside), i, o_visible + visibleCount);
+    }
+
+    for (; i < boxes->count; i++)
+    {
+        cp_aabb box = {
+            .min = {.x = boxes->minX[i], .y = boxes->minY[i], .z = boxes->minZ[i]},
+            .max = {.x = boxes->maxX[i], .y = boxes->maxY[i], .z = boxes->maxZ[i]}
+        };
+        if (cp_frustum_test_aabb(frustum, box))
+            o_visible[visibleCount++] = i;
+    }
+
+    return visibleCount;
+}
+
+// Same as cp_frustum_cull_aabbs for spheres.
+static inline uint32_t cp_frustum_cull_spheres(const cp_frustum* frustum, const cp_sphere_soa* spheres, uint32_t* o_visible)
+{
+    uint32_t visibleCount = 0;
+    uint32_t i = 0;
+
+#ifdef __AVX__
+    for (; i + 8 <= spheres->count; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(spheres->x + i), y = _mm256_loadu_ps(spheres->y + i), z = _mm256_loadu_ps(spheres->z + i);
+        __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(spheres->radius + i));
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+        for (int p = 0; p < 6; p++)
+        {
+            __m256 d = _mm256_fmadd_ps(_mm256_set1_ps(frustum->planes[p].x), x, _mm256_set1_ps(frustum->planes[p].w));
+            d = _mm256_fmadd_ps(_mm256_set1_ps(frustum->planes[p].y), y, d);
+            d = _mm256_fmadd_ps(_mm256_set1_ps(frustum->planes[p].z), z, d);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negRadius, _CMP_GE_OQ));
+        }
+
+        visibleCount += cp_compact_mask(_mm256_movemask_ps(inside), i, o_visible + visibleCount);
+    }
+#endif
+    for (; i + 4 <= spheres->count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(spheres->x + i), y = _mm_loadu_ps(spheres->y + i), z = _mm_loadu_ps(spheres->z + i);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres->radius + i));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 d = _mm_fmadd_ps(_mm_set1_ps(frustum->planes[p].x), x, _mm_set1_ps(frustum->planes[p].w));
+            d = _mm_fmadd_ps(_mm_set1_ps(frustum->planes[p].y), y, d);
+            d = _mm_fmadd_ps(_mm_set1_ps(frustum->planes[p].z), z, d);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negRadius));
+        }
+
+        visibleCount += cp_compact_mask(_mm_movemask_ps(inside), i, o_visible + visibleCount);
+    }
+
+    for (; i < spheres->count; i++)
+    {
+        cp_vec3 center = {.x = spheres->x[i], .y = spheres->y[i], .z = spheres->z[i]};
+        if (cp_frustum_test_sphere(frustum, center, spheres->radius[i]))
+            o_visible[visibleCount++] = i;
+    }
+
+    return visibleCount;
+}
+
+// Writes the indices of all boxes that overlap box to o_overlapping and returns their count (touching counts as overlapping).
+static inline uint32_t cp_aabb_overlap_batch(cp_aabb box, const cp_aabb_soa* boxes, uint32_t* o_overlapping)
+{
+    uint32_t overlapCount = 0;
+    uint32_t i = 0;
+
+#ifdef __AVX__
+    {
+        const __m256 minX = _mm256_set1_ps(box.min.x), minY = _mm256_set1_ps(box.min.y), minZ = _mm256_set1_ps(box.min.z);
+        const __m256 maxX = _mm256_set1_ps(box.max.x), maxY = _mm256_set1_ps(box.max.y), maxZ = _mm256_set1_ps(box.max.z);
+
+        for (; i + 8 <= boxes->count; i += 8)
+        {
+            __m256 overlap = _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(boxes->minX + i), maxX, _CMP_LE_OQ),
+                                           _mm256_cmp_ps(_mm256_loadu_ps(boxes->maxX + i), minX, _CMP_GE_OQ));
+            overlap = _mm256_and_ps(overlap, _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(boxes->minY + i), maxY, _CMP_LE_OQ),
+                                                           _mm256_cmp_ps(_mm256_loadu_ps(boxes->maxY + i), minY, _CMP_GE_OQ)));
+            overlap = _mm256_and_ps(overlap, _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(boxes->minZ + i), maxZ, _CMP_LE_OQ),
+                                                           _mm256_cmp_ps(_mm256_loadu_ps(boxes->maxZ + i), minZ, _CMP_GE_OQ)));
+
+            overlapCount += cp_compact_mask(_mm256_movemask_ps(overlap), i, o_overlapping + overlapCount);
+        }
+    }
+#endif
+    {
+        const __m128 minX = _mm_set1_ps(box.min.x), minY = _mm_set1_ps(box.min.y), minZ = _mm_set1_ps(box.min.z);
+        const __m128 maxX = _mm_set1_ps(box.max.x), maxY = _mm_set1_ps(box.max.y), maxZ = _mm_set1_ps(box.max.z);
+
+        for (; i + 4 <= boxes->count; i += 4)
+        {
+            __m128 overlap = _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(boxes->minX + i), maxX), _mm_cmpge_ps(_mm_loadu_ps(boxes->maxX + i), minX));
+            overlap = _mm_and_ps(overlap, _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(boxes->minY + i), maxY), _mm_cmpge_ps(_mm_loadu_ps(boxes->maxY + i), minY)));
+            overlap = _mm_and_ps(overlap, _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(boxes->minZ + i), maxZ), _mm_cmpge_ps(_mm_loadu_ps(boxes->maxZ + i), minZ)));
+
+            overlapCount += cp_compact_mask(_mm_movemask_ps(overlap), i, o_overlapping + overlapCount);
+        }
+    }
+
+    for (; i < boxes->count; i++)
+    {
+        cp_aabb other = {
+            .min = {.x = boxes->minX[i], .y = boxes->minY[i], .z = boxes->minZ[i]},
+            .max = {.x = boxes->maxX[i], .y = boxes->maxY[i], .z = boxes->maxZ[i]}
+        };
+        if (cp_aabb_overlap(box, other))
+            o_overlapping[overlapCount++] = i;
+    }
+
+    return overlapCount;
+}
+
+/**
+ * Ray Intersection
+ */
+
+// The inverse direction is precomputed, as every slab test needs it. Components of the direction that are 0 turn into +-infinity,
+// which the slab tests handle.
+typedef struct cp_ray
+{
+    cp_vec3 origin;
+    cp_vec3 direction;
+    cp_vec3 invDirection;
+} cp_ray;
+
+// 4 rays in SoA layout, for testing 4 rays against one box at once
+typedef struct cp_ray4
+{
+    __m128 originX, originY, originZ;
+    __m128 invDirectionX, invDirectionY, invDirectionZ;
+} cp_ray4;
+
+static CP_INLINE cp_ray cp_ray_create(cp_vec3 origin, cp_vec3 direction)
+{
+    cp_ray ray = {.origin = origin, .direction = direction};
+    ray.invDirection.i = _mm_div_ps(_mm_set1_ps(1.0f), direction.i);
+    return ray;
+}
+
+static CP_INLINE cp_ray4 cp_ray4_create(const cp_ray rays[4])
+{
+    cp_ray4 packet;
+    packet.originX = _mm_setr_ps(rays[0].origin.x, rays[1].origin.x, rays[2].origin.x, rays[3].origin.x);
+    packet.originY = _mm_setr_ps(rays[0].origin.y, rays[1].origin.y, rays[2].origin.y, rays[3].origin.y);
+    packet.originZ = _mm_setr_ps(rays[0].origin.z, rays[1].origin.z, rays[2].origin.z, rays[3].origin.z);
+    packet.invDirectionX = _mm_setr_ps(rays[0].invDirection.x, rays[1].invDirection.x, rays[2].invDirection.x, rays[3].invDirection.x);
+    packet.invDirectionY = _mm_setr_ps(rays[0].invDirection.y, rays[1].invDirection.y, rays[2].invDirection.y, rays[3].invDirection.y);
+    packet.invDirectionZ = _mm_setr_ps(rays[0].invDirection.z, rays[1].invDirection.z, rays[2].invDirection.z, rays[3].invDirection.z);
+    return packet;
+}
+
+// Clips [entry, exit] against the slab between boxMin and boxMax along one axis.
+// If the ray is parallel to the slab and its origin lies exactly on one of the planes, we get 0 * inf = NaN. Such a ray runs
+// along the boundary of the box, which counts as a hit, so the slab must not restrict the interval. We make both t values NaN
+// in that case (cmpunord is all ones, which is a NaN) and rely on min/max returning their second operand if one operand is NaN.
+static CP_INLINE void cp_ray_slab4(__m128 origin, __m128 invDirection, __m128 boxMin, __m128 boxMax, __m128* entry, __m128* exit)
+{
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(boxMin, origin), invDirection);
+    __m128 t2 = _mm_mul_ps(_mm_sub_ps(boxMax, origin), invDirection);
+    __m128 nan = _mm_cmpunord_ps(t1, t2);
+
+    *entry = _mm_max_ps(_mm_or_ps(_mm_min_ps(t1, t2), nan), *entry);
+    *exit = _mm_min_ps(_mm_or_ps(_mm_max_ps(t1, t2), nan), *exit);
+}
+
+// All intersection functions only look at the part of the ray between t = 0 and tMax, so a ray starting inside of a box
+// reports an entry of 0. Entry and exit are the t values where the ray enters / leaves the box (origin + t * direction),
+// they are only meaningful for the lanes that hit.
+
+// Returns 1 if the ray hits the box.
+static CP_INLINE int cp_ray_intersect_aabb(const cp_ray* ray, cp_aabb box, float tMax, float* o_entry, float* o_exit)
+{
+    // one lane per axis, the w lane is not used
+    __m128 entry = _mm_setzero_ps();
+    __m128 exit = _mm_set1_ps(tMax);
+    cp_ray_slab4(ray->origin.i, ray->invDirection.i, box.min.i, box.max.i, &entry, &exit);
+
+    entry = _mm_max_ps(entry, _mm_max_ps(_mm_shuffle_ps(entry, entry, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(entry, entry, _MM_SHUFFLE(2, 2, 2, 2))));
+    exit = _mm_min_ps(exit, _mm_min_ps(_mm_shuffle_ps(exit, exit, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(exit, exit, _MM_SHUFFLE(2, 2, 2, 2))));
+
+    *o_entry = _mm_cvtss_f32(entry);
+    *o_exit = _mm_cvtss_f32(exit);
+    return *o_entry <= *o_exit;
+}
+
+// Tests one ray against the 4 boxes starting at index first. Returns a mask with bit i set if box first + i is hit.
+static CP_INLINE int cp_ray_intersect_aabb4(const cp_ray* ray, const cp_aabb_soa* boxes, uint32_t first, float tMax, float o_entry[4], float o_exit[4])
+{
+    __m128 entry = _mm_setzero_ps();
+    __m128 exit = _mm_set1_ps(tMax);
+
+    cp_ray_slab4(_mm_set1_ps(ray->origin.x), _mm_set1_ps(ray->invDirection.x), _mm_loadu_ps(boxes->minX + first), _mm_loadu_ps(boxes->maxX + first), &entry, &exit);
+    cp_ray_slab4(_mm_set1_ps(ray->origin.y), _mm_set1_ps(ray->invDirection.y), _mm_loadu_ps(boxes->minY + first), _mm_loadu_ps(boxes->maxY + first), &entry, &exit);
+    cp_ray_slab4(_mm_set1_ps(ray->origin.z), _mm_set1_ps(ray->invDirection.z), _mm_loadu_ps(boxes->minZ + first), _mm_loadu_ps(boxes->maxZ + first), &entry, &exit);
+
+    _mm_storeu_ps(o_entry, entry);
+    _mm_storeu_ps(o_exit, exit);
+    return _mm_movemask_ps(_mm_cmple_ps(entry, exit));
+}
+
+// Tests 4 rays against one box. Returns a mask with bit i set if ray i is hit.
+static CP_INLINE int cp_ray4_intersect_aabb(const cp_ray4* rays, cp_aabb box, float tMax, float o_entry[4], float o_exit[4])
+{
+    __m128 entry = _mm_setzero_ps();
+    __m128 exit = _mm_set1_ps(tMax);
+
+    cp_ray_slab4(rays->originX, rays->invDirectionX, _mm_set1_ps(box.min.x), _mm_set1_ps(box.max.x), &entry, &exit);
+    cp_ray_slab4(rays->originY, rays->invDirectionY, _mm_set1_ps(box.min.y), _mm_set1_ps(box.max.y), &entry, &exit);
+    cp_ray_slab4(rays->originZ, rays->invDirectionZ, _mm_set1_ps(box.min.z), _mm_set1_ps(box.max.z), &entry, &exit);
+
+    _mm_storeu_ps(o_entry, entry);
+    _mm_storeu_ps(o_exit, exit);
+    return _mm_movemask_ps(_mm_cmple_ps(entry, exit));
+}
+
+#ifdef __AVX__
+// 8 rays in SoA layout
+typedef struct cp_ray8
+{
+    __m256 originX, originY, originZ;
+    __m256 invDirectionX, invDirectionY, invDirectionZ;
+} cp_ray8;
+
+static CP_INLINE cp_ray8 cp_ray8_create(const cp_ray rays[8])
+{
+    cp_ray4 lo = cp_ray4_create(rays);
+    cp_ray4 hi = cp_ray4_create(rays + 4);
+    cp_ray8 packet;
+    packet.originX = _mm256_set_m128(hi.originX, lo.originX);
+    packet.originY = _mm256_set_m128(hi.originY, lo.originY);
+    packet.originZ = _mm256_set_m128(hi.originZ, lo.originZ);
+    packet.invDirectionX = _mm256_set_m128(hi.invDirectionX, lo.invDirectionX);
+    packet.invDirectionY = _mm256_set_m128(hi.invDirectionY, lo.invDirectionY);
+    packet.invDirectionZ = _mm256_set_m128(hi.invDirectionZ, lo.invDirectionZ);
+    return packet;
+}
+
+// see cp_ray_slab4
+static CP_INLINE void cp_ray_slab8(__m256 origin, __m256 invDirection, __m256 boxMin, __m256 boxMax, __m256* entry, __m256* exit)
+{
+    __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(boxMin, origin), invDirection);
+    __m256 t2 = _mm256_mul_ps(_mm256_sub_ps(boxMax, origin), invDirection);
+    __m256 nan = _mm256_cmp_ps(t1, t2, _CMP_UNORD_Q);
+
+    *entry = _mm256_max_ps(_mm256_or_ps(_mm256_min_ps(t1, t2), nan), *entry);
+    *exit = _mm256_min_ps(_mm256_or_ps(_mm256_max_ps(t1, t2), nan), *exit);
+}
+
+// Tests one ray against the 8 boxes starting at index first. Returns a mask with bit i set if box first + i is hit.
+static CP_INLINE int cp_ray_intersect_aabb8(const cp_ray* ray, const cp_aabb_soa* boxes, uint32_t first, float tMax, float o_entry[8], float o_exit[8])
+{
+    __m256 entry = _mm256_setzero_ps();
+    __m256 exit = _mm256_set1_ps(tMax);
+
+    cp_ray_slab8(_mm256_set1_ps(ray->origin.x), _mm256_set1_ps(ray->invDirection.x), _mm256_loadu_ps(boxes->minX + first), _mm256_loadu_ps(boxes->maxX + first), &entry, &exit);
+    cp_ray_slab8(_mm256_set1_ps(ray->origin.y), _mm256_set1_ps(ray->invDirection.y), _mm256_loadu_ps(boxes->minY + first), _mm256_loadu_ps(boxes->maxY + first), &entry, &exit);
+    cp_ray_slab8(_mm256_set1_ps(ray->origin.z), _mm256_set1_ps(ray->invDirection.z), _mm256_loadu_ps(boxes->minZ + first), _mm256_loadu_ps(boxes->maxZ + first), &entry, &exit);
+
+    _mm256_storeu_ps(o_entry, entry);
+    _mm256_storeu_ps(o_exit, exit);
+    return _mm256_movemask_ps(_mm256_cmp_ps(entry, exit, _CMP_LE_OQ));
+}
+
+// Tests 8 rays against one box. Returns a mask with bit i set if ray i is hit.
+static CP_INLINE int cp_ray8_intersect_aabb(const cp_ray8* rays, cp_aabb box, float tMax, float o_entry[8], float o_exit[8])
+{
+    __m256 entry = _mm256_setzero_ps();
+    __m256 exit = _mm256_set1_ps(tMax);
+
+    cp_ray_slab8(rays->originX, rays->invDirectionX, _mm256_set1_ps(box.min.x), _mm256_set1_ps(box.max.x), &entry, &exit);
+    cp_ray_slab8(rays->originY, rays->invDirectionY, _mm256_set1_ps(box.min.y), _mm256_set1_ps(box.max.y), &entry, &exit);
+    cp_ray_slab8(rays->originZ, rays->invDirectionZ, _mm256_set1_ps(box.min.z), _mm256_set1_ps(box.max.z), &entry, &exit);
+
+    _mm256_storeu_ps(o_entry, entry);
+    _mm256_storeu_ps(o_exit, exit);
+    return _mm256_movemask_ps(_mm256_cmp_ps(entry, exit, _CMP_LE_OQ));
+}
+#endif
+
 /**
  * Type Aliases and Generic Functions
  */
@@ -1588,6 +2244,8 @@ typedef cp_uvec4 uvec4;
 typedef cp_uvec3 uvec3;
 typedef cp_uvec2 uvec2;
 
+typedef cp_mat4 mat4;
+
 typedef struct INVALID_GENERIC_ARGUMENT {} INVALID_GENERIC_ARGUMENT;
 INVALID_GENERIC_ARGUMENT *invalid_type_for_generic_function();
 